@@ -0,0 +1,351 @@
+#define _POSIX_C_SOURCE 199309L
+
+#define TECHNICALLYFLAC_IMPLEMENTATION
+#include "../technicallyflac.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/* encoders for the "specialized" flag, the common configurations */
+TECHNICALLYFLAC_ENCODER(16,1)
+TECHNICALLYFLAC_ENCODER(16,2)
+TECHNICALLYFLAC_ENCODER(16,9)
+TECHNICALLYFLAC_ENCODER(16,10)
+TECHNICALLYFLAC_ENCODER(16,11)
+TECHNICALLYFLAC_ENCODER(24,1)
+TECHNICALLYFLAC_ENCODER(24,2)
+TECHNICALLYFLAC_ENCODER(24,9)
+TECHNICALLYFLAC_ENCODER(24,10)
+TECHNICALLYFLAC_ENCODER(24,11)
+
+/* throughput of technicallyflac_frame and technicallyflac_metadata.
+ *
+ * Sweeps bitdepth, channels (including the stereo modes 9-11), blocksize,
+ * a few kinds of audio and the optional flags, writing each frame either
+ * into a buffer big enough for the whole frame or one byte at a time
+ * (like examples/example-flac.c). Results go to stdout as CSV, one line
+ * per case:
+ *
+ *   test,signal,bitdepth,channels,blocksize,flags,buffer,bytes,seconds,mb_per_s,ns_per_sample
+ *
+ * mb_per_s is bytes written (10^6 bytes) per second, ns_per_sample is per
+ * sample of a single channel. For the metadata tests blocksize is the
+ * block length and there are no samples.
+ *
+ * usage: bench [-t ms] [-d bitdepths] [-c channels] [-n blocksizes]
+ *              [-s signals] [-f flags] [-b buffers] [-m]
+ *   lists are comma-separated, eg. bench -d 16,24 -c 2,11 -s noise
+ *   signals: noise,silence,sine   buffers: full,1
+ *   flags: none,fixed+wasted+constant,verify,specialized
+ *   -m only runs the metadata tests
+ *
+ * fixed+wasted+constant turns on those three flags, verify is the same
+ * plus TECHNICALLYFLAC_FLAG_VERIFY (full buffers only), specialized is none
+ * with the TECHNICALLYFLAC_ENCODER encoders (16 and 24-bit, 1, 2 and 9-11
+ * channels only) */
+
+#define MAX_LIST 64
+
+/* blocks of audio to cycle through, so every frame isn't the same one */
+#define BLOCKS 4
+
+static const char *signal_names[] = { "noise", "silence", "sine" };
+
+static const char *flag_names[] = { "none", "fixed+wasted+constant", "verify", "specialized" };
+
+static const uint32_t flag_values[] = {
+    0,
+    TECHNICALLYFLAC_FLAG_FIXED | TECHNICALLYFLAC_FLAG_WASTED | TECHNICALLYFLAC_FLAG_CONSTANT,
+    TECHNICALLYFLAC_FLAG_FIXED | TECHNICALLYFLAC_FLAG_WASTED | TECHNICALLYFLAC_FLAG_CONSTANT | TECHNICALLYFLAC_FLAG_VERIFY,
+    0
+};
+
+#define FLAG_SPECIALIZED 3
+
+typedef int (*frame_func)(technicallyflac *, uint8_t *, uint32_t *, uint32_t, int32_t **);
+
+/* the specialized encoder for bitdepth and channels, or NULL */
+static frame_func encoder_specialized(uint32_t bitdepth, uint32_t channels) {
+    switch(bitdepth * 100 + channels) {
+        case 1601: return technicallyflac_frame_16_1;
+        case 1602: return technicallyflac_frame_16_2;
+        case 1609: return technicallyflac_frame_16_9;
+        case 1610: return technicallyflac_frame_16_10;
+        case 1611: return technicallyflac_frame_16_11;
+        case 2401: return technicallyflac_frame_24_1;
+        case 2402: return technicallyflac_frame_24_2;
+        case 2409: return technicallyflac_frame_24_9;
+        case 2410: return technicallyflac_frame_24_10;
+        case 2411: return technicallyflac_frame_24_11;
+        default: break;
+    }
+    return NULL;
+}
+
+struct list_s {
+    uint32_t val[MAX_LIST];
+    uint32_t len;
+};
+
+typedef struct list_s list;
+
+static uint32_t ms = 20;
+
+static uint32_t rng_state = 2463534242U;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+static void list_set(list *l, const uint32_t *vals, uint32_t len) {
+    memcpy(l->val,vals,sizeof(uint32_t) * len);
+    l->len = len;
+}
+
+/* parses "a,b,c", names (if not NULL) are looked up instead of parsing numbers */
+static int list_parse(list *l, const char *str, const char **names, uint32_t names_len) {
+    char buf[256];
+    char *tok;
+    uint32_t i;
+
+    if(strlen(str) >= sizeof(buf)) return -1;
+    strcpy(buf,str);
+    l->len = 0;
+
+    for(tok = strtok(buf,","); tok != NULL; tok = strtok(NULL,",")) {
+        if(l->len == MAX_LIST) return -1;
+        if(names != NULL) {
+            for(i=0;i<names_len;i++) {
+                if(strcmp(tok,names[i]) == 0) break;
+            }
+            if(i == names_len) return -1;
+            l->val[l->len++] = i;
+        } else {
+            l->val[l->len++] = (uint32_t)strtoul(tok,NULL,10);
+        }
+    }
+    return l->len ? 0 : -1;
+}
+
+static void generate(int32_t *samples, uint32_t len, uint8_t bitdepth, uint32_t signal, uint32_t channel) {
+    double amp = (double)(((uint64_t)1 << (bitdepth - 1)) - 1) / 2;
+    uint32_t i;
+
+    for(i=0;i<len;i++) {
+        switch(signal) {
+            case 0: samples[i] = (int32_t)rng() >> (32 - bitdepth); break;
+            case 1: samples[i] = 0; break;
+            default: samples[i] = (int32_t)(amp * sin((2.0 * 3.14159265358979 * 440.0 * i / 44100.0) + channel)); break;
+        }
+    }
+}
+
+static void report(const char *test, const char *signal, uint32_t bitdepth, uint32_t channels, uint32_t blocksize,
+  const char *flags, uint32_t buffer, uint64_t bytes, uint64_t samples, double seconds) {
+    printf("%s,%s,%u,%u,%u,%s,",test,signal,bitdepth,channels,blocksize,flags);
+    if(buffer) printf("%u,",buffer);
+    else printf("full,");
+    printf("%llu,%.6f,%.2f,",(unsigned long long)bytes,seconds,(double)bytes / seconds / 1e6);
+    if(samples) printf("%.3f\n",seconds * 1e9 / (double)samples);
+    else printf("\n");
+    fflush(stdout);
+}
+
+static int bench_frame(uint32_t bitdepth, uint32_t channels, uint32_t blocksize, uint32_t signal, uint32_t flags, uint32_t buffer) {
+    technicallyflac f;
+    frame_func frame = technicallyflac_frame;
+    uint8_t nch = (uint8_t)(channels < 9 ? channels : 2);
+    int32_t *samplesbuf;
+    int32_t *frames[BLOCKS][8];
+    void *workspace = NULL;
+    uint8_t *output;
+    uint32_t outlen;
+    uint32_t len;
+    uint64_t bytes = 0;
+    uint64_t samples = 0;
+    double start;
+    double elapsed;
+    uint32_t b;
+    uint32_t c;
+    int r;
+
+    if(technicallyflac_init(&f,blocksize,44100,(uint8_t)channels,(uint8_t)bitdepth) != 0) return -1;
+
+    if(flags == FLAG_SPECIALIZED) {
+        frame = encoder_specialized(bitdepth,channels);
+    } else if(flags) {
+        workspace = malloc(technicallyflac_size_workspace(blocksize));
+        if(workspace == NULL) abort();
+        technicallyflac_set_workspace(&f,workspace,technicallyflac_size_workspace(blocksize));
+        technicallyflac_set_flags(&f,flag_values[flags]);
+    }
+
+    samplesbuf = (int32_t *)malloc(sizeof(int32_t) * blocksize * nch * BLOCKS);
+    if(samplesbuf == NULL) abort();
+    for(b=0;b<BLOCKS;b++) {
+        for(c=0;c<nch;c++) {
+            frames[b][c] = &samplesbuf[((b * nch) + c) * blocksize];
+            generate(frames[b][c],blocksize,(uint8_t)bitdepth,signal,c);
+        }
+    }
+
+    outlen = buffer ? buffer : technicallyflac_size_frame(blocksize,(uint8_t)channels,(uint8_t)bitdepth);
+    output = (uint8_t *)malloc(outlen);
+    if(output == NULL) abort();
+
+    start = now();
+    do {
+        for(b=0;b<BLOCKS;b++) {
+            do {
+                len = outlen;
+                r = frame(&f,output,&len,blocksize,frames[b]);
+                bytes += len;
+            } while(r == 1);
+            if(r != 0) abort();
+        }
+        samples += (uint64_t)blocksize * nch * BLOCKS;
+        elapsed = now() - start;
+    } while(elapsed * 1000 < ms);
+
+    report("frame",signal_names[signal],bitdepth,channels,blocksize,flag_names[flags],buffer,bytes,samples,elapsed);
+
+    free(output);
+    free(samplesbuf);
+    free(workspace);
+    return 0;
+}
+
+static uint32_t bench_read(uint8_t *buffer, uint32_t len, void *userdata) {
+    uint8_t **src = (uint8_t **)userdata;
+    memcpy(buffer,*src,len);
+    *src += len;
+    return len;
+}
+
+static void bench_metadata(uint32_t block_length, uint32_t buffer, int callback) {
+    technicallyflac f;
+    uint8_t *block;
+    uint8_t *src;
+    uint8_t *output;
+    uint32_t outlen;
+    uint32_t len;
+    uint64_t bytes = 0;
+    double start;
+    double elapsed;
+    uint32_t i;
+    int r;
+
+    technicallyflac_init(&f,4096,44100,2,16);
+
+    block = (uint8_t *)malloc(block_length);
+    if(block == NULL) abort();
+    for(i=0;i<block_length;i++) block[i] = (uint8_t)rng();
+
+    outlen = buffer ? buffer : technicallyflac_size_metadata(block_length);
+    output = (uint8_t *)malloc(outlen);
+    if(output == NULL) abort();
+
+    start = now();
+    do {
+        src = block;
+        do {
+            len = outlen;
+            if(callback) r = technicallyflac_metadata_read(&f,output,&len,1,6,block_length,bench_read,&src);
+            else r = technicallyflac_metadata(&f,output,&len,1,6,block_length,block);
+            bytes += len;
+        } while(r == 1);
+        elapsed = now() - start;
+    } while(elapsed * 1000 < ms);
+
+    report(callback ? "metadata_read" : "metadata","-",0,0,block_length,"none",buffer,bytes,0,elapsed);
+
+    free(output);
+    free(block);
+}
+
+int main(int argc, const char *argv[]) {
+    static const uint32_t default_bitdepths[] = { 4, 8, 12, 16, 20, 24, 28, 32 };
+    static const uint32_t default_channels[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+    static const uint32_t default_blocksizes[] = { 16, 192, 1152, 4096, 16384, 65535 };
+    static const uint32_t default_signals[] = { 0, 1, 2 };
+    static const uint32_t default_flags[] = { 0, 1, 2, 3 };
+    static const uint32_t default_buffers[] = { 0, 1 };
+    static const uint32_t metadata_lengths[] = { 16, 1024, 65536, 1048576, 10485760 };
+    static const char *buffer_names[] = { "full", "1" };
+    list bitdepths;
+    list channels;
+    list blocksizes;
+    list signals;
+    list flags;
+    list buffers;
+    int metadata_only = 0;
+    uint32_t d, c, n, s, fl, b;
+    int i;
+
+    list_set(&bitdepths,default_bitdepths,sizeof(default_bitdepths) / sizeof(uint32_t));
+    list_set(&channels,default_channels,sizeof(default_channels) / sizeof(uint32_t));
+    list_set(&blocksizes,default_blocksizes,sizeof(default_blocksizes) / sizeof(uint32_t));
+    list_set(&signals,default_signals,sizeof(default_signals) / sizeof(uint32_t));
+    list_set(&flags,default_flags,sizeof(default_flags) / sizeof(uint32_t));
+    list_set(&buffers,default_buffers,sizeof(default_buffers) / sizeof(uint32_t));
+
+    for(i=1;i<argc;i++) {
+        int e = 0;
+        if(strcmp(argv[i],"-m") == 0) {
+            metadata_only = 1;
+            continue;
+        }
+        if(i + 1 == argc) e = -1;
+        else if(strcmp(argv[i],"-t") == 0) ms = (uint32_t)strtoul(argv[++i],NULL,10);
+        else if(strcmp(argv[i],"-d") == 0) e = list_parse(&bitdepths,argv[++i],NULL,0);
+        else if(strcmp(argv[i],"-c") == 0) e = list_parse(&channels,argv[++i],NULL,0);
+        else if(strcmp(argv[i],"-n") == 0) e = list_parse(&blocksizes,argv[++i],NULL,0);
+        else if(strcmp(argv[i],"-s") == 0) e = list_parse(&signals,argv[++i],signal_names,3);
+        else if(strcmp(argv[i],"-f") == 0) e = list_parse(&flags,argv[++i],flag_names,4);
+        else if(strcmp(argv[i],"-b") == 0) e = list_parse(&buffers,argv[++i],buffer_names,2);
+        else e = -1;
+        if(e != 0) {
+            fprintf(stderr,"Usage: %s [-t ms] [-d bitdepths] [-c channels] [-n blocksizes] [-s signals] [-f flags] [-b buffers] [-m]\n",argv[0]);
+            return 1;
+        }
+    }
+
+    printf("test,signal,bitdepth,channels,blocksize,flags,buffer,bytes,seconds,mb_per_s,ns_per_sample\n");
+
+    if(!metadata_only) {
+        for(d=0;d<bitdepths.len;d++)
+        for(c=0;c<channels.len;c++)
+        for(n=0;n<blocksizes.len;n++)
+        for(s=0;s<signals.len;s++)
+        for(fl=0;fl<flags.len;fl++)
+        for(b=0;b<buffers.len;b++) {
+            /* verify needs room for the whole frame */
+            if((flag_values[flags.val[fl]] & TECHNICALLYFLAC_FLAG_VERIFY) && buffers.val[b]) continue;
+            if(flags.val[fl] == FLAG_SPECIALIZED && encoder_specialized(bitdepths.val[d],channels.val[c]) == NULL) continue;
+            if(bench_frame(bitdepths.val[d],channels.val[c],blocksizes.val[n],signals.val[s],flags.val[fl],buffers.val[b]) != 0) {
+                fprintf(stderr,"skipping bitdepth %u, channels %u, blocksize %u: init failed\n",
+                  bitdepths.val[d],channels.val[c],blocksizes.val[n]);
+            }
+        }
+    }
+
+    for(n=0;n<sizeof(metadata_lengths) / sizeof(uint32_t);n++)
+    for(b=0;b<buffers.len;b++) {
+        bench_metadata(metadata_lengths[n],buffers.val[b],0);
+        bench_metadata(metadata_lengths[n],buffers.val[b],1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "example-shared.h"
+
+#define TECHNICALLYFLAC_IMPLEMENTATION
+#include "../technicallyflac.h"
+#define TECHNICALLYFLAC_BROADCAST_IMPLEMENTATION
+#include "../technicallyflac_broadcast.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+/* example that reads in a headerless WAV file and streams it live over
+ * HTTP, in real time, to any number of listeners on 127.0.0.1. Each block is
+ * encoded once no matter how many are listening. assumes WAV is 16-bit,
+ * 2channel, 44100Hz
+ *
+ *     example-broadcast your-audio.raw 8000
+ *     curl http://127.0.0.1:8000/ > out.flac (or point a player at it)
+ */
+
+/* headerless wav can be created via ffmpeg like:
+ *     ffmpeg -i your-audio.mp3 -ar 44100 -ac 2 -f s16le your-audio.raw
+ */
+
+#define BLOCKSIZE 4410 /* 100ms */
+#define MAX_LISTENERS 64
+
+/* new listeners get the last second of audio straight away */
+#define BACKLOG 10
+
+/* keep 5 seconds of frames for listeners that fall behind */
+#define RING_FRAMES 50
+
+#define HTTP_RESPONSE "HTTP/1.0 200 OK\r\nContent-Type: audio/flac\r\nCache-Control: no-cache\r\n\r\n"
+
+struct client_s {
+    int fd;
+    uint32_t response;  /* bytes of HTTP_RESPONSE sent */
+    int requested;      /* the request has come in */
+    technicallyflac_listener l;
+};
+
+typedef struct client_s client;
+
+static client clients[MAX_LISTENERS];
+static uint32_t clients_len = 0;
+
+static double
+now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+static void
+drop_client(uint32_t i) {
+    close(clients[i].fd);
+    clients[i] = clients[--clients_len];
+}
+
+/* sends whatever the client can take right now, returns -1 to drop it */
+static int
+send_client(technicallyflac_broadcast *b, client *c) {
+    const uint8_t *data;
+    uint32_t len;
+    ssize_t r;
+    int d;
+
+    while(c->response < sizeof(HTTP_RESPONSE) - 1) {
+        r = send(c->fd,&HTTP_RESPONSE[c->response],sizeof(HTTP_RESPONSE) - 1 - c->response,0);
+        if(r < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        c->response += (uint32_t)r;
+    }
+
+    while((d = technicallyflac_broadcast_data(b,&c->l,&data,&len)) == 0) {
+        r = send(c->fd,data,len,0);
+        if(r < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        technicallyflac_broadcast_sent(b,&c->l,(uint32_t)r);
+    }
+
+    /* too slow, it missed part of a frame */
+    return d < 0 ? -1 : 0;
+}
+
+int main(int argc, const char *argv[]) {
+    technicallyflac f;
+    technicallyflac_broadcast b;
+    technicallyflac_broadcast_slot slots[RING_FRAMES];
+    struct pollfd fds[MAX_LISTENERS + 1];
+    struct sockaddr_in addr;
+    uint8_t *header;
+    uint32_t header_len;
+    const uint8_t *data;
+    uint32_t len;
+    uint8_t *ring;
+    uint32_t ring_len;
+    uint8_t *tags;
+    uint32_t tags_len;
+    int16_t *raw_samples;
+    char request[1024];
+    FILE *input;
+    uint32_t frames;
+    double next;
+    double wait;
+    int server;
+    int fd;
+    int one = 1;
+    int eof = 0;
+    uint32_t i;
+
+    if(argc < 3) {
+        printf("Usage: %s /path/to/raw port\n",argv[0]);
+        return 1;
+    }
+
+    input = fopen(argv[1],"rb");
+    if(input == NULL) return 1;
+
+    /* listeners going away show up as send errors */
+    signal(SIGPIPE,SIG_IGN);
+
+    technicallyflac_init(&f,BLOCKSIZE,44100,2,16);
+
+    /* the header every listener gets first. There's no end to a live stream,
+     * STREAMINFO just says the length is unknown */
+    tags = create_tags(&tags_len);
+    header = (uint8_t *)malloc(technicallyflac_size_streammarker() + technicallyflac_size_streaminfo() + technicallyflac_size_metadata(tags_len));
+    if(header == NULL) abort();
+    header_len = technicallyflac_size_streammarker();
+    technicallyflac_streammarker(&f,header,&header_len);
+    len = technicallyflac_size_streaminfo();
+    technicallyflac_streaminfo(&f,&header[header_len],&len,0);
+    header_len += len;
+    len = technicallyflac_size_metadata(tags_len);
+    technicallyflac_metadata(&f,&header[header_len],&len,1,4,tags_len,tags);
+    header_len += len;
+
+    ring_len = technicallyflac_broadcast_size(&f,RING_FRAMES);
+    ring = (uint8_t *)malloc(ring_len);
+    if(ring == NULL) abort();
+    if(technicallyflac_broadcast_init(&b,&f,header,header_len,ring,ring_len,slots,RING_FRAMES) != 0) abort();
+
+    raw_samples = (int16_t *)malloc(sizeof(int16_t) * 2 * BLOCKSIZE);
+    if(raw_samples == NULL) abort();
+
+    server = socket(AF_INET,SOCK_STREAM,0);
+    if(server < 0) return 1;
+    setsockopt(server,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(server,(struct sockaddr *)&addr,sizeof(addr)) != 0 || listen(server,16) != 0) {
+        printf("unable to listen on port %s\n",argv[2]);
+        return 1;
+    }
+
+    next = now();
+    while(!eof || clients_len) {
+        /* encode a block whenever one is due, once for everybody */
+        while(!eof && now() >= next) {
+            frames = (uint32_t)fread(raw_samples,sizeof(int16_t) * 2,BLOCKSIZE,input);
+            if(frames == 0) {
+                eof = 1;
+                break;
+            }
+            if(technicallyflac_broadcast_frame_interleaved(&b,frames,raw_samples,TECHNICALLYFLAC_FORMAT_S16LE) != 0) abort();
+            next += (double)frames / 44100.0;
+        }
+
+        /* once the audio runs out, finish sending to everybody who's caught up */
+        fds[0].fd = eof ? -1 : server;
+        fds[0].events = POLLIN;
+        for(i=0;i<clients_len;i++) {
+            fds[i+1].fd = clients[i].fd;
+            fds[i+1].events = clients[i].requested ? 0 : POLLIN;
+            if(clients[i].requested &&
+              (clients[i].response < sizeof(HTTP_RESPONSE) - 1 || technicallyflac_broadcast_data(&b,&clients[i].l,&data,&len) != 1)) {
+                fds[i+1].events |= POLLOUT;
+            }
+        }
+
+        wait = (next - now()) * 1000;
+        if(poll(fds,clients_len + 1,eof ? 100 : (wait > 0 ? (int)wait + 1 : 0)) < 0 && errno != EINTR) break;
+
+        for(i=clients_len;i>0;i--) {
+            client *c = &clients[i-1];
+            if(fds[i].revents & (POLLERR | POLLHUP)) {
+                drop_client(i-1);
+                continue;
+            }
+            if(fds[i].revents & POLLIN) {
+                /* a stand-in for HTTP, any request gets the stream */
+                if(recv(c->fd,request,sizeof(request),0) <= 0) {
+                    drop_client(i-1);
+                    continue;
+                }
+                c->requested = 1;
+                technicallyflac_broadcast_join(&b,&c->l,BACKLOG);
+            }
+            if(c->requested && send_client(&b,c) != 0) {
+                drop_client(i-1);
+                continue;
+            }
+            if(eof && c->requested && technicallyflac_broadcast_data(&b,&c->l,&data,&len) == 1) {
+                drop_client(i-1);
+            }
+        }
+
+        if(fds[0].revents & POLLIN) {
+            fd = accept(server,NULL,NULL);
+            if(fd >= 0) {
+                if(clients_len == MAX_LISTENERS) {
+                    close(fd);
+                } else {
+                    fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) | O_NONBLOCK);
+                    clients[clients_len].fd = fd;
+                    clients[clients_len].response = 0;
+                    clients[clients_len].requested = 0;
+                    clients_len++;
+                }
+            }
+        }
+    }
+
+    close(server);
+    fclose(input);
+    quit(0,tags,header,raw_samples,ring,NULL);
+    return 0;
+}
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+
+#include "example-shared.h"
+
+#define TECHNICALLYFLAC_IMPLEMENTATION
+#include "../technicallyflac.h"
+#define TECHNICALLYFLAC_MMAP_IMPLEMENTATION
+#include "../technicallyflac_mmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* same as example-flac, but converts a whole file at once: the output is
+ * sized up front and mapped, and each thread encodes every THREADS-th frame
+ * straight into its place in the file. assumes WAV is 16-bit, 2channel, 44100Hz */
+
+/* headerless wav can be created via ffmpeg like:
+ *     ffmpeg -i your-audio.mp3 -ar 44100 -ac 2 -f s16le your-audio.raw
+ */
+
+#define THREADS 4
+#define BLOCKSIZE 4096
+
+struct worker_s {
+    pthread_t thread;
+    technicallyflac_mmap *m;
+    const int16_t *samples;
+    uint64_t first;
+    int failed;
+};
+
+typedef struct worker_s worker;
+
+static void *
+encode(void *arg) {
+    worker *w = (worker *)arg;
+    uint64_t n;
+
+    for(n=w->first;n<technicallyflac_mmap_frames(w->m);n+=THREADS) {
+        if(technicallyflac_mmap_frame_interleaved(w->m,n,&w->samples[n * BLOCKSIZE * 2],TECHNICALLYFLAC_FORMAT_S16LE) != 0) {
+            w->failed = 1;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, const char *argv[]) {
+    technicallyflac f;
+    technicallyflac_mmap m;
+    technicallyflac_seekpoint points[100];
+    worker workers[THREADS];
+    struct stat st;
+    FILE *input;
+    int16_t *raw_samples;
+    uint8_t *tags;
+    uint8_t *metadata;
+    uint32_t tags_len;
+    uint32_t metadata_len;
+    uint64_t total_samples;
+    int output;
+    int failed = 0;
+    int i;
+
+    if(argc < 3) {
+        printf("Usage: %s /path/to/raw /path/to/flac\n",argv[0]);
+        return 1;
+    }
+
+    input = fopen(argv[1],"rb");
+    if(input == NULL) return 1;
+    if(fstat(fileno(input),&st) != 0) return 1;
+
+    total_samples = (uint64_t)st.st_size / (sizeof(int16_t) * 2);
+    if(total_samples == 0) return 1;
+
+    raw_samples = (int16_t *)malloc(total_samples * sizeof(int16_t) * 2);
+    if(raw_samples == NULL) abort();
+    if(fread(raw_samples,sizeof(int16_t) * 2,total_samples,input) != total_samples) abort();
+    fclose(input);
+
+    output = open(argv[2],O_RDWR | O_CREAT | O_TRUNC,0644);
+    if(output < 0) return 1;
+
+    technicallyflac_init(&f,BLOCKSIZE,44100,2,16);
+    technicallyflac_set_seektable(&f,points,100,44100 * 10);
+
+    tags = create_tags(&tags_len);
+    metadata_len = technicallyflac_size_metadata(tags_len);
+    metadata = (uint8_t *)malloc(metadata_len);
+    if(metadata == NULL) abort();
+    technicallyflac_metadata(&f,metadata,&metadata_len,1,4,tags_len,tags);
+
+    if(technicallyflac_mmap_init(&m,&f,output,total_samples,metadata,metadata_len) != 0) {
+        perror("unable to set up the output");
+        return 1;
+    }
+
+    for(i=0;i<THREADS;i++) {
+        workers[i].m = &m;
+        workers[i].samples = raw_samples;
+        workers[i].first = (uint64_t)i;
+        workers[i].failed = 0;
+        if(pthread_create(&workers[i].thread,NULL,encode,&workers[i]) != 0) abort();
+    }
+    for(i=0;i<THREADS;i++) {
+        pthread_join(workers[i].thread,NULL);
+        failed |= workers[i].failed;
+    }
+    if(failed) abort();
+
+    if(technicallyflac_mmap_finish(&m) != 0) {
+        perror("unable to finish the output");
+        return 1;
+    }
+
+    close(output);
+    quit(0,tags,metadata,raw_samples,NULL);
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "example-shared.h"
+
+#define TECHNICALLYFLAC_IMPLEMENTATION
+#include "../technicallyflac.h"
+#define TECHNICALLYFLAC_MT_IMPLEMENTATION
+#include "../technicallyflac_mt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* same as example-flac, but encodes batches of blocks on several threads.
+ * assumes WAV is 16-bit, 2channel, 44100Hz */
+
+/* headerless wav can be created via ffmpeg like:
+ *     ffmpeg -i your-audio.mp3 -ar 44100 -ac 2 -f s16le your-audio.raw
+ */
+
+#define BUFFER_SIZE 8192
+#define THREADS 4
+#define BATCH_BLOCKS 256
+
+int main(int argc, const char *argv[]) {
+    uint8_t buffer[BUFFER_SIZE];
+    uint32_t bufferlen = BUFFER_SIZE;
+    FILE *input;
+    FILE *output;
+    size_t frames;
+    size_t bytes;
+    int16_t *raw_samples;
+    uint8_t *frame_buffer;
+    uint8_t *tags;
+    uint32_t tags_len;
+    technicallyflac f;
+    technicallyflac_mt mt;
+
+    if(argc < 3) {
+        printf("Usage: %s /path/to/raw /path/to/flac\n",argv[0]);
+        return 1;
+    }
+
+    input = fopen(argv[1],"rb");
+    if(input == NULL) return 1;
+
+    output = fopen(argv[2],"wb");
+    if(output == NULL) {
+        fclose(input);
+        return 1;
+    }
+
+    tags = create_tags(&tags_len);
+
+    technicallyflac_init(&f,4096,44100,2,16);
+    technicallyflac_set_flags(&f,TECHNICALLYFLAC_FLAG_WASTED | TECHNICALLYFLAC_FLAG_MD5);
+
+    if(technicallyflac_mt_init(&mt,&f,THREADS) != 0) abort();
+
+    raw_samples = (int16_t *)malloc(sizeof(int16_t) * f.channels * f.blocksize * BATCH_BLOCKS);
+    if(!raw_samples) abort();
+
+    frame_buffer = (uint8_t *)malloc(technicallyflac_mt_size(&f,f.blocksize * BATCH_BLOCKS));
+    if(!frame_buffer) abort();
+
+    technicallyflac_streammarker(&f,buffer,&bufferlen);
+    fwrite(buffer,1,bufferlen,output);
+    bufferlen = BUFFER_SIZE;
+
+    technicallyflac_streaminfo(&f,buffer,&bufferlen,0);
+    fwrite(buffer,1,bufferlen,output);
+    bufferlen = BUFFER_SIZE;
+
+    technicallyflac_metadata(&f,buffer,&bufferlen,1,4,tags_len,tags);
+    fwrite(buffer,1,bufferlen,output);
+    bufferlen = BUFFER_SIZE;
+
+    while((frames = fread(raw_samples,sizeof(int16_t) * 2, f.blocksize * BATCH_BLOCKS, input)) > 0) {
+        if(technicallyflac_mt_frames_interleaved(&mt,frame_buffer,&bytes,frames,raw_samples,TECHNICALLYFLAC_FORMAT_S16LE,NULL) != 0) abort();
+        fwrite(frame_buffer,1,bytes,output);
+    }
+
+    bufferlen = BUFFER_SIZE;
+    technicallyflac_streaminfo_finalize(&f,buffer,&bufferlen);
+    fseek(output,8,SEEK_SET);
+    fwrite(buffer,1,bufferlen,output);
+
+    technicallyflac_mt_free(&mt);
+    fclose(input);
+    fclose(output);
+    quit(0,tags,raw_samples,frame_buffer, NULL);
+
+    return 0;
+}
@@ -14,21 +14,24 @@
  *     ffmpeg -i your-audio.mp3 -ar 44100 -ac 2 -f s16le your-audio.raw
  */
 
-/* example assumes we're on a little-endian system - would need to have
- * a proper decoder for input WAV data. */
-
 #define BUFFER_SIZE 1
 
+/* room for a seek point every 10 seconds of a 30-minute file */
+#define SEEKPOINTS 180
+#define SEEKSPACING (44100 * 10)
+
 
 int main(int argc, const char *argv[]) {
     uint8_t buffer[BUFFER_SIZE];
+    uint8_t streaminfo[34];
+    technicallyflac_seekpoint seekpoints[SEEKPOINTS];
+    long seektable_pos;
     uint32_t bufferlen = BUFFER_SIZE;
     FILE *input;
     FILE *output;
     uint32_t frames;
     int16_t *raw_samples;
-    int32_t *samples[2];
-    int32_t *samplesbuf;
+    void *workspace;
     uint8_t *tags;
     uint32_t tags_len;
     technicallyflac f;
@@ -54,10 +57,13 @@ int main(int argc, const char *argv[]) {
 
     raw_samples = (int16_t *)malloc(sizeof(int16_t) * f.channels * f.blocksize);
     if(!raw_samples) abort();
-    samplesbuf = (int32_t *)malloc(sizeof(int32_t) * f.channels * f.blocksize);
-    if(!samplesbuf) abort();
-    samples[0] = &samplesbuf[0];
-    samples[1] = &samplesbuf[f.blocksize];
+
+    /* compress with the fixed predictors */
+    workspace = malloc(technicallyflac_size_workspace(f.blocksize));
+    if(!workspace) abort();
+    technicallyflac_set_workspace(&f,workspace,technicallyflac_size_workspace(f.blocksize));
+    technicallyflac_set_flags(&f,TECHNICALLYFLAC_FLAG_FIXED | TECHNICALLYFLAC_FLAG_WASTED | TECHNICALLYFLAC_FLAG_MD5);
+    technicallyflac_set_seektable(&f,seekpoints,SEEKPOINTS,SEEKSPACING);
 
     while(technicallyflac_streammarker(&f,buffer,&bufferlen)) {
         fwrite(buffer,1,bufferlen,output);
@@ -75,6 +81,16 @@ int main(int argc, const char *argv[]) {
     fwrite(buffer,1,bufferlen,output);
     bufferlen = BUFFER_SIZE;
 
+    /* reserve space for the seektable, it gets filled in at the end */
+    seektable_pos = ftell(output);
+    while(technicallyflac_seektable(&f,buffer,&bufferlen,0)) {
+        fwrite(buffer,1,bufferlen,output);
+        bufferlen = BUFFER_SIZE;
+    }
+
+    fwrite(buffer,1,bufferlen,output);
+    bufferlen = BUFFER_SIZE;
+
     while(technicallyflac_metadata(&f,buffer,&bufferlen,1, 4,tags_len, tags)) {
         fwrite(buffer,1,bufferlen,output);
         bufferlen = BUFFER_SIZE;
@@ -84,9 +100,8 @@ int main(int argc, const char *argv[]) {
     bufferlen = BUFFER_SIZE;
 
     while((frames = fread(raw_samples,sizeof(int16_t) * 2, f.blocksize, input)) > 0) {
-        repack_samples_deinterleave(samples,raw_samples,2,frames, 0);
-
-        while(technicallyflac_frame(&f,buffer,&bufferlen,frames,samples)) {
+        /* samples can be passed in as-is, no need to deinterleave */
+        while(technicallyflac_frame_interleaved(&f,buffer,&bufferlen,frames,raw_samples,TECHNICALLYFLAC_FORMAT_S16LE)) {
             fwrite(buffer,1,bufferlen,output);
             bufferlen = BUFFER_SIZE;
         }
@@ -94,9 +109,25 @@ int main(int argc, const char *argv[]) {
         bufferlen = BUFFER_SIZE;
     }
 
+    /* now that the totals and MD5 are known, write the STREAMINFO
+     * body over the one at the start of the file */
+    bufferlen = sizeof(streaminfo);
+    technicallyflac_streaminfo_finalize(&f,streaminfo,&bufferlen);
+    fseek(output,8,SEEK_SET);
+    fwrite(streaminfo,1,bufferlen,output);
+    bufferlen = BUFFER_SIZE;
+
+    /* and the seektable over the placeholder */
+    fseek(output,seektable_pos,SEEK_SET);
+    while(technicallyflac_seektable(&f,buffer,&bufferlen,0)) {
+        fwrite(buffer,1,bufferlen,output);
+        bufferlen = BUFFER_SIZE;
+    }
+    fwrite(buffer,1,bufferlen,output);
+
     fclose(input);
     fclose(output);
-    quit(0,tags,raw_samples,samplesbuf, NULL);
+    quit(0,tags,raw_samples, NULL);
 
     return 0;
 }
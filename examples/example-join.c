@@ -0,0 +1,150 @@
+#define TECHNICALLYFLAC_IMPLEMENTATION
+#include "../technicallyflac.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* example that joins FLAC files into one without re-encoding, the frames
+ * are only renumbered. The files need the same samplerate, channels and
+ * bitdepth. Only STREAMINFO is kept from the metadata.
+ *
+ *     example-join out.flac hour1.flac hour2.flac ...
+ */
+
+/* reads the STREAMINFO block at the start of a file */
+static int
+read_streaminfo(const char *path, technicallyflac_decoder *d) {
+    FILE *in;
+    uint8_t header[42];
+    uint32_t used;
+
+    in = fopen(path,"rb");
+    if(in == NULL) return -1;
+    if(fread(header,1,sizeof(header),in) != sizeof(header)) {
+        fclose(in);
+        return -1;
+    }
+    fclose(in);
+
+    technicallyflac_decoder_init(d);
+    if(technicallyflac_decode_metadata(d,header,sizeof(header),&used) < 0 || used == 0 || d->block_type != 0) return -1;
+    return 0;
+}
+
+static uint8_t *
+read_file(const char *path, uint32_t *len) {
+    FILE *in;
+    uint8_t *data;
+    long size;
+
+    in = fopen(path,"rb");
+    if(in == NULL) return NULL;
+
+    fseek(in,0,SEEK_END);
+    size = ftell(in);
+    fseek(in,0,SEEK_SET);
+
+    data = (uint8_t *)malloc(size > 0 ? size : 1);
+    if(data == NULL) abort();
+    if(fread(data,1,size,in) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(in);
+    *len = (uint32_t)size;
+    return data;
+}
+
+int main(int argc, const char *argv[]) {
+    technicallyflac f;
+    technicallyflac_decoder d;
+    FILE *output;
+    uint8_t *data;
+    uint8_t *buffer = NULL;
+    uint32_t bufferlen;
+    uint32_t blocksize = 0;
+    uint32_t len;
+    uint32_t pos;
+    uint32_t used;
+    int r;
+    int i;
+
+    if(argc < 3) {
+        printf("Usage: %s /path/to/output.flac /path/to/input.flac ...\n",argv[0]);
+        return 1;
+    }
+
+    /* the output's blocksize has to cover the biggest frame of every file */
+    for(i=2;i<argc;i++) {
+        if(read_streaminfo(argv[i],&d) != 0) {
+            printf("%s isn't a FLAC file\n",argv[i]);
+            return 1;
+        }
+        if(d.max_blocksize > blocksize) blocksize = d.max_blocksize;
+    }
+
+    output = fopen(argv[1],"wb");
+    if(output == NULL) return 1;
+
+    for(i=2;i<argc;i++) {
+        data = read_file(argv[i],&len);
+        if(data == NULL) {
+            printf("unable to read %s\n",argv[i]);
+            return 1;
+        }
+
+        /* skip the metadata, STREAMINFO ends up in d */
+        technicallyflac_decoder_init(&d);
+        pos = 0;
+        while((r = technicallyflac_decode_metadata(&d,&data[pos],len - pos,&used)) == 1 && used) {
+            pos += used;
+        }
+        pos += used;
+        if(r != 0) {
+            printf("%s isn't a FLAC file\n",argv[i]);
+            return 1;
+        }
+
+        if(i == 2) {
+            /* the first file sets up the output. Every file but the last
+             * probably ends on a short frame, so number frames by sample */
+            if(technicallyflac_init(&f,blocksize,d.samplerate,d.channels,d.bitdepth) != 0 ||
+               technicallyflac_set_flags(&f,TECHNICALLYFLAC_FLAG_VARIABLE) != 0) {
+                printf("unsupported stream\n");
+                return 1;
+            }
+
+            bufferlen = technicallyflac_size_streammarker();
+            buffer = (uint8_t *)malloc(technicallyflac_size_frame(65535,8,32) + 6);
+            if(buffer == NULL) abort();
+            technicallyflac_streammarker(&f,buffer,&bufferlen);
+            fwrite(buffer,1,bufferlen,output);
+
+            /* written again at the end, with the totals */
+            bufferlen = technicallyflac_size_streaminfo();
+            technicallyflac_streaminfo(&f,buffer,&bufferlen,1);
+            fwrite(buffer,1,bufferlen,output);
+        }
+
+        while(pos < len) {
+            bufferlen = technicallyflac_size_frame(65535,8,32) + 6;
+            if(technicallyflac_remux_frame(&f,buffer,&bufferlen,&data[pos],len - pos,&used) != 0) {
+                printf("%s: bad frame at byte %u\n",argv[i],pos);
+                return 1;
+            }
+            fwrite(buffer,1,bufferlen,output);
+            pos += used;
+        }
+
+        free(data);
+    }
+
+    bufferlen = technicallyflac_size_streaminfo();
+    technicallyflac_streaminfo_finalize(&f,buffer,&bufferlen);
+    fseek(output,8,SEEK_SET);
+    fwrite(buffer,1,bufferlen,output);
+
+    fclose(output);
+    free(buffer);
+    return 0;
+}
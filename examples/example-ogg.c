@@ -2,19 +2,19 @@
 
 #define TECHNICALLYFLAC_IMPLEMENTATION
 #include "../technicallyflac.h"
+#define TECHNICALLYFLAC_OGG_IMPLEMENTATION
+#include "../technicallyflac_ogg.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <time.h>
-#include <ogg/ogg.h>
 
 #define QUIT { \
-        ogg_stream_clear(&os); \
         fclose(input); \
         fclose(output); \
-        quit(1,tags,raw_samples,samplesbuf, NULL); \
+        quit(1,tags,raw_samples,samplesbuf,buffer, NULL); \
         return 1; }
 
 /* re-define this if you'd like to experiment with other bit-depths (must be <= 16) */
@@ -23,6 +23,9 @@
 #define CHANNELS 2
 #define CHANNELSMODE CHANNELS /* change to 9,10,11 for left, right, mid-side stereo */
 
+/* start a new page once there's this much audio waiting */
+#define PAGE_SIZE 4096
+
 /* example that reads in a headerless WAV file and writes
  * out an FLAC-in-Ogg file with some tags. assumes WAV is 16-bit, 2channel, 44100Hz */
 
@@ -33,20 +36,44 @@
 /* example assumes we're on a little-endian system - would need to have
  * a proper decoder for input WAV data. */
 
+/* packets are written into buffer one after another, and written out
+ * as the body of a page once it's full */
+static uint8_t *buffer;
+static uint32_t bufferpos = 0;
+
+static int
+write_ogg_page(technicallyflac_ogg *ogg, FILE *out) {
+    uint8_t header[27 + 255];
+    uint32_t headerlen = sizeof(header);
+    uint32_t bodylen;
+
+    if(technicallyflac_ogg_page(ogg,header,&headerlen,&bodylen) != 0) return -1;
+    if(headerlen == 0) return 0;
+
+    /* the page body is the packet bytes already in the buffer */
+    if(fwrite(header,1,headerlen,out) != headerlen) return -1;
+    if(fwrite(buffer,1,bodylen,out) != bodylen) return -1;
+
+    /* move whatever's carried over to the next page to the front */
+    memmove(buffer,&buffer[bodylen],bufferpos - bodylen);
+    bufferpos -= bodylen;
+    return 0;
+}
+
+/* adds the packet at the end of the buffer to the stream, writing out any pages that fill up */
 static int
-write_ogg_page(ogg_page *og, FILE *out) {
-    int h;
-    int b;
-    if((h = fwrite(og->header,1,og->header_len,out)) != og->header_len) return h;
-    if((b = fwrite(og->body,1,og->body_len,out)) != og->body_len) return b;
-    return h + b;
+add_packet(technicallyflac_ogg *ogg, FILE *out, uint32_t len, uint32_t samples, uint8_t eos) {
+    bufferpos += len;
+    /* the packet is always at the end of the buffer, even after a page is written */
+    while(technicallyflac_ogg_packet(ogg,&buffer[bufferpos - len],len,samples,eos)) {
+        if(write_ogg_page(ogg,out) != 0) return -1;
+    }
+    return 0;
 }
 
 int main(int argc, const char *argv[]) {
-    uint8_t *buffer;
     uint32_t bufferlen = 0;
     uint32_t buffersize = 0;
-    uint32_t bufferpos = 0;
     FILE *input;
     FILE *output;
     uint32_t frames;
@@ -55,14 +82,12 @@ int main(int argc, const char *argv[]) {
     int32_t *samplesbuf;
     uint8_t *tags;
     uint32_t tags_len;
-    int serial;
+    uint8_t eos;
+    int c;
     uint32_t i;
 
     technicallyflac f;
-
-    ogg_stream_state os;
-    ogg_packet op;
-    ogg_page og;
+    technicallyflac_ogg ogg;
 
     if(argc < 3) {
         printf("Usage: %s /path/to/raw /path/to/ogg\n",argv[0]);
@@ -76,8 +101,7 @@ int main(int argc, const char *argv[]) {
 
     /* seed random number generator for making an ogg serial */
     srand((unsigned int)time(NULL));
-    serial = rand();
-    if(ogg_stream_init(&os,serial) != 0) return 1;
+    technicallyflac_ogg_init(&ogg,(uint32_t)rand());
 
     input = fopen(argv[1],"rb");
     if(input == NULL) return 1;
@@ -100,125 +124,45 @@ int main(int argc, const char *argv[]) {
         samples[i] = &samplesbuf[i * f.blocksize];
     }
 
-    /* find our max packet size */
-    buffersize = technicallyflac_size_frame(882,CHANNELSMODE,BIT_DEPTH);
+    /* a page's worth of frames plus one more frame, or the tags */
+    buffersize = PAGE_SIZE + technicallyflac_size_frame(f.blocksize,CHANNELSMODE,BIT_DEPTH);
+    if(buffersize < technicallyflac_size_metadata(tags_len)) buffersize = technicallyflac_size_metadata(tags_len);
     buffer = malloc(buffersize);
     if(!buffer) abort();
-    bufferlen = buffersize;
-
-    /* ogg packet will always just use our memory buffer */
-    op.packet = buffer;
-
-    /* set defaults for ogg_packet */
-    op.bytes = 0;
-    op.b_o_s = 0;
-    op.e_o_s = 0;
-    op.granulepos = 0;
-    op.packetno = 0;
-
-    /* everything is allocated - let's create the first packet */
-    /* going to just add stuff into the memory buffer and update fields */
 
-    /* one-byte packet type: 0x7F */
-    buffer[0] = 0x7F;
-
-    /* 4-byte ASCII signature FLAC */
-    buffer[1] = 'F';
-    buffer[2] = 'L';
-    buffer[3] = 'A';
-    buffer[4] = 'C';
-
-    /* 1-byte major version number (1.0) */
-    buffer[5] = 0x01;
-    /* 1-byte minor version number (1.0) */
-    buffer[6] = 0x00;
-
-    /* 2-byte, big endian number of header packets (not including first) */
-    buffer[7] = 0x00;
-    buffer[8] = 0x01;
-
-    bufferpos = 9;
+    /* first page only has the mapping header + streaminfo packet */
     bufferlen = buffersize - bufferpos;
+    if(technicallyflac_ogg_streaminfo(&f,&buffer[bufferpos],&bufferlen,1) != 0) abort();
+    if(add_packet(&ogg,output,bufferlen,0,0) != 0) QUIT
+    if(write_ogg_page(&ogg,output) != 0) QUIT
 
-    if(technicallyflac_streammarker(&f,&buffer[bufferpos],&bufferlen) != 0) abort(); /* this should happen in one call */
-    bufferpos += bufferlen;
+    /* the vorbis comment packet, audio has to start on a fresh page */
     bufferlen = buffersize - bufferpos;
-
-    if(technicallyflac_streaminfo(&f,&buffer[bufferpos],&bufferlen,0) != 0) abort() ;
-    bufferpos += bufferlen;
-    bufferlen = buffersize - bufferpos;
-
-    /* we now have the first packet, feed it in */
-    op.bytes = bufferpos;
-    op.b_o_s = 1;
-
-    if(ogg_stream_packetin(&os,&op) != 0) QUIT
-
-    /* packet sent to stream successfully */
-    op.packetno++;
-    op.b_o_s = 0;
-    bufferpos = 0;
-    bufferlen = buffersize;
-
-    /* force a flush, first page should only have streaminfo packet */
-    if(ogg_stream_flush(&os,&og) == 0) QUIT
-
-    if(write_ogg_page(&og,output) != (og.header_len + og.body_len)) QUIT
-
-
-    /* write out the vorbis comment page */
-    if(technicallyflac_metadata(&f,&buffer[bufferpos],&bufferlen,1,4,tags_len,tags) != 0) abort ();
-    bufferpos += bufferlen;
-    bufferlen = buffersize - bufferpos;
-
-    op.bytes = bufferpos;
-    if(ogg_stream_packetin(&os,&op) != 0) QUIT
-
-    op.packetno++;
-    bufferpos = 0;
-    bufferlen = buffersize;
-
-    if(ogg_stream_flush(&os,&og) == 0) QUIT
-    if(write_ogg_page(&og,output) != (og.header_len + og.body_len)) QUIT
+    if(technicallyflac_metadata(&f,&buffer[bufferpos],&bufferlen,1,4,tags_len,tags) != 0) abort();
+    if(add_packet(&ogg,output,bufferlen,0,0) != 0) QUIT
+    if(write_ogg_page(&ogg,output) != 0) QUIT
 
     while((frames = fread(raw_samples,sizeof(int16_t) * CHANNELS, f.blocksize, input)) > 0) {
 
-        /* first check for and write out any pages */
-        while(ogg_stream_pageout(&os,&og) != 0) {
-            if(write_ogg_page(&og,output) != (og.header_len + og.body_len)) QUIT
-        }
+        /* peek ahead to find the last frame */
+        eos = (c = fgetc(input)) == EOF;
+        if(!eos) ungetc(c,input);
 
         repack_samples_deinterleave(samples,raw_samples,CHANNELS,frames,BIT_SCALE);
 
-        bufferpos = 0;
-        bufferlen = buffersize;
-
+        bufferlen = buffersize - bufferpos;
         if(technicallyflac_frame(&f,&buffer[bufferpos],&bufferlen,frames,samples) != 0) abort();
-        bufferpos += bufferlen;
-        bufferlen -= bufferpos;
 
-        op.bytes = bufferpos;
-        op.granulepos += frames;
+        /* granulepos is worked out from the frame sample counts */
+        if(add_packet(&ogg,output,bufferlen,frames,eos) != 0) QUIT
 
-        if(frames != f.blocksize) {
-            /* this means we're at end-of-file, set the end-of-stream flag */
-            op.e_o_s = 1;
+        if(bufferpos >= PAGE_SIZE || eos) {
+            if(write_ogg_page(&ogg,output) != 0) QUIT
         }
-
-        if(ogg_stream_packetin(&os,&op) != 0) QUIT
-
-        op.packetno++;
-    }
-
-    /* flush out the final page */
-    if(ogg_stream_flush(&os,&og) != 0) {
-        if(write_ogg_page(&og,output) != (og.header_len + og.body_len)) QUIT
     }
 
-    ogg_stream_clear(&os);
     fclose(input);
     fclose(output);
-    quit(0,tags,raw_samples,samplesbuf, NULL);
+    quit(0,tags,raw_samples,samplesbuf,buffer, NULL);
     return 0;
 }
-
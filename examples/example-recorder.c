@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+
+#include "example-shared.h"
+
+#define TECHNICALLYFLAC_IMPLEMENTATION
+#include "../technicallyflac.h"
+#define TECHNICALLYFLAC_OUTPUT_IMPLEMENTATION
+#include "../technicallyflac_output.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+/* example that records many streams at once, each block of every stream
+ * goes into a buffer from technicallyflac_output and a whole round of them
+ * is written with one submit. Every stream here is the same headerless WAV
+ * file, written to prefix-0.flac, prefix-1.flac, ... assumes WAV is 16-bit,
+ * 2channel, 44100Hz
+ *
+ *     example-recorder your-audio.raw /tmp/stream 100
+ */
+
+/* headerless wav can be created via ffmpeg like:
+ *     ffmpeg -i your-audio.mp3 -ar 44100 -ac 2 -f s16le your-audio.raw
+ */
+
+#define BLOCKSIZE 4096
+#define MAX_STREAMS 1000
+
+/* buffers for two rounds, so one can be encoded while the last is written */
+#define BUFFERS_PER_STREAM 2
+
+/* threads writing if there's no io_uring */
+#define THREADS 4
+
+struct stream_s {
+    technicallyflac f;
+    int fd;
+    int64_t offset;
+};
+
+typedef struct stream_s stream;
+
+static stream streams[MAX_STREAMS];
+
+int main(int argc, const char *argv[]) {
+    technicallyflac_output o;
+    char path[4096];
+    uint8_t *buffer;
+    uint8_t *tags;
+    uint32_t tags_len;
+    uint32_t buffer_len;
+    uint32_t bufferlen;
+    uint32_t len;
+    int16_t *raw_samples;
+    FILE *input;
+    size_t frames;
+    unsigned int streams_len;
+    unsigned int i;
+
+    if(argc < 4) {
+        printf("Usage: %s /path/to/raw /path/to/prefix streams\n",argv[0]);
+        return 1;
+    }
+
+    streams_len = (unsigned int)atoi(argv[3]);
+    if(streams_len == 0 || streams_len > MAX_STREAMS) return 1;
+
+    input = fopen(argv[1],"rb");
+    if(input == NULL) return 1;
+
+    raw_samples = (int16_t *)malloc(sizeof(int16_t) * 2 * BLOCKSIZE);
+    if(raw_samples == NULL) abort();
+
+    /* a buffer holds a frame, or the header */
+    tags = create_tags(&tags_len);
+    buffer_len = technicallyflac_size_frame(BLOCKSIZE,2,16);
+    len = technicallyflac_size_streammarker() + technicallyflac_size_streaminfo() + technicallyflac_size_metadata(tags_len);
+    if(len > buffer_len) buffer_len = len;
+
+    if(technicallyflac_output_init(&o,streams_len * BUFFERS_PER_STREAM,buffer_len,THREADS) != 0) abort();
+    printf("writing with %s\n",o.uring ? (o.registered ? "io_uring (registered buffers)" : "io_uring") : "threads");
+
+    for(i=0;i<streams_len;i++) {
+        snprintf(path,sizeof(path),"%s-%u.flac",argv[2],i);
+        streams[i].fd = open(path,O_WRONLY | O_CREAT | O_TRUNC,0644);
+        if(streams[i].fd < 0) {
+            printf("unable to open %s\n",path);
+            return 1;
+        }
+        technicallyflac_init(&streams[i].f,BLOCKSIZE,44100,2,16);
+
+        buffer = technicallyflac_output_buffer(&o);
+        if(buffer == NULL) abort();
+        len = technicallyflac_size_streammarker();
+        technicallyflac_streammarker(&streams[i].f,buffer,&len);
+        bufferlen = len;
+        len = technicallyflac_size_streaminfo();
+        technicallyflac_streaminfo(&streams[i].f,&buffer[bufferlen],&len,0);
+        bufferlen += len;
+        len = technicallyflac_size_metadata(tags_len);
+        technicallyflac_metadata(&streams[i].f,&buffer[bufferlen],&len,1,4,tags_len,tags);
+        bufferlen += len;
+
+        technicallyflac_output_queue(&o,buffer,bufferlen,streams[i].fd,0);
+        streams[i].offset = bufferlen;
+    }
+
+    /* a block comes in for every stream, each one is encoded and the whole
+     * round goes out together */
+    while((frames = fread(raw_samples,sizeof(int16_t) * 2,BLOCKSIZE,input)) > 0) {
+        for(i=0;i<streams_len;i++) {
+            buffer = technicallyflac_output_buffer(&o);
+            if(buffer == NULL) abort();
+            bufferlen = buffer_len;
+            if(technicallyflac_frame_interleaved(&streams[i].f,buffer,&bufferlen,(uint32_t)frames,raw_samples,TECHNICALLYFLAC_FORMAT_S16LE) != 0) abort();
+            technicallyflac_output_queue(&o,buffer,bufferlen,streams[i].fd,streams[i].offset);
+            streams[i].offset += bufferlen;
+        }
+        if(technicallyflac_output_submit(&o) != 0) {
+            printf("write failed: %s\n",strerror(o.error));
+            return 1;
+        }
+    }
+
+    /* the STREAMINFO totals go over the first one. Writes can finish in any
+     * order, so the header has to be out before anything overlaps it */
+    if(technicallyflac_output_flush(&o) != 0) {
+        printf("write failed: %s\n",strerror(o.error));
+        return 1;
+    }
+
+    for(i=0;i<streams_len;i++) {
+        buffer = technicallyflac_output_buffer(&o);
+        if(buffer == NULL) abort();
+        bufferlen = buffer_len;
+        technicallyflac_streaminfo_finalize(&streams[i].f,buffer,&bufferlen);
+        technicallyflac_output_queue(&o,buffer,bufferlen,streams[i].fd,8);
+    }
+
+    if(technicallyflac_output_flush(&o) != 0) {
+        printf("write failed: %s\n",strerror(o.error));
+        return 1;
+    }
+
+    for(i=0;i<streams_len;i++) {
+        close(streams[i].fd);
+    }
+    technicallyflac_output_free(&o);
+    fclose(input);
+    quit(0,tags,raw_samples,NULL);
+
+    return 0;
+}
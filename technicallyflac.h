@@ -21,6 +21,9 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <assert.h>
 
 typedef struct technicallyflac_s technicallyflac;
+typedef struct technicallyflac_seekpoint_s technicallyflac_seekpoint;
+typedef struct technicallyflac_iovec_s technicallyflac_iovec;
+typedef struct technicallyflac_decoder_s technicallyflac_decoder;
 
 #ifdef __cplusplus
 extern "C" {
@@ -55,9 +58,54 @@ uint32_t technicallyflac_size_metadata(uint32_t num_bytes);
 TF_PURE
 uint32_t technicallyflac_size_frame(uint32_t blocksize, uint8_t channels, uint8_t bitdepth);
 
-/* returns the max bytes required for a given blocksize, channels, bitdepth, and frame index */
+/* returns the max bytes required for a given blocksize, channels, bitdepth, and frame index
+ * (the sample number with TECHNICALLYFLAC_FLAG_VARIABLE) */
 TF_PURE
-uint32_t technicallyflac_size_frame_index(uint32_t blocksize, uint8_t channels, uint8_t bitdepth, uint32_t frameindex);
+uint32_t technicallyflac_size_frame_index(uint32_t blocksize, uint8_t channels, uint8_t bitdepth, uint64_t frameindex);
+
+/* returns the bytes required for a SEEKTABLE block with num_points seek points */
+/* (4 + 18 * num_points) */
+TF_PURE
+uint32_t technicallyflac_size_seektable(uint32_t num_points);
+
+/* returns the number of bytes needed for a workspace, see technicallyflac_set_workspace */
+TF_PURE
+uint32_t technicallyflac_size_workspace(uint32_t blocksize);
+
+/* returns the bytes needed for the header buffer of technicallyflac_remux_iov */
+/* (16 for the longest frame header + 2 for the CRC-16) */
+TF_PURE
+uint32_t technicallyflac_size_remux_header(void);
+
+/* optional encoding features, see technicallyflac_set_flags */
+enum TECHNICALLYFLAC_FLAG {
+    /* write a CONSTANT subframe when every sample of a channel in the block
+     * is the same (digital silence, DC), costs an extra pass over the block */
+    TECHNICALLYFLAC_FLAG_CONSTANT = 0x01,
+
+    /* try the FIXED predictors (order 0-4) with rice-coded residuals and use
+     * whichever is smallest, falling back to verbatim. Needs a workspace */
+    TECHNICALLYFLAC_FLAG_FIXED    = 0x02,
+
+    /* find low bits that are zero in every sample of a channel in the block
+     * (eg 16-bit audio in a 24-bit stream) and leave them out */
+    TECHNICALLYFLAC_FLAG_WASTED   = 0x04,
+
+    /* keep an MD5 of the audio for STREAMINFO, costs a pass over every sample */
+    TECHNICALLYFLAC_FLAG_MD5      = 0x08,
+
+    /* variable blocksize stream: every frame can have any number of samples up
+     * to the blocksize given to technicallyflac_init (more returns -1), and
+     * frame headers carry the sample number instead of the frame number.
+     * Only the last frame can have fewer than 16 samples, any frame after
+     * one returns -1 */
+    TECHNICALLYFLAC_FLAG_VARIABLE = 0x10,
+
+    /* decode every frame after writing it and check it against the input,
+     * technicallyflac_frame returns -1 if it doesn't match. Frames have to
+     * be written in one call (see technicallyflac_size_frame) */
+    TECHNICALLYFLAC_FLAG_VERIFY   = 0x20,
+};
 
 /* initialize a technicallyflac object, should be called before any other function */
 /* channels should be number of channels (1-8) OR
@@ -66,6 +114,31 @@ uint32_t technicallyflac_size_frame_index(uint32_t blocksize, uint8_t channels,
  * 11 for mid/side stereo */
 int technicallyflac_init(technicallyflac *f, uint32_t blocksize, uint32_t samplerate, uint8_t channels, uint8_t bitdepth);
 
+/* enable optional encoding features (TECHNICALLYFLAC_FLAG_* or'd together), call after
+ * technicallyflac_init and before writing any frames. Frames never get bigger than
+ * plain verbatim frames, so the technicallyflac_size_frame* functions still apply.
+ * returns -1 on unknown flags, or TECHNICALLYFLAC_FLAG_FIXED without a workspace */
+int technicallyflac_set_flags(technicallyflac *f, uint32_t flags);
+
+/* give the encoder scratch memory for TECHNICALLYFLAC_FLAG_FIXED, call before
+ * technicallyflac_set_flags. len should be at least technicallyflac_size_workspace(blocksize),
+ * the memory should be aligned for a uint64_t and has to stay untouched while
+ * frames are being written. returns -1 if it's too small */
+int technicallyflac_set_workspace(technicallyflac *f, void *workspace, uint32_t len);
+
+/* one SEEKTABLE entry, offset is from the first byte of the first frame */
+struct technicallyflac_seekpoint_s {
+    uint64_t sample;
+    uint64_t offset;
+    uint16_t samples;
+};
+
+/* record a seek point in points (num_points long) for the first frame at or
+ * after every multiple of spacing samples, until points is full. Call before
+ * writing any frames. points has to stay around until the SEEKTABLE is written.
+ * returns -1 if spacing is 0 or the table wouldn't fit in a metadata block */
+int technicallyflac_set_seektable(technicallyflac *f, technicallyflac_seekpoint *points, uint32_t num_points, uint64_t spacing);
+
 /*
 Below functions are for writing out parts of a FLAC stream.
 
@@ -83,7 +156,7 @@ All functions take the same common parameters:
   You CAN call a function with OUTPUT set to NULL to find the required number of bytes,
   if you want to dynamically allocate space. This will return the number of bytes required
   for that particular frame, whereas technicallyflac_size_frame returns the *maximum*
-  number of bytes required.
+  number of bytes required. With flags enabled frames can come out smaller than this.
 
   Generally-speaking, every flac file will need:
     * 1 streammarker
@@ -99,12 +172,200 @@ int technicallyflac_streammarker(technicallyflac *f, uint8_t *output, uint32_t *
 /* write out the streaminfo block, set last_flag to 1 if this is the only metadata block */
 int technicallyflac_streaminfo(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag);
 
+/* writes the 34-byte STREAMINFO body (without the 4-byte block header) with the
+ * total samples, min/max frame size and MD5 of every frame written so far, to be
+ * written over the STREAMINFO written at the start of the stream. The MD5 is
+ * only filled in with TECHNICALLYFLAC_FLAG_MD5. returns -1 if *bytes < 34.
+ * technicallyflac_streaminfo writes these values too, they're 0 until frames are written */
+int technicallyflac_streaminfo_finalize(technicallyflac *f, uint8_t *output, uint32_t *bytes);
+
+/* write out a SEEKTABLE block with the num_points points given to
+ * technicallyflac_set_seektable, points that haven't been recorded yet are
+ * written as placeholders. Write it once with the other metadata blocks to
+ * reserve the space and again over it after the last frame */
+int technicallyflac_seektable(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag);
+
 /* write out other metadata blocks, set last_flag to 1 on the final block */
 int technicallyflac_metadata(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag, uint8_t block_type, uint32_t block_length, uint8_t *block);
 
-/* write out a frame of audio. num_frames should be equal to your pre-configured block size, except for the last flac frame (where it may be less). */
+/* reads up to len bytes of a metadata block into buffer, returns the number of
+ * bytes read (0 if the block can't be read) */
+typedef uint32_t (*technicallyflac_read_func)(uint8_t *buffer, uint32_t len, void *userdata);
+
+/* same as technicallyflac_metadata, but the block is pulled in from reader as it's
+ * written, straight into output. Only *bytes of it are ever held in memory, so
+ * a large PICTURE can stream in from disk. returns -1 if reader returns 0 */
+int technicallyflac_metadata_read(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag, uint8_t block_type, uint32_t block_length, technicallyflac_read_func reader, void *userdata);
+
+/* writes just the 4-byte header of a metadata block, the block_length bytes of the
+ * block go out straight after it from wherever they already are (eg. a PICTURE's
+ * fields, then the image data). returns -1 if *bytes < 4 or block_length doesn't fit in 24 bits */
+int technicallyflac_metadata_header(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag, uint8_t block_type, uint32_t block_length);
+
+/* same layout as struct iovec, so an array of these can go to writev/sendmsg */
+struct technicallyflac_iovec_s {
+    void *iov_base;
+    size_t iov_len;
+};
+
+/* writes the header of a metadata block into header (4 bytes) and points iov[0] at it
+ * and iov[1] at block, so the block is never copied. returns the number of iovecs
+ * used (1 if block_length is 0), or -1 if block_length doesn't fit in 24 bits */
+int technicallyflac_metadata_iov(technicallyflac *f, uint8_t *header, technicallyflac_iovec *iov, uint8_t last_flag, uint8_t block_type, uint32_t block_length, uint8_t *block);
+
+/* write out a frame of audio. num_frames should be equal to your pre-configured block size, except for the last flac frame (where it may be less).
+ * returns -1 if num_frames is 0 or more than the block size (or follows a frame under 16 samples, see TECHNICALLYFLAC_FLAG_VARIABLE).
+ * With TECHNICALLYFLAC_FLAG_VERIFY returns -1 if *bytes is too small for the whole frame or the frame doesn't decode back to the input */
 int technicallyflac_frame(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, int32_t **frames);
 
+/* formats accepted by technicallyflac_frame_interleaved */
+enum TECHNICALLYFLAC_FORMAT {
+    TECHNICALLYFLAC_FORMAT_S16LE,
+    TECHNICALLYFLAC_FORMAT_S16BE,
+    TECHNICALLYFLAC_FORMAT_S24LE, /* packed, 3 bytes per sample */
+    TECHNICALLYFLAC_FORMAT_S24BE,
+    TECHNICALLYFLAC_FORMAT_S32LE,
+    TECHNICALLYFLAC_FORMAT_S32BE,
+};
+
+/* same as technicallyflac_frame, but reads interleaved PCM in the given format.
+ * samples are used as-is, they need to fit in your configured bitdepth.
+ * stereo decorrelation modes (9-11) expect 2 interleaved channels. */
+int technicallyflac_frame_interleaved(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, const void *samples, enum TECHNICALLYFLAC_FORMAT format);
+
+/* returns where frame frame_n (counting from 0) starts, in bytes from the start of
+ * the first frame, assuming every frame before it has the full blocksize. Add the
+ * streammarker and metadata blocks to get the offset in the file. Uncompressed
+ * frames are always the same size, so this is exact unless flags that compress
+ * frames (FIXED, CONSTANT, WASTED) are on, then it's the most it can be */
+uint64_t technicallyflac_frame_offset(const technicallyflac *f, uint64_t frame_n);
+
+/* returns the bytes of every frame for total_samples samples (per channel),
+ * written as full blocks and one short one at the end. Exact the same way as
+ * technicallyflac_frame_offset */
+uint64_t technicallyflac_stream_size(const technicallyflac *f, uint64_t total_samples);
+
+/*
+  Encoders for one bitdepth and channels
+
+  TECHNICALLYFLAC_ENCODER(16,2) defines technicallyflac_frame_16_2 and
+  technicallyflac_frame_interleaved_16_2, the same as technicallyflac_frame
+  and technicallyflac_frame_interleaved for a stream set up with exactly
+  that bitdepth and channels (channels can be a stereo mode, 9-11). Sample
+  widths and the channel layout are constants in them, so the compiler can
+  unroll and vectorize the packing. Only verbatim frames written in one go
+  are specialized: with any flag besides TECHNICALLYFLAC_FLAG_MD5 and
+  TECHNICALLYFLAC_FLAG_VARIABLE, or a buffer smaller than the frame, they
+  call technicallyflac_frame. returns -1 if f has a different bitdepth or
+  channels.
+
+  Use TECHNICALLYFLAC_ENCODER in the file with TECHNICALLYFLAC_IMPLEMENTATION,
+  after including this, and TECHNICALLYFLAC_ENCODER_DECL(16,2); wherever it's
+  called. TECHNICALLYFLAC_SIZE_FRAME is technicallyflac_size_frame as a
+  constant expression, for static buffers. See technicallyflac.hpp for C++.
+*/
+
+#ifdef __cplusplus
+#define TECHNICALLYFLAC_EXTERN_C extern "C"
+#else
+#define TECHNICALLYFLAC_EXTERN_C
+#endif
+
+#define TECHNICALLYFLAC_ENCODER_PLANAR(bitdepth, channels) \
+TECHNICALLYFLAC_EXTERN_C int technicallyflac_frame_##bitdepth##_##channels(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, int32_t **frames)
+
+#define TECHNICALLYFLAC_ENCODER_INTERLEAVED(bitdepth, channels) \
+TECHNICALLYFLAC_EXTERN_C int technicallyflac_frame_interleaved_##bitdepth##_##channels(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, const void *samples, enum TECHNICALLYFLAC_FORMAT format)
+
+#define TECHNICALLYFLAC_ENCODER_DECL(bitdepth, channels) \
+TECHNICALLYFLAC_ENCODER_PLANAR(bitdepth, channels); \
+TECHNICALLYFLAC_ENCODER_INTERLEAVED(bitdepth, channels)
+
+#define TECHNICALLYFLAC_ENCODER(bitdepth, channels) \
+TECHNICALLYFLAC_ENCODER_DECL(bitdepth, channels); \
+TECHNICALLYFLAC_ENCODER_PLANAR(bitdepth, channels) { \
+    technicallyflac_input in; \
+    in.planar = frames; \
+    in.interleaved = NULL; \
+    return technicallyflac_frame_const(f,output,bytes,num_frames,&in,bitdepth,channels); \
+} \
+TECHNICALLYFLAC_ENCODER_INTERLEAVED(bitdepth, channels) { \
+    technicallyflac_input in; \
+    technicallyflac_input_interleaved(f,&in,samples,format); \
+    return technicallyflac_frame_const(f,output,bytes,num_frames,&in,bitdepth,channels); \
+}
+
+#define TECHNICALLYFLAC_SIZE_FRAME(blocksize, channels, bitdepth) \
+  ((((channels) <= 8 ? (uint32_t)(blocksize) * (bitdepth) * (channels) : (uint32_t)(blocksize) * (2 * (bitdepth) + 1)) + 7) / 8 + \
+   18 + ((channels) <= 8 ? (channels) : 2))
+
+/* adds a frame of frame_bytes bytes to the STREAMINFO totals. technicallyflac_frame
+ * already does this, it's only needed for frames encoded on a copy of f
+ * (eg. on another thread). Frames have to be added in order for the MD5 */
+void technicallyflac_streaminfo_track(technicallyflac *f, uint32_t num_frames, uint32_t frame_bytes, int32_t **frames);
+
+/* same as technicallyflac_streaminfo_track, with interleaved samples */
+void technicallyflac_streaminfo_track_interleaved(technicallyflac *f, uint32_t num_frames, uint32_t frame_bytes, const void *samples, enum TECHNICALLYFLAC_FORMAT format);
+
+/*
+  Decoding
+
+  The decoder reads back the streams this library writes: STREAMINFO, and
+  frames made of CONSTANT, VERBATIM and FIXED subframes (not LPC). It
+  doesn't keep any state between frames, so frames can be decoded in any
+  order, and doesn't allocate memory.
+*/
+
+/* set up a decoder */
+void technicallyflac_decoder_init(technicallyflac_decoder *d);
+
+/* reads one metadata block, the first call should start at the streammarker.
+ * The block's type and length are left in d->block_type and d->block_length,
+ * STREAMINFO is parsed into d. returns 1 if there are more metadata blocks,
+ * call again at data + *used. returns 0 after the last one, frames start at
+ * data + *used. If len doesn't hold the whole block, *used is set to 0 and it
+ * returns 1. returns -1 if this isn't a FLAC stream */
+int technicallyflac_decode_metadata(technicallyflac_decoder *d, const uint8_t *data, uint32_t len, uint32_t *used);
+
+/* decodes one frame at data into output, one array per channel of at least
+ * the frame's blocksize (STREAMINFO's max blocksize, or 65536). The frame's
+ * header values are left in d->frame_*, *used is set to the size of the frame.
+ * returns 0 on success, 1 if len doesn't hold the whole frame and -1 if it
+ * isn't a valid frame (including CRC errors) */
+int technicallyflac_decode_frame(technicallyflac_decoder *d, const uint8_t *data, uint32_t len, uint32_t *used, int32_t **output);
+
+/*
+  Remuxing
+
+  Joins or cuts streams without re-encoding: each existing frame is
+  renumbered as the next frame of f, only its header and CRC-16 change.
+  The new CRC-16 is worked out from the old one, so the audio isn't read
+  again (a frame that was corrupt stays corrupt). Verbatim and constant
+  subframes are skipped over, fixed ones have to be decoded to find
+  where the frame ends.
+
+  f needs the same samplerate, channels and bitdepth as the frames (any
+  stereo mode counts as 2 channels, each frame keeps its own), and a
+  blocksize at least as big as theirs. Frames are numbered on from f's
+  frame (or sample) number, so a new f starts a new stream at 0. The
+  STREAMINFO totals and seek points are kept like technicallyflac_frame
+  does, except for the MD5 (TECHNICALLYFLAC_FLAG_MD5 can't be set). When
+  joining streams that end on a short frame, set TECHNICALLYFLAC_FLAG_VARIABLE
+  on f.
+*/
+
+/* renumbers the frame at the start of data (len bytes are available) and
+ * copies it into output, which can't overlap data. *bytes needs room for the
+ * frame plus 6 bytes (a longer frame number), and is set to the bytes written.
+ * *used is set to the size of the frame in data. returns 0 on success, 1 if
+ * len doesn't hold the whole frame and -1 if it isn't a valid frame for f */
+int technicallyflac_remux_frame(technicallyflac *f, uint8_t *output, uint32_t *bytes, const uint8_t *data, uint32_t len, uint32_t *used);
+
+/* same as technicallyflac_remux_frame but without copying. iov gets 3 entries:
+ * the new frame header and CRC-16 are written into header
+ * (technicallyflac_size_remux_header bytes), and the rest points into data */
+int technicallyflac_remux_iov(technicallyflac *f, uint8_t *header, technicallyflac_iovec *iov, const uint8_t *data, uint32_t len, uint32_t *used);
+
 enum TECHNICALLYFLAC_STREAMMARKER_STATE {
     TECHNICALLYFLAC_STREAMMARKER_START,
     TECHNICALLYFLAC_STREAMMARKER_F,
@@ -143,20 +404,20 @@ enum TECHNICALLYFLAC_METADATA_STATE {
     TECHNICALLYFLAC_METADATA_END,
 };
 
+enum TECHNICALLYFLAC_SEEKTABLE_STATE {
+    TECHNICALLYFLAC_SEEKTABLE_START,
+    TECHNICALLYFLAC_SEEKTABLE_HEADER,
+    TECHNICALLYFLAC_SEEKTABLE_SAMPLE_HI,
+    TECHNICALLYFLAC_SEEKTABLE_SAMPLE_LO,
+    TECHNICALLYFLAC_SEEKTABLE_OFFSET_HI,
+    TECHNICALLYFLAC_SEEKTABLE_OFFSET_LO,
+    TECHNICALLYFLAC_SEEKTABLE_SAMPLES,
+    TECHNICALLYFLAC_SEEKTABLE_END,
+};
+
 enum TECHNICALLYFLAC_FRAME_STATE {
     TECHNICALLYFLAC_FRAME_START,
-    TECHNICALLYFLAC_FRAME_SYNC,
-    TECHNICALLYFLAC_FRAME_RES0,
-    TECHNICALLYFLAC_FRAME_BLOCKING_STRATEGY,
-    TECHNICALLYFLAC_FRAME_BLOCK_SIZE,
-    TECHNICALLYFLAC_FRAME_SAMPLE_RATE,
-    TECHNICALLYFLAC_FRAME_CHANNEL_ASSIGNMENT,
-    TECHNICALLYFLAC_FRAME_SAMPLE_SIZE,
-    TECHNICALLYFLAC_FRAME_RES1,
-    TECHNICALLYFLAC_FRAME_INDEX,
-    TECHNICALLYFLAC_FRAME_OPT_BLOCK_SIZE,
-    TECHNICALLYFLAC_FRAME_OPT_SAMPLE_RATE,
-    TECHNICALLYFLAC_FRAME_CRC8,
+    TECHNICALLYFLAC_FRAME_HEADER,
     TECHNICALLYFLAC_FRAME_SUBFRAME,
     TECHNICALLYFLAC_FRAME_ALIGN,
     TECHNICALLYFLAC_FRAME_FOOTER,
@@ -168,7 +429,12 @@ enum TECHNICALLYFLAC_SUBFRAME_STATE {
     TECHNICALLYFLAC_SUBFRAME_PAD,
     TECHNICALLYFLAC_SUBFRAME_TYPE,
     TECHNICALLYFLAC_SUBFRAME_WASTED,
+    TECHNICALLYFLAC_SUBFRAME_CONSTANT,
     TECHNICALLYFLAC_SUBFRAME_VERBATIM,
+    TECHNICALLYFLAC_SUBFRAME_WARMUP,
+    TECHNICALLYFLAC_SUBFRAME_RESIDUAL_CODING,
+    TECHNICALLYFLAC_SUBFRAME_RICE_PARAM,
+    TECHNICALLYFLAC_SUBFRAME_RESIDUAL,
     TECHNICALLYFLAC_SUBFRAME_END,
 };
 
@@ -178,6 +444,7 @@ struct technicallyflac_streammarker_state {
 
 struct technicallyflac_streaminfo_state {
     enum TECHNICALLYFLAC_STREAMINFO_STATE state;
+    uint8_t md5[16];
 };
 
 struct technicallyflac_metadata_state {
@@ -185,31 +452,51 @@ struct technicallyflac_metadata_state {
     uint32_t pos;
 };
 
+struct technicallyflac_seektable_state {
+    enum TECHNICALLYFLAC_SEEKTABLE_STATE state;
+    uint32_t pos;
+};
+
 struct technicallyflac_subframe_state {
     enum TECHNICALLYFLAC_SUBFRAME_STATE state;
+    uint8_t type;
+    uint8_t wasted;
     uint8_t channel;
     uint8_t channels;
     uint32_t frame;
+    uint32_t partition;
+    uint32_t partend;
+    uint32_t zeros;
 };
 
+/* sync through CRC-8: 4 + up to 7 frame/sample number bytes + 4 + 1 */
+#define TECHNICALLYFLAC_FRAME_HEADER_MAX 16
+
 struct technicallyflac_frame_state {
     enum TECHNICALLYFLAC_FRAME_STATE state;
     struct technicallyflac_subframe_state subframe;
-    uint8_t frameindexpos;
-    uint8_t frameindexlen;
-    uint8_t frameindex[6];
+    uint32_t framesize;
+    uint8_t headerpos;
+    uint8_t headerlen;
+    uint8_t header[TECHNICALLYFLAC_FRAME_HEADER_MAX];
 };
 
 struct technicallyflac_bitwriter_s {
     uint64_t val;
     uint8_t  bits;
-    uint8_t  crc8;
     uint16_t crc16;
+    uint32_t crcpos;
     uint32_t pos;
     uint32_t len;
     uint8_t* buffer;
 };
 
+struct technicallyflac_md5_s {
+    uint32_t state[4];
+    uint64_t len;
+    uint8_t buffer[64];
+};
+
 struct technicallyflac_s {
     /* block size (number of audio frames in a block) */
     uint32_t blocksize;
@@ -226,6 +513,9 @@ struct technicallyflac_s {
     /* current audio frame being encoded */
     uint32_t frameindex;
 
+    /* first sample of the current audio frame, 36 bits */
+    uint64_t sampleindex;
+
     /* stored as header value (8 = 001, 16 = 100, etc) */
     uint8_t bitdepth_header;
 
@@ -233,19 +523,80 @@ struct technicallyflac_s {
     uint8_t samplerate_header;
 
     /* value to use for the end-of-frame-header samplerate */
-    uint16_t samplerate_value;
+    uint32_t samplerate_value;
+
+    /* the first 4 bytes of every frame header (sync through sample size)
+     * and the CRC-8 up to there, built by technicallyflac_init */
+    uint8_t header[4];
+    uint8_t header_crc8;
 
     /* sample size in bytes */
     uint8_t samplesize;
 
+    /* cpu features detected at init, used to pick CRC/packing routines */
+    uint32_t cpu;
+
+    /* TECHNICALLYFLAC_FLAG_* */
+    uint32_t flags;
+
+    /* caller-provided scratch memory, see technicallyflac_set_workspace */
+    void *workspace;
+
+    /* STREAMINFO totals, updated as each frame is finished */
+    uint64_t total_samples;
+    uint32_t min_blocksize;
+    uint32_t max_blocksize;
+    uint32_t min_framesize;
+    uint32_t max_framesize;
+    struct technicallyflac_md5_s md5;
+
+    /* bytes of frames written so far */
+    uint64_t stream_bytes;
+
+    /* SEEKTABLE points, see technicallyflac_set_seektable */
+    technicallyflac_seekpoint *seekpoints;
+    uint32_t seekpoints_len;
+    uint32_t seekpoints_used;
+    uint64_t seekpoint_spacing;
+    uint64_t seekpoint_next;
+
     struct technicallyflac_bitwriter_s bw;
 
     struct technicallyflac_streammarker_state sm_state;
     struct technicallyflac_streaminfo_state   si_state;
     struct technicallyflac_metadata_state     md_state;
+    struct technicallyflac_seektable_state    st_state;
     struct technicallyflac_frame_state        fr_state;
 };
 
+struct technicallyflac_decoder_s {
+    /* from STREAMINFO */
+    uint32_t min_blocksize;
+    uint32_t max_blocksize;
+    uint32_t min_framesize;
+    uint32_t max_framesize;
+    uint32_t samplerate;
+    uint8_t channels;
+    uint8_t bitdepth;
+    uint64_t total_samples;
+    uint8_t md5[16];
+
+    /* the last metadata block read */
+    uint8_t block_type;
+    uint32_t block_length;
+
+    /* the last frame read */
+    uint8_t frame_variable;    /* numbered by sample instead of by frame */
+    uint64_t frame_number;     /* frame number, or the first sample with frame_variable */
+    uint32_t frame_blocksize;
+    uint32_t frame_samplerate;
+    uint8_t frame_channels;    /* 1-8, or 9-11 like technicallyflac_init */
+    uint8_t frame_bitdepth;
+
+    uint8_t streammarker;      /* the streammarker has been read */
+    uint32_t cpu;
+};
+
 
 #ifdef __cplusplus
 }
@@ -257,12 +608,117 @@ struct technicallyflac_s {
 
 #define TECHNICALLYFLAC_STREAMINFO_SIZE 38
 
+/* SIMD routines are only used with compilers that support per-function
+ * target attributes, so the rest of the file can be built without any
+ * special flags. Define TECHNICALLYFLAC_NO_SIMD to disable them. */
+#if !defined(TECHNICALLYFLAC_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define TECHNICALLYFLAC_X86 1
+#define TECHNICALLYFLAC_TARGET(t) __attribute__((target(t)))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif !defined(TECHNICALLYFLAC_NO_SIMD) && defined(__aarch64__)
+#define TECHNICALLYFLAC_ARM 1
+#include <arm_neon.h>
+#if defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES)
+#define TECHNICALLYFLAC_ARM_PMULL 1
+#endif
+#endif
+
+/* for the helpers of the constant-parameter encoders, so the parameters
+ * reach the code that uses them */
+#if defined(__GNUC__)
+#define TECHNICALLYFLAC_INLINE static __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define TECHNICALLYFLAC_INLINE static __forceinline
+#else
+#define TECHNICALLYFLAC_INLINE static
+#endif
+
+#define TECHNICALLYFLAC_TYPE_CONSTANT 0x00
+#define TECHNICALLYFLAC_TYPE_VERBATIM 0x01
+#define TECHNICALLYFLAC_TYPE_FIXED    0x08
+
+#define TECHNICALLYFLAC_MAX_FIXED_ORDER 4
+#define TECHNICALLYFLAC_MAX_PARTITION_ORDER 8
+
+#define TECHNICALLYFLAC_CPU_CLMUL 0x01
+#define TECHNICALLYFLAC_CPU_SSSE3 0x02
+#define TECHNICALLYFLAC_CPU_AVX2  0x04
+#define TECHNICALLYFLAC_CPU_SSE2  0x08
+
 typedef struct technicallyflac_bitwriter_s technicallyflac_bitwriter;
 
 static void technicallyflac_bitwriter_init(technicallyflac_bitwriter *bw);
 static int technicallyflac_bitwriter_add(technicallyflac_bitwriter *bw, uint8_t bits, uint64_t val);
 static void technicallyflac_bitwriter_align(technicallyflac_bitwriter *bw);
 
+/* the fastwriter is used when the output buffer can hold an entire frame,
+ * it packs into a 64-bit word and stores whole words big-endian, there's
+ * no bounds-checking and it can't be resumed. */
+struct technicallyflac_fastwriter_s {
+    uint64_t val;
+    uint8_t  bits;
+    uint16_t crc16;
+    uint32_t crcpos;
+    uint32_t pos;
+    uint32_t len;
+    uint8_t* buffer;
+};
+
+typedef struct technicallyflac_fastwriter_s technicallyflac_fastwriter;
+
+static void technicallyflac_fastwriter_init(technicallyflac_fastwriter *fw, uint8_t *buffer, uint32_t len);
+static void technicallyflac_fastwriter_add(technicallyflac_fastwriter *fw, uint8_t bits, uint64_t val);
+static void technicallyflac_fastwriter_flush(technicallyflac_fastwriter *fw);
+static void technicallyflac_fastwriter_align(technicallyflac_fastwriter *fw);
+
+/* where technicallyflac_frame/technicallyflac_frame_interleaved read samples from */
+struct technicallyflac_input_s {
+    int32_t **planar;
+    const uint8_t *interleaved;
+    enum TECHNICALLYFLAC_FORMAT format;
+    uint8_t samplesize;
+    uint32_t stride;
+};
+
+typedef struct technicallyflac_input_s technicallyflac_input;
+
+static void technicallyflac_streaminfo_md5(const technicallyflac *f, uint8_t *digest);
+static void technicallyflac_streaminfo_frame(technicallyflac *f, uint32_t num_frames, uint32_t frame_bytes, const technicallyflac_input *in);
+
+/* number of samples the fast path converts at a time */
+#define TECHNICALLYFLAC_CHUNK 256
+
+/* longest frame header (16 bytes) and a CRC-16, for technicallyflac_remux_iov */
+#define TECHNICALLYFLAC_REMUX_HEADER_LEN 18
+
+/* the samples of one subframe, a chunk at a time. side channels need
+ * bitdepth+1 bits so they're returned in s64, everything else in s32 */
+struct technicallyflac_chunk_s {
+    int32_t lbuf[TECHNICALLYFLAC_CHUNK];
+    int32_t rbuf[TECHNICALLYFLAC_CHUNK];
+    int32_t mbuf[TECHNICALLYFLAC_CHUNK];
+    int64_t sbuf[TECHNICALLYFLAC_CHUNK];
+    const int32_t *s32;
+    const int64_t *s64;
+};
+
+typedef struct technicallyflac_chunk_s technicallyflac_chunk;
+
+/* FIXED predictor analysis of the current subframe, kept at the start of
+ * the workspace and followed by the residuals (one int32_t per sample) */
+struct technicallyflac_fixed_s {
+    /* sum of zigzagged residuals per partition, per predictor order */
+    uint64_t sums[TECHNICALLYFLAC_MAX_FIXED_ORDER + 1][1 << TECHNICALLYFLAC_MAX_PARTITION_ORDER];
+    uint8_t params[1 << TECHNICALLYFLAC_MAX_PARTITION_ORDER];
+    uint8_t order;
+    uint8_t porder;
+    uint8_t parambits;
+};
+
+typedef struct technicallyflac_fixed_s technicallyflac_fixed;
+
 static const uint8_t technicallyflac_crc8_table[256] = {
   0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15,
   0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
@@ -298,45 +754,284 @@ static const uint8_t technicallyflac_crc8_table[256] = {
   0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3,
 };
 
-static const uint16_t technicallyflac_crc16_table[256] = {
-  0x0000, 0x8005, 0x800f, 0x000a, 0x801b, 0x001e, 0x0014, 0x8011,
-  0x8033, 0x0036, 0x003c, 0x8039, 0x0028, 0x802d, 0x8027, 0x0022,
-  0x8063, 0x0066, 0x006c, 0x8069, 0x0078, 0x807d, 0x8077, 0x0072,
-  0x0050, 0x8055, 0x805f, 0x005a, 0x804b, 0x004e, 0x0044, 0x8041,
-  0x80c3, 0x00c6, 0x00cc, 0x80c9, 0x00d8, 0x80dd, 0x80d7, 0x00d2,
-  0x00f0, 0x80f5, 0x80ff, 0x00fa, 0x80eb, 0x00ee, 0x00e4, 0x80e1,
-  0x00a0, 0x80a5, 0x80af, 0x00aa, 0x80bb, 0x00be, 0x00b4, 0x80b1,
-  0x8093, 0x0096, 0x009c, 0x8099, 0x0088, 0x808d, 0x8087, 0x0082,
-  0x8183, 0x0186, 0x018c, 0x8189, 0x0198, 0x819d, 0x8197, 0x0192,
-  0x01b0, 0x81b5, 0x81bf, 0x01ba, 0x81ab, 0x01ae, 0x01a4, 0x81a1,
-  0x01e0, 0x81e5, 0x81ef, 0x01ea, 0x81fb, 0x01fe, 0x01f4, 0x81f1,
-  0x81d3, 0x01d6, 0x01dc, 0x81d9, 0x01c8, 0x81cd, 0x81c7, 0x01c2,
-  0x0140, 0x8145, 0x814f, 0x014a, 0x815b, 0x015e, 0x0154, 0x8151,
-  0x8173, 0x0176, 0x017c, 0x8179, 0x0168, 0x816d, 0x8167, 0x0162,
-  0x8123, 0x0126, 0x012c, 0x8129, 0x0138, 0x813d, 0x8137, 0x0132,
-  0x0110, 0x8115, 0x811f, 0x011a, 0x810b, 0x010e, 0x0104, 0x8101,
-  0x8303, 0x0306, 0x030c, 0x8309, 0x0318, 0x831d, 0x8317, 0x0312,
-  0x0330, 0x8335, 0x833f, 0x033a, 0x832b, 0x032e, 0x0324, 0x8321,
-  0x0360, 0x8365, 0x836f, 0x036a, 0x837b, 0x037e, 0x0374, 0x8371,
-  0x8353, 0x0356, 0x035c, 0x8359, 0x0348, 0x834d, 0x8347, 0x0342,
-  0x03c0, 0x83c5, 0x83cf, 0x03ca, 0x83db, 0x03de, 0x03d4, 0x83d1,
-  0x83f3, 0x03f6, 0x03fc, 0x83f9, 0x03e8, 0x83ed, 0x83e7, 0x03e2,
-  0x83a3, 0x03a6, 0x03ac, 0x83a9, 0x03b8, 0x83bd, 0x83b7, 0x03b2,
-  0x0390, 0x8395, 0x839f, 0x039a, 0x838b, 0x038e, 0x0384, 0x8381,
-  0x0280, 0x8285, 0x828f, 0x028a, 0x829b, 0x029e, 0x0294, 0x8291,
-  0x82b3, 0x02b6, 0x02bc, 0x82b9, 0x02a8, 0x82ad, 0x82a7, 0x02a2,
-  0x82e3, 0x02e6, 0x02ec, 0x82e9, 0x02f8, 0x82fd, 0x82f7, 0x02f2,
-  0x02d0, 0x82d5, 0x82df, 0x02da, 0x82cb, 0x02ce, 0x02c4, 0x82c1,
-  0x8243, 0x0246, 0x024c, 0x8249, 0x0258, 0x825d, 0x8257, 0x0252,
-  0x0270, 0x8275, 0x827f, 0x027a, 0x826b, 0x026e, 0x0264, 0x8261,
-  0x0220, 0x8225, 0x822f, 0x022a, 0x823b, 0x023e, 0x0234, 0x8231,
-  0x8213, 0x0216, 0x021c, 0x8219, 0x0208, 0x820d, 0x8207, 0x0202,
+static const uint16_t technicallyflac_crc16_table[8][256] = {
+  {
+    0x0000, 0x8005, 0x800f, 0x000a, 0x801b, 0x001e, 0x0014, 0x8011,
+    0x8033, 0x0036, 0x003c, 0x8039, 0x0028, 0x802d, 0x8027, 0x0022,
+    0x8063, 0x0066, 0x006c, 0x8069, 0x0078, 0x807d, 0x8077, 0x0072,
+    0x0050, 0x8055, 0x805f, 0x005a, 0x804b, 0x004e, 0x0044, 0x8041,
+    0x80c3, 0x00c6, 0x00cc, 0x80c9, 0x00d8, 0x80dd, 0x80d7, 0x00d2,
+    0x00f0, 0x80f5, 0x80ff, 0x00fa, 0x80eb, 0x00ee, 0x00e4, 0x80e1,
+    0x00a0, 0x80a5, 0x80af, 0x00aa, 0x80bb, 0x00be, 0x00b4, 0x80b1,
+    0x8093, 0x0096, 0x009c, 0x8099, 0x0088, 0x808d, 0x8087, 0x0082,
+    0x8183, 0x0186, 0x018c, 0x8189, 0x0198, 0x819d, 0x8197, 0x0192,
+    0x01b0, 0x81b5, 0x81bf, 0x01ba, 0x81ab, 0x01ae, 0x01a4, 0x81a1,
+    0x01e0, 0x81e5, 0x81ef, 0x01ea, 0x81fb, 0x01fe, 0x01f4, 0x81f1,
+    0x81d3, 0x01d6, 0x01dc, 0x81d9, 0x01c8, 0x81cd, 0x81c7, 0x01c2,
+    0x0140, 0x8145, 0x814f, 0x014a, 0x815b, 0x015e, 0x0154, 0x8151,
+    0x8173, 0x0176, 0x017c, 0x8179, 0x0168, 0x816d, 0x8167, 0x0162,
+    0x8123, 0x0126, 0x012c, 0x8129, 0x0138, 0x813d, 0x8137, 0x0132,
+    0x0110, 0x8115, 0x811f, 0x011a, 0x810b, 0x010e, 0x0104, 0x8101,
+    0x8303, 0x0306, 0x030c, 0x8309, 0x0318, 0x831d, 0x8317, 0x0312,
+    0x0330, 0x8335, 0x833f, 0x033a, 0x832b, 0x032e, 0x0324, 0x8321,
+    0x0360, 0x8365, 0x836f, 0x036a, 0x837b, 0x037e, 0x0374, 0x8371,
+    0x8353, 0x0356, 0x035c, 0x8359, 0x0348, 0x834d, 0x8347, 0x0342,
+    0x03c0, 0x83c5, 0x83cf, 0x03ca, 0x83db, 0x03de, 0x03d4, 0x83d1,
+    0x83f3, 0x03f6, 0x03fc, 0x83f9, 0x03e8, 0x83ed, 0x83e7, 0x03e2,
+    0x83a3, 0x03a6, 0x03ac, 0x83a9, 0x03b8, 0x83bd, 0x83b7, 0x03b2,
+    0x0390, 0x8395, 0x839f, 0x039a, 0x838b, 0x038e, 0x0384, 0x8381,
+    0x0280, 0x8285, 0x828f, 0x028a, 0x829b, 0x029e, 0x0294, 0x8291,
+    0x82b3, 0x02b6, 0x02bc, 0x82b9, 0x02a8, 0x82ad, 0x82a7, 0x02a2,
+    0x82e3, 0x02e6, 0x02ec, 0x82e9, 0x02f8, 0x82fd, 0x82f7, 0x02f2,
+    0x02d0, 0x82d5, 0x82df, 0x02da, 0x82cb, 0x02ce, 0x02c4, 0x82c1,
+    0x8243, 0x0246, 0x024c, 0x8249, 0x0258, 0x825d, 0x8257, 0x0252,
+    0x0270, 0x8275, 0x827f, 0x027a, 0x826b, 0x026e, 0x0264, 0x8261,
+    0x0220, 0x8225, 0x822f, 0x022a, 0x823b, 0x023e, 0x0234, 0x8231,
+    0x8213, 0x0216, 0x021c, 0x8219, 0x0208, 0x820d, 0x8207, 0x0202,
+  },
+  {
+    0x0000, 0x8603, 0x8c03, 0x0a00, 0x9803, 0x1e00, 0x1400, 0x9203,
+    0xb003, 0x3600, 0x3c00, 0xba03, 0x2800, 0xae03, 0xa403, 0x2200,
+    0xe003, 0x6600, 0x6c00, 0xea03, 0x7800, 0xfe03, 0xf403, 0x7200,
+    0x5000, 0xd603, 0xdc03, 0x5a00, 0xc803, 0x4e00, 0x4400, 0xc203,
+    0x4003, 0xc600, 0xcc00, 0x4a03, 0xd800, 0x5e03, 0x5403, 0xd200,
+    0xf000, 0x7603, 0x7c03, 0xfa00, 0x6803, 0xee00, 0xe400, 0x6203,
+    0xa000, 0x2603, 0x2c03, 0xaa00, 0x3803, 0xbe00, 0xb400, 0x3203,
+    0x1003, 0x9600, 0x9c00, 0x1a03, 0x8800, 0x0e03, 0x0403, 0x8200,
+    0x8006, 0x0605, 0x0c05, 0x8a06, 0x1805, 0x9e06, 0x9406, 0x1205,
+    0x3005, 0xb606, 0xbc06, 0x3a05, 0xa806, 0x2e05, 0x2405, 0xa206,
+    0x6005, 0xe606, 0xec06, 0x6a05, 0xf806, 0x7e05, 0x7405, 0xf206,
+    0xd006, 0x5605, 0x5c05, 0xda06, 0x4805, 0xce06, 0xc406, 0x4205,
+    0xc005, 0x4606, 0x4c06, 0xca05, 0x5806, 0xde05, 0xd405, 0x5206,
+    0x7006, 0xf605, 0xfc05, 0x7a06, 0xe805, 0x6e06, 0x6406, 0xe205,
+    0x2006, 0xa605, 0xac05, 0x2a06, 0xb805, 0x3e06, 0x3406, 0xb205,
+    0x9005, 0x1606, 0x1c06, 0x9a05, 0x0806, 0x8e05, 0x8405, 0x0206,
+    0x8009, 0x060a, 0x0c0a, 0x8a09, 0x180a, 0x9e09, 0x9409, 0x120a,
+    0x300a, 0xb609, 0xbc09, 0x3a0a, 0xa809, 0x2e0a, 0x240a, 0xa209,
+    0x600a, 0xe609, 0xec09, 0x6a0a, 0xf809, 0x7e0a, 0x740a, 0xf209,
+    0xd009, 0x560a, 0x5c0a, 0xda09, 0x480a, 0xce09, 0xc409, 0x420a,
+    0xc00a, 0x4609, 0x4c09, 0xca0a, 0x5809, 0xde0a, 0xd40a, 0x5209,
+    0x7009, 0xf60a, 0xfc0a, 0x7a09, 0xe80a, 0x6e09, 0x6409, 0xe20a,
+    0x2009, 0xa60a, 0xac0a, 0x2a09, 0xb80a, 0x3e09, 0x3409, 0xb20a,
+    0x900a, 0x1609, 0x1c09, 0x9a0a, 0x0809, 0x8e0a, 0x840a, 0x0209,
+    0x000f, 0x860c, 0x8c0c, 0x0a0f, 0x980c, 0x1e0f, 0x140f, 0x920c,
+    0xb00c, 0x360f, 0x3c0f, 0xba0c, 0x280f, 0xae0c, 0xa40c, 0x220f,
+    0xe00c, 0x660f, 0x6c0f, 0xea0c, 0x780f, 0xfe0c, 0xf40c, 0x720f,
+    0x500f, 0xd60c, 0xdc0c, 0x5a0f, 0xc80c, 0x4e0f, 0x440f, 0xc20c,
+    0x400c, 0xc60f, 0xcc0f, 0x4a0c, 0xd80f, 0x5e0c, 0x540c, 0xd20f,
+    0xf00f, 0x760c, 0x7c0c, 0xfa0f, 0x680c, 0xee0f, 0xe40f, 0x620c,
+    0xa00f, 0x260c, 0x2c0c, 0xaa0f, 0x380c, 0xbe0f, 0xb40f, 0x320c,
+    0x100c, 0x960f, 0x9c0f, 0x1a0c, 0x880f, 0x0e0c, 0x040c, 0x820f,
+  },
+  {
+    0x0000, 0x8017, 0x802b, 0x003c, 0x8053, 0x0044, 0x0078, 0x806f,
+    0x80a3, 0x00b4, 0x0088, 0x809f, 0x00f0, 0x80e7, 0x80db, 0x00cc,
+    0x8143, 0x0154, 0x0168, 0x817f, 0x0110, 0x8107, 0x813b, 0x012c,
+    0x01e0, 0x81f7, 0x81cb, 0x01dc, 0x81b3, 0x01a4, 0x0198, 0x818f,
+    0x8283, 0x0294, 0x02a8, 0x82bf, 0x02d0, 0x82c7, 0x82fb, 0x02ec,
+    0x0220, 0x8237, 0x820b, 0x021c, 0x8273, 0x0264, 0x0258, 0x824f,
+    0x03c0, 0x83d7, 0x83eb, 0x03fc, 0x8393, 0x0384, 0x03b8, 0x83af,
+    0x8363, 0x0374, 0x0348, 0x835f, 0x0330, 0x8327, 0x831b, 0x030c,
+    0x8503, 0x0514, 0x0528, 0x853f, 0x0550, 0x8547, 0x857b, 0x056c,
+    0x05a0, 0x85b7, 0x858b, 0x059c, 0x85f3, 0x05e4, 0x05d8, 0x85cf,
+    0x0440, 0x8457, 0x846b, 0x047c, 0x8413, 0x0404, 0x0438, 0x842f,
+    0x84e3, 0x04f4, 0x04c8, 0x84df, 0x04b0, 0x84a7, 0x849b, 0x048c,
+    0x0780, 0x8797, 0x87ab, 0x07bc, 0x87d3, 0x07c4, 0x07f8, 0x87ef,
+    0x8723, 0x0734, 0x0708, 0x871f, 0x0770, 0x8767, 0x875b, 0x074c,
+    0x86c3, 0x06d4, 0x06e8, 0x86ff, 0x0690, 0x8687, 0x86bb, 0x06ac,
+    0x0660, 0x8677, 0x864b, 0x065c, 0x8633, 0x0624, 0x0618, 0x860f,
+    0x8a03, 0x0a14, 0x0a28, 0x8a3f, 0x0a50, 0x8a47, 0x8a7b, 0x0a6c,
+    0x0aa0, 0x8ab7, 0x8a8b, 0x0a9c, 0x8af3, 0x0ae4, 0x0ad8, 0x8acf,
+    0x0b40, 0x8b57, 0x8b6b, 0x0b7c, 0x8b13, 0x0b04, 0x0b38, 0x8b2f,
+    0x8be3, 0x0bf4, 0x0bc8, 0x8bdf, 0x0bb0, 0x8ba7, 0x8b9b, 0x0b8c,
+    0x0880, 0x8897, 0x88ab, 0x08bc, 0x88d3, 0x08c4, 0x08f8, 0x88ef,
+    0x8823, 0x0834, 0x0808, 0x881f, 0x0870, 0x8867, 0x885b, 0x084c,
+    0x89c3, 0x09d4, 0x09e8, 0x89ff, 0x0990, 0x8987, 0x89bb, 0x09ac,
+    0x0960, 0x8977, 0x894b, 0x095c, 0x8933, 0x0924, 0x0918, 0x890f,
+    0x0f00, 0x8f17, 0x8f2b, 0x0f3c, 0x8f53, 0x0f44, 0x0f78, 0x8f6f,
+    0x8fa3, 0x0fb4, 0x0f88, 0x8f9f, 0x0ff0, 0x8fe7, 0x8fdb, 0x0fcc,
+    0x8e43, 0x0e54, 0x0e68, 0x8e7f, 0x0e10, 0x8e07, 0x8e3b, 0x0e2c,
+    0x0ee0, 0x8ef7, 0x8ecb, 0x0edc, 0x8eb3, 0x0ea4, 0x0e98, 0x8e8f,
+    0x8d83, 0x0d94, 0x0da8, 0x8dbf, 0x0dd0, 0x8dc7, 0x8dfb, 0x0dec,
+    0x0d20, 0x8d37, 0x8d0b, 0x0d1c, 0x8d73, 0x0d64, 0x0d58, 0x8d4f,
+    0x0cc0, 0x8cd7, 0x8ceb, 0x0cfc, 0x8c93, 0x0c84, 0x0cb8, 0x8caf,
+    0x8c63, 0x0c74, 0x0c48, 0x8c5f, 0x0c30, 0x8c27, 0x8c1b, 0x0c0c,
+  },
+  {
+    0x0000, 0x9403, 0xa803, 0x3c00, 0xd003, 0x4400, 0x7800, 0xec03,
+    0x2003, 0xb400, 0x8800, 0x1c03, 0xf000, 0x6403, 0x5803, 0xcc00,
+    0x4006, 0xd405, 0xe805, 0x7c06, 0x9005, 0x0406, 0x3806, 0xac05,
+    0x6005, 0xf406, 0xc806, 0x5c05, 0xb006, 0x2405, 0x1805, 0x8c06,
+    0x800c, 0x140f, 0x280f, 0xbc0c, 0x500f, 0xc40c, 0xf80c, 0x6c0f,
+    0xa00f, 0x340c, 0x080c, 0x9c0f, 0x700c, 0xe40f, 0xd80f, 0x4c0c,
+    0xc00a, 0x5409, 0x6809, 0xfc0a, 0x1009, 0x840a, 0xb80a, 0x2c09,
+    0xe009, 0x740a, 0x480a, 0xdc09, 0x300a, 0xa409, 0x9809, 0x0c0a,
+    0x801d, 0x141e, 0x281e, 0xbc1d, 0x501e, 0xc41d, 0xf81d, 0x6c1e,
+    0xa01e, 0x341d, 0x081d, 0x9c1e, 0x701d, 0xe41e, 0xd81e, 0x4c1d,
+    0xc01b, 0x5418, 0x6818, 0xfc1b, 0x1018, 0x841b, 0xb81b, 0x2c18,
+    0xe018, 0x741b, 0x481b, 0xdc18, 0x301b, 0xa418, 0x9818, 0x0c1b,
+    0x0011, 0x9412, 0xa812, 0x3c11, 0xd012, 0x4411, 0x7811, 0xec12,
+    0x2012, 0xb411, 0x8811, 0x1c12, 0xf011, 0x6412, 0x5812, 0xcc11,
+    0x4017, 0xd414, 0xe814, 0x7c17, 0x9014, 0x0417, 0x3817, 0xac14,
+    0x6014, 0xf417, 0xc817, 0x5c14, 0xb017, 0x2414, 0x1814, 0x8c17,
+    0x803f, 0x143c, 0x283c, 0xbc3f, 0x503c, 0xc43f, 0xf83f, 0x6c3c,
+    0xa03c, 0x343f, 0x083f, 0x9c3c, 0x703f, 0xe43c, 0xd83c, 0x4c3f,
+    0xc039, 0x543a, 0x683a, 0xfc39, 0x103a, 0x8439, 0xb839, 0x2c3a,
+    0xe03a, 0x7439, 0x4839, 0xdc3a, 0x3039, 0xa43a, 0x983a, 0x0c39,
+    0x0033, 0x9430, 0xa830, 0x3c33, 0xd030, 0x4433, 0x7833, 0xec30,
+    0x2030, 0xb433, 0x8833, 0x1c30, 0xf033, 0x6430, 0x5830, 0xcc33,
+    0x4035, 0xd436, 0xe836, 0x7c35, 0x9036, 0x0435, 0x3835, 0xac36,
+    0x6036, 0xf435, 0xc835, 0x5c36, 0xb035, 0x2436, 0x1836, 0x8c35,
+    0x0022, 0x9421, 0xa821, 0x3c22, 0xd021, 0x4422, 0x7822, 0xec21,
+    0x2021, 0xb422, 0x8822, 0x1c21, 0xf022, 0x6421, 0x5821, 0xcc22,
+    0x4024, 0xd427, 0xe827, 0x7c24, 0x9027, 0x0424, 0x3824, 0xac27,
+    0x6027, 0xf424, 0xc824, 0x5c27, 0xb024, 0x2427, 0x1827, 0x8c24,
+    0x802e, 0x142d, 0x282d, 0xbc2e, 0x502d, 0xc42e, 0xf82e, 0x6c2d,
+    0xa02d, 0x342e, 0x082e, 0x9c2d, 0x702e, 0xe42d, 0xd82d, 0x4c2e,
+    0xc028, 0x542b, 0x682b, 0xfc28, 0x102b, 0x8428, 0xb828, 0x2c2b,
+    0xe02b, 0x7428, 0x4828, 0xdc2b, 0x3028, 0xa42b, 0x982b, 0x0c28,
+  },
+  {
+    0x0000, 0x807b, 0x80f3, 0x0088, 0x81e3, 0x0198, 0x0110, 0x816b,
+    0x83c3, 0x03b8, 0x0330, 0x834b, 0x0220, 0x825b, 0x82d3, 0x02a8,
+    0x8783, 0x07f8, 0x0770, 0x870b, 0x0660, 0x861b, 0x8693, 0x06e8,
+    0x0440, 0x843b, 0x84b3, 0x04c8, 0x85a3, 0x05d8, 0x0550, 0x852b,
+    0x8f03, 0x0f78, 0x0ff0, 0x8f8b, 0x0ee0, 0x8e9b, 0x8e13, 0x0e68,
+    0x0cc0, 0x8cbb, 0x8c33, 0x0c48, 0x8d23, 0x0d58, 0x0dd0, 0x8dab,
+    0x0880, 0x88fb, 0x8873, 0x0808, 0x8963, 0x0918, 0x0990, 0x89eb,
+    0x8b43, 0x0b38, 0x0bb0, 0x8bcb, 0x0aa0, 0x8adb, 0x8a53, 0x0a28,
+    0x9e03, 0x1e78, 0x1ef0, 0x9e8b, 0x1fe0, 0x9f9b, 0x9f13, 0x1f68,
+    0x1dc0, 0x9dbb, 0x9d33, 0x1d48, 0x9c23, 0x1c58, 0x1cd0, 0x9cab,
+    0x1980, 0x99fb, 0x9973, 0x1908, 0x9863, 0x1818, 0x1890, 0x98eb,
+    0x9a43, 0x1a38, 0x1ab0, 0x9acb, 0x1ba0, 0x9bdb, 0x9b53, 0x1b28,
+    0x1100, 0x917b, 0x91f3, 0x1188, 0x90e3, 0x1098, 0x1010, 0x906b,
+    0x92c3, 0x12b8, 0x1230, 0x924b, 0x1320, 0x935b, 0x93d3, 0x13a8,
+    0x9683, 0x16f8, 0x1670, 0x960b, 0x1760, 0x971b, 0x9793, 0x17e8,
+    0x1540, 0x953b, 0x95b3, 0x15c8, 0x94a3, 0x14d8, 0x1450, 0x942b,
+    0xbc03, 0x3c78, 0x3cf0, 0xbc8b, 0x3de0, 0xbd9b, 0xbd13, 0x3d68,
+    0x3fc0, 0xbfbb, 0xbf33, 0x3f48, 0xbe23, 0x3e58, 0x3ed0, 0xbeab,
+    0x3b80, 0xbbfb, 0xbb73, 0x3b08, 0xba63, 0x3a18, 0x3a90, 0xbaeb,
+    0xb843, 0x3838, 0x38b0, 0xb8cb, 0x39a0, 0xb9db, 0xb953, 0x3928,
+    0x3300, 0xb37b, 0xb3f3, 0x3388, 0xb2e3, 0x3298, 0x3210, 0xb26b,
+    0xb0c3, 0x30b8, 0x3030, 0xb04b, 0x3120, 0xb15b, 0xb1d3, 0x31a8,
+    0xb483, 0x34f8, 0x3470, 0xb40b, 0x3560, 0xb51b, 0xb593, 0x35e8,
+    0x3740, 0xb73b, 0xb7b3, 0x37c8, 0xb6a3, 0x36d8, 0x3650, 0xb62b,
+    0x2200, 0xa27b, 0xa2f3, 0x2288, 0xa3e3, 0x2398, 0x2310, 0xa36b,
+    0xa1c3, 0x21b8, 0x2130, 0xa14b, 0x2020, 0xa05b, 0xa0d3, 0x20a8,
+    0xa583, 0x25f8, 0x2570, 0xa50b, 0x2460, 0xa41b, 0xa493, 0x24e8,
+    0x2640, 0xa63b, 0xa6b3, 0x26c8, 0xa7a3, 0x27d8, 0x2750, 0xa72b,
+    0xad03, 0x2d78, 0x2df0, 0xad8b, 0x2ce0, 0xac9b, 0xac13, 0x2c68,
+    0x2ec0, 0xaebb, 0xae33, 0x2e48, 0xaf23, 0x2f58, 0x2fd0, 0xafab,
+    0x2a80, 0xaafb, 0xaa73, 0x2a08, 0xab63, 0x2b18, 0x2b90, 0xabeb,
+    0xa943, 0x2938, 0x29b0, 0xa9cb, 0x28a0, 0xa8db, 0xa853, 0x2828,
+  },
+  {
+    0x0000, 0xf803, 0x7003, 0x8800, 0xe006, 0x1805, 0x9005, 0x6806,
+    0x4009, 0xb80a, 0x300a, 0xc809, 0xa00f, 0x580c, 0xd00c, 0x280f,
+    0x8012, 0x7811, 0xf011, 0x0812, 0x6014, 0x9817, 0x1017, 0xe814,
+    0xc01b, 0x3818, 0xb018, 0x481b, 0x201d, 0xd81e, 0x501e, 0xa81d,
+    0x8021, 0x7822, 0xf022, 0x0821, 0x6027, 0x9824, 0x1024, 0xe827,
+    0xc028, 0x382b, 0xb02b, 0x4828, 0x202e, 0xd82d, 0x502d, 0xa82e,
+    0x0033, 0xf830, 0x7030, 0x8833, 0xe035, 0x1836, 0x9036, 0x6835,
+    0x403a, 0xb839, 0x3039, 0xc83a, 0xa03c, 0x583f, 0xd03f, 0x283c,
+    0x8047, 0x7844, 0xf044, 0x0847, 0x6041, 0x9842, 0x1042, 0xe841,
+    0xc04e, 0x384d, 0xb04d, 0x484e, 0x2048, 0xd84b, 0x504b, 0xa848,
+    0x0055, 0xf856, 0x7056, 0x8855, 0xe053, 0x1850, 0x9050, 0x6853,
+    0x405c, 0xb85f, 0x305f, 0xc85c, 0xa05a, 0x5859, 0xd059, 0x285a,
+    0x0066, 0xf865, 0x7065, 0x8866, 0xe060, 0x1863, 0x9063, 0x6860,
+    0x406f, 0xb86c, 0x306c, 0xc86f, 0xa069, 0x586a, 0xd06a, 0x2869,
+    0x8074, 0x7877, 0xf077, 0x0874, 0x6072, 0x9871, 0x1071, 0xe872,
+    0xc07d, 0x387e, 0xb07e, 0x487d, 0x207b, 0xd878, 0x5078, 0xa87b,
+    0x808b, 0x7888, 0xf088, 0x088b, 0x608d, 0x988e, 0x108e, 0xe88d,
+    0xc082, 0x3881, 0xb081, 0x4882, 0x2084, 0xd887, 0x5087, 0xa884,
+    0x0099, 0xf89a, 0x709a, 0x8899, 0xe09f, 0x189c, 0x909c, 0x689f,
+    0x4090, 0xb893, 0x3093, 0xc890, 0xa096, 0x5895, 0xd095, 0x2896,
+    0x00aa, 0xf8a9, 0x70a9, 0x88aa, 0xe0ac, 0x18af, 0x90af, 0x68ac,
+    0x40a3, 0xb8a0, 0x30a0, 0xc8a3, 0xa0a5, 0x58a6, 0xd0a6, 0x28a5,
+    0x80b8, 0x78bb, 0xf0bb, 0x08b8, 0x60be, 0x98bd, 0x10bd, 0xe8be,
+    0xc0b1, 0x38b2, 0xb0b2, 0x48b1, 0x20b7, 0xd8b4, 0x50b4, 0xa8b7,
+    0x00cc, 0xf8cf, 0x70cf, 0x88cc, 0xe0ca, 0x18c9, 0x90c9, 0x68ca,
+    0x40c5, 0xb8c6, 0x30c6, 0xc8c5, 0xa0c3, 0x58c0, 0xd0c0, 0x28c3,
+    0x80de, 0x78dd, 0xf0dd, 0x08de, 0x60d8, 0x98db, 0x10db, 0xe8d8,
+    0xc0d7, 0x38d4, 0xb0d4, 0x48d7, 0x20d1, 0xd8d2, 0x50d2, 0xa8d1,
+    0x80ed, 0x78ee, 0xf0ee, 0x08ed, 0x60eb, 0x98e8, 0x10e8, 0xe8eb,
+    0xc0e4, 0x38e7, 0xb0e7, 0x48e4, 0x20e2, 0xd8e1, 0x50e1, 0xa8e2,
+    0x00ff, 0xf8fc, 0x70fc, 0x88ff, 0xe0f9, 0x18fa, 0x90fa, 0x68f9,
+    0x40f6, 0xb8f5, 0x30f5, 0xc8f6, 0xa0f0, 0x58f3, 0xd0f3, 0x28f0,
+  },
+  {
+    0x0000, 0x8113, 0x8223, 0x0330, 0x8443, 0x0550, 0x0660, 0x8773,
+    0x8883, 0x0990, 0x0aa0, 0x8bb3, 0x0cc0, 0x8dd3, 0x8ee3, 0x0ff0,
+    0x9103, 0x1010, 0x1320, 0x9233, 0x1540, 0x9453, 0x9763, 0x1670,
+    0x1980, 0x9893, 0x9ba3, 0x1ab0, 0x9dc3, 0x1cd0, 0x1fe0, 0x9ef3,
+    0xa203, 0x2310, 0x2020, 0xa133, 0x2640, 0xa753, 0xa463, 0x2570,
+    0x2a80, 0xab93, 0xa8a3, 0x29b0, 0xaec3, 0x2fd0, 0x2ce0, 0xadf3,
+    0x3300, 0xb213, 0xb123, 0x3030, 0xb743, 0x3650, 0x3560, 0xb473,
+    0xbb83, 0x3a90, 0x39a0, 0xb8b3, 0x3fc0, 0xbed3, 0xbde3, 0x3cf0,
+    0xc403, 0x4510, 0x4620, 0xc733, 0x4040, 0xc153, 0xc263, 0x4370,
+    0x4c80, 0xcd93, 0xcea3, 0x4fb0, 0xc8c3, 0x49d0, 0x4ae0, 0xcbf3,
+    0x5500, 0xd413, 0xd723, 0x5630, 0xd143, 0x5050, 0x5360, 0xd273,
+    0xdd83, 0x5c90, 0x5fa0, 0xdeb3, 0x59c0, 0xd8d3, 0xdbe3, 0x5af0,
+    0x6600, 0xe713, 0xe423, 0x6530, 0xe243, 0x6350, 0x6060, 0xe173,
+    0xee83, 0x6f90, 0x6ca0, 0xedb3, 0x6ac0, 0xebd3, 0xe8e3, 0x69f0,
+    0xf703, 0x7610, 0x7520, 0xf433, 0x7340, 0xf253, 0xf163, 0x7070,
+    0x7f80, 0xfe93, 0xfda3, 0x7cb0, 0xfbc3, 0x7ad0, 0x79e0, 0xf8f3,
+    0x0803, 0x8910, 0x8a20, 0x0b33, 0x8c40, 0x0d53, 0x0e63, 0x8f70,
+    0x8080, 0x0193, 0x02a3, 0x83b0, 0x04c3, 0x85d0, 0x86e0, 0x07f3,
+    0x9900, 0x1813, 0x1b23, 0x9a30, 0x1d43, 0x9c50, 0x9f60, 0x1e73,
+    0x1183, 0x9090, 0x93a0, 0x12b3, 0x95c0, 0x14d3, 0x17e3, 0x96f0,
+    0xaa00, 0x2b13, 0x2823, 0xa930, 0x2e43, 0xaf50, 0xac60, 0x2d73,
+    0x2283, 0xa390, 0xa0a0, 0x21b3, 0xa6c0, 0x27d3, 0x24e3, 0xa5f0,
+    0x3b03, 0xba10, 0xb920, 0x3833, 0xbf40, 0x3e53, 0x3d63, 0xbc70,
+    0xb380, 0x3293, 0x31a3, 0xb0b0, 0x37c3, 0xb6d0, 0xb5e0, 0x34f3,
+    0xcc00, 0x4d13, 0x4e23, 0xcf30, 0x4843, 0xc950, 0xca60, 0x4b73,
+    0x4483, 0xc590, 0xc6a0, 0x47b3, 0xc0c0, 0x41d3, 0x42e3, 0xc3f0,
+    0x5d03, 0xdc10, 0xdf20, 0x5e33, 0xd940, 0x5853, 0x5b63, 0xda70,
+    0xd580, 0x5493, 0x57a3, 0xd6b0, 0x51c3, 0xd0d0, 0xd3e0, 0x52f3,
+    0x6e03, 0xef10, 0xec20, 0x6d33, 0xea40, 0x6b53, 0x6863, 0xe970,
+    0xe680, 0x6793, 0x64a3, 0xe5b0, 0x62c3, 0xe3d0, 0xe0e0, 0x61f3,
+    0xff00, 0x7e13, 0x7d23, 0xfc30, 0x7b43, 0xfa50, 0xf960, 0x7873,
+    0x7783, 0xf690, 0xf5a0, 0x74b3, 0xf3c0, 0x72d3, 0x71e3, 0xf0f0,
+  },
+  {
+    0x0000, 0x1006, 0x200c, 0x300a, 0x4018, 0x501e, 0x6014, 0x7012,
+    0x8030, 0x9036, 0xa03c, 0xb03a, 0xc028, 0xd02e, 0xe024, 0xf022,
+    0x8065, 0x9063, 0xa069, 0xb06f, 0xc07d, 0xd07b, 0xe071, 0xf077,
+    0x0055, 0x1053, 0x2059, 0x305f, 0x404d, 0x504b, 0x6041, 0x7047,
+    0x80cf, 0x90c9, 0xa0c3, 0xb0c5, 0xc0d7, 0xd0d1, 0xe0db, 0xf0dd,
+    0x00ff, 0x10f9, 0x20f3, 0x30f5, 0x40e7, 0x50e1, 0x60eb, 0x70ed,
+    0x00aa, 0x10ac, 0x20a6, 0x30a0, 0x40b2, 0x50b4, 0x60be, 0x70b8,
+    0x809a, 0x909c, 0xa096, 0xb090, 0xc082, 0xd084, 0xe08e, 0xf088,
+    0x819b, 0x919d, 0xa197, 0xb191, 0xc183, 0xd185, 0xe18f, 0xf189,
+    0x01ab, 0x11ad, 0x21a7, 0x31a1, 0x41b3, 0x51b5, 0x61bf, 0x71b9,
+    0x01fe, 0x11f8, 0x21f2, 0x31f4, 0x41e6, 0x51e0, 0x61ea, 0x71ec,
+    0x81ce, 0x91c8, 0xa1c2, 0xb1c4, 0xc1d6, 0xd1d0, 0xe1da, 0xf1dc,
+    0x0154, 0x1152, 0x2158, 0x315e, 0x414c, 0x514a, 0x6140, 0x7146,
+    0x8164, 0x9162, 0xa168, 0xb16e, 0xc17c, 0xd17a, 0xe170, 0xf176,
+    0x8131, 0x9137, 0xa13d, 0xb13b, 0xc129, 0xd12f, 0xe125, 0xf123,
+    0x0101, 0x1107, 0x210d, 0x310b, 0x4119, 0x511f, 0x6115, 0x7113,
+    0x8333, 0x9335, 0xa33f, 0xb339, 0xc32b, 0xd32d, 0xe327, 0xf321,
+    0x0303, 0x1305, 0x230f, 0x3309, 0x431b, 0x531d, 0x6317, 0x7311,
+    0x0356, 0x1350, 0x235a, 0x335c, 0x434e, 0x5348, 0x6342, 0x7344,
+    0x8366, 0x9360, 0xa36a, 0xb36c, 0xc37e, 0xd378, 0xe372, 0xf374,
+    0x03fc, 0x13fa, 0x23f0, 0x33f6, 0x43e4, 0x53e2, 0x63e8, 0x73ee,
+    0x83cc, 0x93ca, 0xa3c0, 0xb3c6, 0xc3d4, 0xd3d2, 0xe3d8, 0xf3de,
+    0x8399, 0x939f, 0xa395, 0xb393, 0xc381, 0xd387, 0xe38d, 0xf38b,
+    0x03a9, 0x13af, 0x23a5, 0x33a3, 0x43b1, 0x53b7, 0x63bd, 0x73bb,
+    0x02a8, 0x12ae, 0x22a4, 0x32a2, 0x42b0, 0x52b6, 0x62bc, 0x72ba,
+    0x8298, 0x929e, 0xa294, 0xb292, 0xc280, 0xd286, 0xe28c, 0xf28a,
+    0x82cd, 0x92cb, 0xa2c1, 0xb2c7, 0xc2d5, 0xd2d3, 0xe2d9, 0xf2df,
+    0x02fd, 0x12fb, 0x22f1, 0x32f7, 0x42e5, 0x52e3, 0x62e9, 0x72ef,
+    0x8267, 0x9261, 0xa26b, 0xb26d, 0xc27f, 0xd279, 0xe273, 0xf275,
+    0x0257, 0x1251, 0x225b, 0x325d, 0x424f, 0x5249, 0x6243, 0x7245,
+    0x0202, 0x1204, 0x220e, 0x3208, 0x421a, 0x521c, 0x6216, 0x7210,
+    0x8232, 0x9234, 0xa23e, 0xb238, 0xc22a, 0xd22c, 0xe226, 0xf220,
+  },
 };
 
 static void technicallyflac_bitwriter_init(technicallyflac_bitwriter *bw) {
     bw->val    = 0;
     bw->bits   = 0;
-    bw->crc8   = 0;
     bw->crc16  = 0;
 }
 
@@ -344,15 +1039,11 @@ static void technicallyflac_bitwriter_init(technicallyflac_bitwriter *bw) {
 static void technicallyflac_bitwriter_flush(technicallyflac_bitwriter *bw) {
     uint64_t avail = ((bw->len - bw->pos) * 8);
     uint64_t mask  = -1LL;
-    uint8_t  byte  = 0;
 
     while(avail && bw->bits > 7) {
         bw->bits -= 8;
-        byte = (uint8_t)((bw->val >> bw->bits) & 0xFF);
-        bw->buffer[bw->pos++] = byte;
+        bw->buffer[bw->pos++] = (uint8_t)((bw->val >> bw->bits) & 0xFF);
         avail -= 8;
-        bw->crc8 = technicallyflac_crc8_table[bw->crc8 ^ byte];
-        bw->crc16 = technicallyflac_crc16_table[(bw->crc16 >> 8) ^ byte] ^ (( bw->crc16 & 0x00FF ) << 8);
     }
     if(bw->bits == 0) {
         bw->val = 0;
@@ -381,424 +1072,3047 @@ static void technicallyflac_bitwriter_align(technicallyflac_bitwriter *bw) {
     }
 }
 
-size_t technicallyflac_size(void) {
-    return sizeof(technicallyflac);
+static uint8_t technicallyflac_crc8(uint8_t crc, const uint8_t *data, uint32_t len) {
+    while(len--) {
+        crc = technicallyflac_crc8_table[crc ^ *data++];
+    }
+    return crc;
 }
 
-int technicallyflac_init(technicallyflac *f, uint32_t blocksize, uint32_t samplerate, uint8_t channels, uint8_t bitdepth) {
+/* slicing-by-8, each table is the CRC of a byte followed by n zero bytes */
+static uint16_t technicallyflac_crc16_slice8(uint16_t crc, const uint8_t *data, uint32_t len) {
+    while(len >= 8) {
+        crc ^= ((uint16_t)data[0] << 8) | data[1];
+        crc = technicallyflac_crc16_table[7][crc >> 8]   ^
+              technicallyflac_crc16_table[6][crc & 0xFF] ^
+              technicallyflac_crc16_table[5][data[2]]    ^
+              technicallyflac_crc16_table[4][data[3]]    ^
+              technicallyflac_crc16_table[3][data[4]]    ^
+              technicallyflac_crc16_table[2][data[5]]    ^
+              technicallyflac_crc16_table[1][data[6]]    ^
+              technicallyflac_crc16_table[0][data[7]];
+        data += 8;
+        len -= 8;
+    }
+    while(len--) {
+        crc = technicallyflac_crc16_table[0][(crc >> 8) ^ *data++] ^ (( crc & 0x00FF ) << 8);
+    }
+    return crc;
+}
 
-    f->blocksize  = blocksize;
-    f->samplerate = samplerate;
-    f->channels   = channels;
-    f->bitdepth   = bitdepth;
+/* carry-less multiply version, folds 4 lanes of 128 bits at a time.
+ * Each 128-bit block X = H*x^64 + L is moved forward n bits with
+ * H*(x^(n+64) mod P) + L*(x^n mod P), then the final block is reduced
+ * with the table. The constants are x^n mod P for P = 0x18005. */
+#define TECHNICALLYFLAC_CRC16_K128 0x0106
+#define TECHNICALLYFLAC_CRC16_K192 0x1666
+#define TECHNICALLYFLAC_CRC16_K256 0x8011
+#define TECHNICALLYFLAC_CRC16_K320 0x9323
+#define TECHNICALLYFLAC_CRC16_K384 0x926f
+#define TECHNICALLYFLAC_CRC16_K448 0x4aaa
+#define TECHNICALLYFLAC_CRC16_K512 0x8107
+#define TECHNICALLYFLAC_CRC16_K576 0x1446
 
-    if(f->bitdepth < 4 || f->bitdepth > 32) {
-        return -1;
-    }
+#if TECHNICALLYFLAC_X86
 
-    if(f->channels < 1 || f->channels > 11) return -1;
+#define TECHNICALLYFLAC_CLMUL_FOLD(x,k) \
+  _mm_xor_si128(_mm_clmulepi64_si128((x),(k),0x11),_mm_clmulepi64_si128((x),(k),0x00))
 
-    switch(f->bitdepth) {
-        case 8:  {
-            f->bitdepth_header = 1;
-            break;
-        }
-        case 12:  {
-            f->bitdepth_header = 2;
-            break;
-        }
-        case 16: {
-            f->bitdepth_header = 4;
-            break;
-        }
-        case 20: {
-            f->bitdepth_header = 5;
-            break;
-        }
-        case 24: {
-            f->bitdepth_header = 6;
-            break;
-        }
-        default: f->bitdepth_header = 0;
+TECHNICALLYFLAC_TARGET("pclmul,ssse3")
+static uint16_t technicallyflac_crc16_clmul(uint16_t crc, const uint8_t *data, uint32_t len) {
+    const __m128i bswap = _mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+    __m128i x0, x1, x2, x3, k;
+    uint8_t tmp[16];
+
+    x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data     )),bswap);
+    x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)),bswap);
+    x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)),bswap);
+    x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)),bswap);
+    x0 = _mm_xor_si128(x0,_mm_slli_si128(_mm_cvtsi32_si128(crc),14));
+    data += 64;
+    len -= 64;
+
+    k = _mm_set_epi64x(TECHNICALLYFLAC_CRC16_K576,TECHNICALLYFLAC_CRC16_K512);
+    while(len >= 64) {
+        x0 = _mm_xor_si128(TECHNICALLYFLAC_CLMUL_FOLD(x0,k),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data     )),bswap));
+        x1 = _mm_xor_si128(TECHNICALLYFLAC_CLMUL_FOLD(x1,k),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)),bswap));
+        x2 = _mm_xor_si128(TECHNICALLYFLAC_CLMUL_FOLD(x2,k),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)),bswap));
+        x3 = _mm_xor_si128(TECHNICALLYFLAC_CLMUL_FOLD(x3,k),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)),bswap));
+        data += 64;
+        len -= 64;
     }
 
-    if(f->samplerate % 10 == 0) {
-        f->samplerate_header = 14;
-        f->samplerate_value  = f->samplerate / 10;
-    } else {
-        f->samplerate_header = 13;
-        f->samplerate_value  = f->samplerate;
+    x3 = _mm_xor_si128(x3,TECHNICALLYFLAC_CLMUL_FOLD(x0,_mm_set_epi64x(TECHNICALLYFLAC_CRC16_K448,TECHNICALLYFLAC_CRC16_K384)));
+    x3 = _mm_xor_si128(x3,TECHNICALLYFLAC_CLMUL_FOLD(x1,_mm_set_epi64x(TECHNICALLYFLAC_CRC16_K320,TECHNICALLYFLAC_CRC16_K256)));
+    x3 = _mm_xor_si128(x3,TECHNICALLYFLAC_CLMUL_FOLD(x2,_mm_set_epi64x(TECHNICALLYFLAC_CRC16_K192,TECHNICALLYFLAC_CRC16_K128)));
+
+    k = _mm_set_epi64x(TECHNICALLYFLAC_CRC16_K192,TECHNICALLYFLAC_CRC16_K128);
+    while(len >= 16) {
+        x3 = _mm_xor_si128(TECHNICALLYFLAC_CLMUL_FOLD(x3,k),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data),bswap));
+        data += 16;
+        len -= 16;
     }
 
-    f->samplesize = f->bitdepth / 8;
-    f->frameindex = 0;
+    _mm_storeu_si128((__m128i *)tmp,_mm_shuffle_epi8(x3,bswap));
+    crc = technicallyflac_crc16_slice8(0,tmp,16);
+    return technicallyflac_crc16_slice8(crc,data,len);
+}
 
-    f->sm_state.state   = TECHNICALLYFLAC_STREAMMARKER_START;
-    f->si_state.state   = TECHNICALLYFLAC_STREAMINFO_START;
-    f->md_state.state   = TECHNICALLYFLAC_METADATA_START;
-    f->fr_state.state   = TECHNICALLYFLAC_FRAME_START;
-    f->fr_state.subframe.channels = ( f->channels < 8 ? f->channels : 2 );
-    technicallyflac_bitwriter_init(&f->bw);
+#undef TECHNICALLYFLAC_CLMUL_FOLD
 
-    return 0;
+#elif TECHNICALLYFLAC_ARM_PMULL
+
+static uint64x2_t technicallyflac_pmull_load(const uint8_t *data) {
+    uint8x16_t v = vrev64q_u8(vld1q_u8(data));
+    return vreinterpretq_u64_u8(vextq_u8(v,v,8));
 }
 
-int technicallyflac_streammarker(technicallyflac *f, uint8_t *output, uint32_t *bytes) {
-    int r = 1;
+static uint64x2_t technicallyflac_pmull_fold(uint64x2_t x, poly64_t hi, poly64_t lo) {
+    return veorq_u64(
+      vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(x,1),hi)),
+      vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(x,0),lo)));
+}
 
-    if(output == NULL || bytes == NULL || *bytes == 0) {
-        return 4;
+static uint16_t technicallyflac_crc16_clmul(uint16_t crc, const uint8_t *data, uint32_t len) {
+    uint64x2_t x0, x1, x2, x3;
+    uint8x16_t v;
+    uint8_t tmp[16];
+
+    x0 = technicallyflac_pmull_load(data     );
+    x1 = technicallyflac_pmull_load(data + 16);
+    x2 = technicallyflac_pmull_load(data + 32);
+    x3 = technicallyflac_pmull_load(data + 48);
+    x0 = veorq_u64(x0,vcombine_u64(vcreate_u64(0),vcreate_u64((uint64_t)crc << 48)));
+    data += 64;
+    len -= 64;
+
+    while(len >= 64) {
+        x0 = veorq_u64(technicallyflac_pmull_fold(x0,TECHNICALLYFLAC_CRC16_K576,TECHNICALLYFLAC_CRC16_K512),technicallyflac_pmull_load(data     ));
+        x1 = veorq_u64(technicallyflac_pmull_fold(x1,TECHNICALLYFLAC_CRC16_K576,TECHNICALLYFLAC_CRC16_K512),technicallyflac_pmull_load(data + 16));
+        x2 = veorq_u64(technicallyflac_pmull_fold(x2,TECHNICALLYFLAC_CRC16_K576,TECHNICALLYFLAC_CRC16_K512),technicallyflac_pmull_load(data + 32));
+        x3 = veorq_u64(technicallyflac_pmull_fold(x3,TECHNICALLYFLAC_CRC16_K576,TECHNICALLYFLAC_CRC16_K512),technicallyflac_pmull_load(data + 48));
+        data += 64;
+        len -= 64;
     }
 
-    f->bw.buffer = output;
-    f->bw.len = *bytes;
-    f->bw.pos = 0;
+    x3 = veorq_u64(x3,technicallyflac_pmull_fold(x0,TECHNICALLYFLAC_CRC16_K448,TECHNICALLYFLAC_CRC16_K384));
+    x3 = veorq_u64(x3,technicallyflac_pmull_fold(x1,TECHNICALLYFLAC_CRC16_K320,TECHNICALLYFLAC_CRC16_K256));
+    x3 = veorq_u64(x3,technicallyflac_pmull_fold(x2,TECHNICALLYFLAC_CRC16_K192,TECHNICALLYFLAC_CRC16_K128));
 
-    while(f->bw.pos < f->bw.len && r) {
-        technicallyflac_bitwriter_flush(&f->bw);
+    while(len >= 16) {
+        x3 = veorq_u64(technicallyflac_pmull_fold(x3,TECHNICALLYFLAC_CRC16_K192,TECHNICALLYFLAC_CRC16_K128),technicallyflac_pmull_load(data));
+        data += 16;
+        len -= 16;
+    }
 
-        switch(f->sm_state.state) {
-            case TECHNICALLYFLAC_STREAMMARKER_START: {
-                technicallyflac_bitwriter_init(&f->bw);
-                f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_F;
-                break;
-            }
-            case TECHNICALLYFLAC_STREAMMARKER_F: {
-                if(technicallyflac_bitwriter_add(&f->bw,8,'f')) {
-                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_L;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_STREAMMARKER_L: {
-                if(technicallyflac_bitwriter_add(&f->bw,8,'L')) {
-                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_A;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_STREAMMARKER_A: {
-                if(technicallyflac_bitwriter_add(&f->bw,8,'a')) {
-                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_C;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_STREAMMARKER_C: {
-                if(technicallyflac_bitwriter_add(&f->bw,8,'C')) {
-                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_END;
-                }
-                break;
+    v = vrev64q_u8(vreinterpretq_u8_u64(x3));
+    vst1q_u8(tmp,vextq_u8(v,v,8));
+    crc = technicallyflac_crc16_slice8(0,tmp,16);
+    return technicallyflac_crc16_slice8(crc,data,len);
+}
+
+#endif
+
+static uint16_t technicallyflac_crc16(uint32_t cpu, uint16_t crc, const uint8_t *data, uint32_t len) {
+#if TECHNICALLYFLAC_X86 || TECHNICALLYFLAC_ARM_PMULL
+    if(cpu & TECHNICALLYFLAC_CPU_CLMUL && len >= 128) {
+        return technicallyflac_crc16_clmul(crc,data,len);
+    }
+#else
+    (void)cpu;
+#endif
+    return technicallyflac_crc16_slice8(crc,data,len);
+}
+
+static uint32_t technicallyflac_cpu_detect(void) {
+    uint32_t cpu = 0;
+#if TECHNICALLYFLAC_X86
+    unsigned int a, b, c, d;
+    unsigned int xcr0;
+    if(__get_cpuid(1,&a,&b,&c,&d)) {
+        if(d & bit_SSE2) {
+            cpu |= TECHNICALLYFLAC_CPU_SSE2;
+        }
+        if(c & bit_SSSE3) {
+            cpu |= TECHNICALLYFLAC_CPU_SSSE3;
+            if(c & bit_PCLMUL) {
+                cpu |= TECHNICALLYFLAC_CPU_CLMUL;
             }
-            case TECHNICALLYFLAC_STREAMMARKER_END: {
-                if(f->bw.bits == 0) {
-                    r = 0;
-                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_START;
-                }
-                break;
+        }
+        /* AVX2 also needs the OS to save the ymm registers */
+        if( (c & bit_OSXSAVE) && __get_cpuid_max(0,NULL) >= 7) {
+            __asm__ ("xgetbv" : "=a"(xcr0), "=d"(d) : "c"(0));
+            __cpuid_count(7,0,a,b,c,d);
+            if( (xcr0 & 0x06) == 0x06 && (b & bit_AVX2) ) {
+                cpu |= TECHNICALLYFLAC_CPU_AVX2;
             }
         }
     }
+#elif TECHNICALLYFLAC_ARM_PMULL
+    cpu |= TECHNICALLYFLAC_CPU_CLMUL;
+#endif
+    return cpu;
+}
 
-    assert(f->bw.pos > 0);
-    *bytes = f->bw.pos;
+/* runs the CRCs over any bytes flushed since the last call */
+static void technicallyflac_bitwriter_crc(technicallyflac_bitwriter *bw, uint32_t cpu) {
+    bw->crc16 = technicallyflac_crc16(cpu,bw->crc16,&bw->buffer[bw->crcpos],bw->pos - bw->crcpos);
+    bw->crcpos = bw->pos;
+}
 
-    return r;
+static void technicallyflac_store64be(uint8_t *d, uint64_t val) {
+    d[0] = (uint8_t)(val >> 56);
+    d[1] = (uint8_t)(val >> 48);
+    d[2] = (uint8_t)(val >> 40);
+    d[3] = (uint8_t)(val >> 32);
+    d[4] = (uint8_t)(val >> 24);
+    d[5] = (uint8_t)(val >> 16);
+    d[6] = (uint8_t)(val >>  8);
+    d[7] = (uint8_t)(val      );
 }
 
-int technicallyflac_streaminfo(technicallyflac *f,uint8_t *output, uint32_t *bytes, uint8_t last_flag) {
-    int r = 1;
+static void technicallyflac_fastwriter_init(technicallyflac_fastwriter *fw, uint8_t *buffer, uint32_t len) {
+    fw->val    = 0;
+    fw->bits   = 0;
+    fw->crc16  = 0;
+    fw->crcpos = 0;
+    fw->pos    = 0;
+    fw->len    = len;
+    fw->buffer = buffer;
+}
 
-    if(output == NULL || bytes == NULL || *bytes == 0) {
-        return TECHNICALLYFLAC_STREAMINFO_SIZE;
+/* bits should be 1-63 */
+static void technicallyflac_fastwriter_add(technicallyflac_fastwriter *fw, uint8_t bits, uint64_t val) {
+    uint8_t spill;
+
+    val &= ((uint64_t)-1) >> (64 - bits);
+    if(fw->bits + bits < 64) {
+        fw->val <<= bits;
+        fw->val |= val;
+        fw->bits += bits;
+        return;
     }
 
-    f->bw.buffer = output;
-    f->bw.len = *bytes;
-    f->bw.pos = 0;
+    /* fill the word, store it, keep the leftover bits. anything above the
+     * leftover bits gets shifted out before the next store */
+    spill = fw->bits + bits - 64;
+    fw->val <<= (bits - spill);
+    fw->val |= val >> spill;
+    technicallyflac_store64be(&fw->buffer[fw->pos],fw->val);
+    fw->pos += 8;
+    fw->val = val;
+    fw->bits = spill;
+}
 
-    while(f->bw.pos < f->bw.len && r) {
-        technicallyflac_bitwriter_flush(&f->bw);
+/* writes out any whole bytes */
+static void technicallyflac_fastwriter_flush(technicallyflac_fastwriter *fw) {
+    while(fw->bits > 7) {
+        fw->bits -= 8;
+        fw->buffer[fw->pos++] = (uint8_t)(fw->val >> fw->bits);
+    }
+}
 
-        switch(f->si_state.state) {
-            case TECHNICALLYFLAC_STREAMINFO_START: {
-                technicallyflac_bitwriter_init(&f->bw);
-                f->si_state.state = TECHNICALLYFLAC_STREAMINFO_LAST_FLAG;
-                break;
-            }
-            /* last-metadata-block-flag */
-            case TECHNICALLYFLAC_STREAMINFO_LAST_FLAG: {
-                if(technicallyflac_bitwriter_add(&f->bw,1,last_flag)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_BLOCK_TYPE;
-                }
+static void technicallyflac_fastwriter_align(technicallyflac_fastwriter *fw) {
+    uint8_t r = fw->bits % 8;
+    if(r) {
+        technicallyflac_fastwriter_add(fw,8-r,0);
+    }
+}
+
+/* runs the CRC-16 over any bytes stored since the last call */
+static void technicallyflac_fastwriter_crc(technicallyflac_fastwriter *fw, uint32_t cpu) {
+    fw->crc16 = technicallyflac_crc16(cpu,fw->crc16,&fw->buffer[fw->crcpos],fw->pos - fw->crcpos);
+    fw->crcpos = fw->pos;
+}
+
+/* pshufb/tbl masks that turn 4 int32 samples into 4 big-endian samples of
+ * 1-4 bytes, packed at the start of the register */
+static const uint8_t technicallyflac_pack_shuffle[4][16] = {
+    {  0,  4,  8, 12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    {  1,  0,  5,  4,    9,    8,   13,   12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    {  2,  1,  0,  6,    5,    4,   10,    9,    8,   14,   13,   12, 0x80, 0x80, 0x80, 0x80 },
+    {  3,  2,  1,  0,    7,    6,    5,    4,   11,   10,    9,    8,   15,   14,   13,   12 },
+};
+
+/* scalar version of the byte-aligned verbatim kernel */
+static void technicallyflac_pack_be_scalar(uint8_t *dst, const int32_t *src, uint32_t count, uint8_t width) {
+    uint32_t i;
+    uint32_t s;
+
+    switch(width) {
+        case 1: {
+            for(i=0;i<count;i++) {
+                dst[i] = (uint8_t)src[i];
+            }
+            break;
+        }
+        case 2: {
+            for(i=0;i<count;i++) {
+                s = (uint32_t)src[i];
+                dst[0] = (uint8_t)(s >> 8);
+                dst[1] = (uint8_t)(s     );
+                dst += 2;
+            }
+            break;
+        }
+        case 3: {
+            for(i=0;i<count;i++) {
+                s = (uint32_t)src[i];
+                dst[0] = (uint8_t)(s >> 16);
+                dst[1] = (uint8_t)(s >>  8);
+                dst[2] = (uint8_t)(s      );
+                dst += 3;
+            }
+            break;
+        }
+        default: {
+            for(i=0;i<count;i++) {
+                s = (uint32_t)src[i];
+                dst[0] = (uint8_t)(s >> 24);
+                dst[1] = (uint8_t)(s >> 16);
+                dst[2] = (uint8_t)(s >>  8);
+                dst[3] = (uint8_t)(s      );
+                dst += 4;
+            }
+        }
+    }
+}
+
+/* the vector versions store full registers and let the next store
+ * overwrite the unused part, so they stop while there's still a full
+ * register's worth of samples left and hand the rest to the scalar version */
+#if TECHNICALLYFLAC_X86
+
+TECHNICALLYFLAC_TARGET("ssse3")
+static uint32_t technicallyflac_pack_be_ssse3(uint8_t *dst, const int32_t *src, uint32_t count, uint8_t width) {
+    const __m128i mask = _mm_loadu_si128((const __m128i *)technicallyflac_pack_shuffle[width-1]);
+    uint32_t i = 0;
+
+    while(i + 16 <= count) {
+        _mm_storeu_si128((__m128i *)dst,_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&src[i]),mask));
+        dst += 4 * width;
+        i += 4;
+    }
+    return i;
+}
+
+TECHNICALLYFLAC_TARGET("avx2")
+static uint32_t technicallyflac_pack_be_avx2(uint8_t *dst, const int32_t *src, uint32_t count, uint8_t width) {
+    const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)technicallyflac_pack_shuffle[width-1]));
+    __m256i lanes;
+    uint32_t i = 0;
+
+    /* each 128-bit lane packs its samples at the start of the lane,
+     * this moves the upper lane's bytes next to the lower lane's */
+    switch(width) {
+        case 1:  lanes = _mm256_setr_epi32(0,4,4,4,4,4,4,4); break;
+        case 2:  lanes = _mm256_setr_epi32(0,1,4,5,4,4,4,4); break;
+        case 3:  lanes = _mm256_setr_epi32(0,1,2,4,5,6,4,4); break;
+        default: lanes = _mm256_setr_epi32(0,1,2,3,4,5,6,7);
+    }
+
+    while(i + 32 <= count) {
+        _mm256_storeu_si256((__m256i *)dst,
+          _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)&src[i]),mask),lanes));
+        dst += 8 * width;
+        i += 8;
+    }
+    return i;
+}
+
+#elif TECHNICALLYFLAC_ARM
+
+static uint32_t technicallyflac_pack_be_neon(uint8_t *dst, const int32_t *src, uint32_t count, uint8_t width) {
+    const uint8x16_t mask = vld1q_u8(technicallyflac_pack_shuffle[width-1]);
+    uint32_t i = 0;
+
+    while(i + 16 <= count) {
+        vst1q_u8(dst,vqtbl1q_u8(vreinterpretq_u8_s32(vld1q_s32(&src[i])),mask));
+        dst += 4 * width;
+        i += 4;
+    }
+    return i;
+}
+
+#endif
+
+/* writes count samples as big-endian, width-byte values */
+static void technicallyflac_pack_be(uint32_t cpu, uint8_t *dst, const int32_t *src, uint32_t count, uint8_t width) {
+    uint32_t i = 0;
+
+#if TECHNICALLYFLAC_X86
+    if(cpu & TECHNICALLYFLAC_CPU_AVX2) {
+        i = technicallyflac_pack_be_avx2(dst,src,count,width);
+    } else if(cpu & TECHNICALLYFLAC_CPU_SSSE3) {
+        i = technicallyflac_pack_be_ssse3(dst,src,count,width);
+    }
+#elif TECHNICALLYFLAC_ARM
+    (void)cpu;
+    i = technicallyflac_pack_be_neon(dst,src,count,width);
+#else
+    (void)cpu;
+#endif
+
+    technicallyflac_pack_be_scalar(&dst[i * width],&src[i],count - i,width);
+}
+
+/* copies len bytes, for metadata blocks that are already in memory */
+#if TECHNICALLYFLAC_X86
+
+TECHNICALLYFLAC_TARGET("sse2")
+static uint32_t technicallyflac_copy_sse2(uint8_t *dst, const uint8_t *src, uint32_t len) {
+    uint32_t i = 0;
+
+    while(i + 64 <= len) {
+        _mm_storeu_si128((__m128i *)&dst[i     ],_mm_loadu_si128((const __m128i *)&src[i     ]));
+        _mm_storeu_si128((__m128i *)&dst[i + 16],_mm_loadu_si128((const __m128i *)&src[i + 16]));
+        _mm_storeu_si128((__m128i *)&dst[i + 32],_mm_loadu_si128((const __m128i *)&src[i + 32]));
+        _mm_storeu_si128((__m128i *)&dst[i + 48],_mm_loadu_si128((const __m128i *)&src[i + 48]));
+        i += 64;
+    }
+    return i;
+}
+
+#elif TECHNICALLYFLAC_ARM
+
+static uint32_t technicallyflac_copy_neon(uint8_t *dst, const uint8_t *src, uint32_t len) {
+    uint32_t i = 0;
+
+    while(i + 64 <= len) {
+        vst1q_u8(&dst[i     ],vld1q_u8(&src[i     ]));
+        vst1q_u8(&dst[i + 16],vld1q_u8(&src[i + 16]));
+        vst1q_u8(&dst[i + 32],vld1q_u8(&src[i + 32]));
+        vst1q_u8(&dst[i + 48],vld1q_u8(&src[i + 48]));
+        i += 64;
+    }
+    return i;
+}
+
+#endif
+
+static void technicallyflac_copy(uint32_t cpu, uint8_t *dst, const uint8_t *src, uint32_t len) {
+    uint32_t i = 0;
+
+#if TECHNICALLYFLAC_X86
+    if(cpu & TECHNICALLYFLAC_CPU_SSE2) {
+        i = technicallyflac_copy_sse2(dst,src,len);
+    }
+#elif TECHNICALLYFLAC_ARM
+    (void)cpu;
+    i = technicallyflac_copy_neon(dst,src,len);
+#else
+    (void)cpu;
+#endif
+
+    for(;i<len;i++) {
+        dst[i] = src[i];
+    }
+}
+
+/* packs samples of any width (up to 56 bits) without branching on the
+ * number of bits held. The accumulator is kept left-aligned, every sample
+ * is followed by an unconditional 8-byte store and only the whole bytes are
+ * kept, so this runs while there's 8 bytes of room left in the buffer. */
+#define TECHNICALLYFLAC_PACK_BITS(type, name, storage) \
+storage void technicallyflac_##name##_##type(technicallyflac_fastwriter *fw, const type *src, uint32_t count, uint8_t width) { \
+    const uint64_t mask = ((uint64_t)-1) >> (64 - width); \
+    uint8_t *dst; \
+    uint8_t *end; \
+    uint64_t acc; \
+    uint32_t bits; \
+    uint32_t i; \
+    technicallyflac_fastwriter_flush(fw); \
+    dst = &fw->buffer[fw->pos]; \
+    end = &fw->buffer[fw->len]; \
+    bits = fw->bits; \
+    acc = bits ? fw->val << (64 - bits) : 0; \
+    for(i=0;i<count && end - dst >= 8;i++) { \
+        acc |= ((uint64_t)src[i] & mask) << (64 - width - bits); \
+        bits += width; \
+        technicallyflac_store64be(dst,acc); \
+        dst += bits >> 3; \
+        acc <<= bits & ~7; \
+        bits &= 7; \
+    } \
+    fw->pos = (uint32_t)(dst - fw->buffer); \
+    fw->bits = (uint8_t)bits; \
+    fw->val = bits ? acc >> (64 - bits) : 0; \
+    for(;i<count;i++) { \
+        technicallyflac_fastwriter_add(fw,width,(uint64_t)src[i]); \
+    } \
+}
+
+TECHNICALLYFLAC_PACK_BITS(int32_t,pack_bits,static)
+TECHNICALLYFLAC_PACK_BITS(int64_t,pack_bits,static)
+
+/* the same, inlined where width is a constant (see technicallyflac_frame_const) */
+TECHNICALLYFLAC_PACK_BITS(int32_t,pack_bits_const,TECHNICALLYFLAC_INLINE)
+TECHNICALLYFLAC_PACK_BITS(int64_t,pack_bits_const,TECHNICALLYFLAC_INLINE)
+
+/* adds one sample to a left-aligned accumulator and stores the whole bytes,
+ * like technicallyflac_pack_bits */
+TECHNICALLYFLAC_INLINE void technicallyflac_pack_one(uint8_t **dst, uint64_t *acc, uint32_t *bits, uint64_t sample, uint8_t width) {
+    *acc |= (sample & (((uint64_t)-1) >> (64 - width))) << (64 - width - *bits);
+    *bits += width;
+    technicallyflac_store64be(*dst,*acc);
+    *dst += *bits >> 3;
+    *acc <<= *bits & ~7;
+    *bits &= 7;
+}
+
+/* technicallyflac_pack_bits from a byte boundary, in groups of samples
+ * that end on one (8 samples of 17 bits, 2 of 20). Where width is a
+ * constant the group is written out sample by sample and every shift is
+ * known, nothing carries from one group to the next. Needs 8 bytes of room
+ * past the group, returns the samples packed */
+#define TECHNICALLYFLAC_PACK_GROUPS(type) \
+TECHNICALLYFLAC_INLINE uint32_t technicallyflac_pack_groups_##type(uint8_t *dst, const uint8_t *end, const type *src, uint32_t count, uint8_t width) { \
+    const uint32_t group = width % 2 ? 8 : width % 4 ? 4 : width % 8 ? 2 : 1; \
+    uint64_t acc; \
+    uint32_t bits; \
+    uint32_t i; \
+    for(i=0;i + group <= count && end - dst >= 8 + group * width / 8;i += group) { \
+        acc = 0; \
+        bits = 0; \
+        technicallyflac_pack_one(&dst,&acc,&bits,(uint64_t)src[i],width); \
+        if(group > 1) { \
+            technicallyflac_pack_one(&dst,&acc,&bits,(uint64_t)src[i + 1],width); \
+        } \
+        if(group > 2) { \
+            technicallyflac_pack_one(&dst,&acc,&bits,(uint64_t)src[i + 2],width); \
+            technicallyflac_pack_one(&dst,&acc,&bits,(uint64_t)src[i + 3],width); \
+        } \
+        if(group > 4) { \
+            technicallyflac_pack_one(&dst,&acc,&bits,(uint64_t)src[i + 4],width); \
+            technicallyflac_pack_one(&dst,&acc,&bits,(uint64_t)src[i + 5],width); \
+            technicallyflac_pack_one(&dst,&acc,&bits,(uint64_t)src[i + 6],width); \
+            technicallyflac_pack_one(&dst,&acc,&bits,(uint64_t)src[i + 7],width); \
+        } \
+    } \
+    return i; \
+}
+
+TECHNICALLYFLAC_PACK_GROUPS(int32_t)
+TECHNICALLYFLAC_PACK_GROUPS(int64_t)
+
+#undef TECHNICALLYFLAC_PACK_GROUPS
+
+#undef TECHNICALLYFLAC_PACK_BITS
+
+static uint32_t technicallyflac_zigzag(int32_t val) {
+    return ((uint32_t)val << 1) ^ (uint32_t)(val >> 31);
+}
+
+/* rice codes residuals with parameter k (0-30) the same way as
+ * technicallyflac_pack_bits. Codes over 56 bits only come from outliers,
+ * those go through technicallyflac_fastwriter_add in pieces */
+static void technicallyflac_pack_rice(technicallyflac_fastwriter *fw, const int32_t *src, uint32_t count, uint8_t k) {
+    const uint32_t mask = ((uint32_t)1 << k) - 1;
+    uint8_t *dst;
+    uint8_t *end;
+    uint64_t acc;
+    uint32_t bits;
+    uint32_t len;
+    uint32_t u;
+    uint32_t q;
+    uint32_t i = 0;
+
+    while(i < count) {
+        technicallyflac_fastwriter_flush(fw);
+        dst = &fw->buffer[fw->pos];
+        end = &fw->buffer[fw->len];
+        bits = fw->bits;
+        acc = bits ? fw->val << (64 - bits) : 0;
+        for(;i<count && end - dst >= 8;i++) {
+            u = technicallyflac_zigzag(src[i]);
+            q = u >> k;
+            if(q > 55u - k) break;
+            len = q + 1 + k;
+            acc |= (uint64_t)((u & mask) | (mask + 1)) << (64 - len - bits);
+            bits += len;
+            technicallyflac_store64be(dst,acc);
+            dst += bits >> 3;
+            acc <<= bits & ~7;
+            bits &= 7;
+        }
+        fw->pos = (uint32_t)(dst - fw->buffer);
+        fw->bits = (uint8_t)bits;
+        fw->val = bits ? acc >> (64 - bits) : 0;
+
+        if(i < count) {
+            u = technicallyflac_zigzag(src[i]);
+            for(q = u >> k; q > 32; q -= 32) {
+                technicallyflac_fastwriter_add(fw,32,0);
+            }
+            technicallyflac_fastwriter_add(fw,(uint8_t)(q + 1 + k),(u & mask) | (mask + 1));
+            i++;
+        }
+    }
+}
+
+/* drops wasted bits, out-of-place so it works on the caller's samples */
+#define TECHNICALLYFLAC_SHIFT(type) \
+static void technicallyflac_shift_##type(const type *src, type *dst, uint32_t count, uint8_t shift) { \
+    uint32_t i; \
+    for(i=0;i<count;i++) { \
+        dst[i] = src[i] >> shift; \
+    } \
+}
+
+TECHNICALLYFLAC_SHIFT(int32_t)
+TECHNICALLYFLAC_SHIFT(int64_t)
+
+#undef TECHNICALLYFLAC_SHIFT
+
+/* stereo decorrelation, done a chunk at a time in separate passes so the
+ * compiler can vectorize them. side needs bitdepth+1 bits so it's 64-bit,
+ * mid is computed without overflowing a 32-bit sum */
+static void technicallyflac_stereo_side(const int32_t *left, const int32_t *right, int64_t *side, uint32_t count) {
+    uint32_t i;
+    for(i=0;i<count;i++) {
+        side[i] = (int64_t)left[i] - (int64_t)right[i];
+    }
+}
+
+static void technicallyflac_stereo_mid(const int32_t *left, const int32_t *right, int32_t *mid, uint32_t count) {
+    uint32_t i;
+    for(i=0;i<count;i++) {
+        mid[i] = (left[i] >> 1) + (right[i] >> 1) + (left[i] & right[i] & 1);
+    }
+}
+
+/* MD5 (RFC 1321) of the audio for STREAMINFO */
+static const uint32_t technicallyflac_md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+    0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+    0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+    0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+    0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+    0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t technicallyflac_md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+static uint32_t technicallyflac_load32be(const uint8_t *d) {
+    return ((uint32_t)d[0] << 24) | ((uint32_t)d[1] << 16) | ((uint32_t)d[2] << 8) | (uint32_t)d[3];
+}
+
+static void technicallyflac_md5_init(struct technicallyflac_md5_s *m) {
+    m->state[0] = 0x67452301;
+    m->state[1] = 0xefcdab89;
+    m->state[2] = 0x98badcfe;
+    m->state[3] = 0x10325476;
+    m->len = 0;
+}
+
+static void technicallyflac_md5_transform(uint32_t *state, const uint8_t *block) {
+    uint32_t w[16];
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t f;
+    uint32_t t;
+    uint8_t g;
+    uint8_t i;
+
+    for(i=0;i<16;i++) {
+        w[i] = (uint32_t)block[i*4] | ((uint32_t)block[i*4+1] << 8) |
+               ((uint32_t)block[i*4+2] << 16) | ((uint32_t)block[i*4+3] << 24);
+    }
+
+    for(i=0;i<64;i++) {
+        if(i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if(i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) & 15;
+        } else if(i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) & 15;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) & 15;
+        }
+        t = d;
+        d = c;
+        c = b;
+        f += a + technicallyflac_md5_k[i] + w[g];
+        b += (f << technicallyflac_md5_r[i]) | (f >> (32 - technicallyflac_md5_r[i]));
+        a = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+static void technicallyflac_md5_update(struct technicallyflac_md5_s *m, const uint8_t *data, uint32_t len) {
+    uint32_t fill = (uint32_t)(m->len & 63);
+
+    m->len += len;
+    if(fill) {
+        while(fill < 64 && len) {
+            m->buffer[fill++] = *data++;
+            len--;
+        }
+        if(fill < 64) return;
+        technicallyflac_md5_transform(m->state,m->buffer);
+    }
+    while(len >= 64) {
+        technicallyflac_md5_transform(m->state,data);
+        data += 64;
+        len -= 64;
+    }
+    for(fill=0;fill<len;fill++) {
+        m->buffer[fill] = data[fill];
+    }
+}
+
+/* finishes a copy of the MD5 so more audio can still be added */
+static void technicallyflac_md5_final(const struct technicallyflac_md5_s *m, uint8_t *digest) {
+    struct technicallyflac_md5_s c = *m;
+    uint8_t pad[72];
+    uint32_t padlen;
+    uint32_t i;
+
+    padlen = 64 - (uint32_t)((m->len + 8) & 63);
+    if(padlen == 0) padlen = 64;
+    pad[0] = 0x80;
+    for(i=1;i<padlen;i++) {
+        pad[i] = 0;
+    }
+    for(i=0;i<8;i++) {
+        pad[padlen + i] = (uint8_t)((m->len * 8) >> (i * 8));
+    }
+    technicallyflac_md5_update(&c,pad,padlen + 8);
+
+    for(i=0;i<16;i++) {
+        digest[i] = (uint8_t)(c.state[i / 4] >> ((i % 4) * 8));
+    }
+}
+
+/* the 4-bit frame header block size code, 6 and 7 mean (blocksize-1) follows
+ * in 8 or 16 bits at the end of the header */
+static uint8_t technicallyflac_blocksize_code(uint32_t blocksize) {
+    uint8_t code;
+
+    if(blocksize == 192) return 1;
+    for(code=0;code<4;code++) {
+        if(blocksize == ((uint32_t)576 << code)) return 2 + code;
+    }
+    for(code=0;code<8;code++) {
+        if(blocksize == ((uint32_t)256 << code)) return 8 + code;
+    }
+    return blocksize <= 256 ? 6 : 7;
+}
+
+/* sync, reserved, blocking strategy, block size, sample rate, channels, sample size */
+static void technicallyflac_header_template(technicallyflac *f) {
+    f->header[0] = 0xFF;
+    f->header[1] = (uint8_t)(0xF8 | ((f->flags & TECHNICALLYFLAC_FLAG_VARIABLE) != 0));
+    f->header[2] = (uint8_t)((technicallyflac_blocksize_code(f->blocksize) << 4) | f->samplerate_header);
+    f->header[3] = (uint8_t)(((f->channels - 1) << 4) | (f->bitdepth_header << 1));
+    f->header_crc8 = technicallyflac_crc8(0,f->header,4);
+}
+
+/* a fixed blocksize stream always says blocksize, a variable one says what
+ * it's written so far. STREAMINFO can't go under 16 */
+static uint32_t technicallyflac_streaminfo_blocksize(const technicallyflac *f, uint8_t max) {
+    if(!(f->flags & TECHNICALLYFLAC_FLAG_VARIABLE) || f->max_blocksize == 0) {
+        return f->blocksize;
+    }
+    if(max) return f->max_blocksize < 16 ? 16 : f->max_blocksize;
+    return f->min_blocksize < 16 ? 16 : f->min_blocksize;
+}
+
+size_t technicallyflac_size(void) {
+    return sizeof(technicallyflac);
+}
+
+int technicallyflac_init(technicallyflac *f, uint32_t blocksize, uint32_t samplerate, uint8_t channels, uint8_t bitdepth) {
+
+    f->blocksize  = blocksize;
+    f->samplerate = samplerate;
+    f->channels   = channels;
+    f->bitdepth   = bitdepth;
+
+    if(f->bitdepth < 4 || f->bitdepth > 32) {
+        return -1;
+    }
+
+    if(f->channels < 1 || f->channels > 11) return -1;
+
+    /* STREAMINFO has 20 bits for it */
+    if(f->samplerate == 0 || f->samplerate > 0xFFFFF) return -1;
+
+    switch(f->bitdepth) {
+        case 8:  {
+            f->bitdepth_header = 1;
+            break;
+        }
+        case 12:  {
+            f->bitdepth_header = 2;
+            break;
+        }
+        case 16: {
+            f->bitdepth_header = 4;
+            break;
+        }
+        case 20: {
+            f->bitdepth_header = 5;
+            break;
+        }
+        case 24: {
+            f->bitdepth_header = 6;
+            break;
+        }
+        default: f->bitdepth_header = 0;
+    }
+
+    f->samplerate_value = 0;
+    switch(f->samplerate) {
+        case 88200:  f->samplerate_header = 1;  break;
+        case 176400: f->samplerate_header = 2;  break;
+        case 192000: f->samplerate_header = 3;  break;
+        case 8000:   f->samplerate_header = 4;  break;
+        case 16000:  f->samplerate_header = 5;  break;
+        case 22050:  f->samplerate_header = 6;  break;
+        case 24000:  f->samplerate_header = 7;  break;
+        case 32000:  f->samplerate_header = 8;  break;
+        case 44100:  f->samplerate_header = 9;  break;
+        case 48000:  f->samplerate_header = 10; break;
+        case 96000:  f->samplerate_header = 11; break;
+        default: {
+            if(f->samplerate % 1000 == 0 && f->samplerate <= 255000) {
+                f->samplerate_header = 12;
+                f->samplerate_value  = f->samplerate / 1000;
+            } else if(f->samplerate <= 0xFFFF) {
+                f->samplerate_header = 13;
+                f->samplerate_value  = f->samplerate;
+            } else if(f->samplerate % 10 == 0 && f->samplerate / 10 <= 0xFFFF) {
+                f->samplerate_header = 14;
+                f->samplerate_value  = f->samplerate / 10;
+            } else {
+                /* too big for the frame header, use the STREAMINFO rate */
+                f->samplerate_header = 0;
+            }
+        }
+    }
+
+    f->samplesize = f->bitdepth / 8;
+    f->frameindex = 0;
+    f->sampleindex = 0;
+    f->cpu = technicallyflac_cpu_detect();
+    f->flags = 0;
+    f->workspace = NULL;
+    technicallyflac_header_template(f);
+    f->total_samples = 0;
+    f->min_blocksize = 0;
+    f->max_blocksize = 0;
+    f->min_framesize = 0;
+    f->max_framesize = 0;
+    technicallyflac_md5_init(&f->md5);
+    f->stream_bytes = 0;
+    f->seekpoints = NULL;
+    f->seekpoints_len = 0;
+    f->seekpoints_used = 0;
+
+    f->sm_state.state   = TECHNICALLYFLAC_STREAMMARKER_START;
+    f->si_state.state   = TECHNICALLYFLAC_STREAMINFO_START;
+    f->md_state.state   = TECHNICALLYFLAC_METADATA_START;
+    f->st_state.state   = TECHNICALLYFLAC_SEEKTABLE_START;
+    f->fr_state.state   = TECHNICALLYFLAC_FRAME_START;
+    f->fr_state.subframe.channels = ( f->channels < 9 ? f->channels : 2 );
+    technicallyflac_bitwriter_init(&f->bw);
+
+    return 0;
+}
+
+int technicallyflac_set_flags(technicallyflac *f, uint32_t flags) {
+    if(flags & ~((uint32_t)(TECHNICALLYFLAC_FLAG_CONSTANT | TECHNICALLYFLAC_FLAG_FIXED | TECHNICALLYFLAC_FLAG_WASTED | TECHNICALLYFLAC_FLAG_MD5 | TECHNICALLYFLAC_FLAG_VARIABLE | TECHNICALLYFLAC_FLAG_VERIFY))) {
+        return -1;
+    }
+    if((flags & TECHNICALLYFLAC_FLAG_FIXED) && f->workspace == NULL) {
+        return -1;
+    }
+    f->flags = flags;
+    technicallyflac_header_template(f);
+    return 0;
+}
+
+int technicallyflac_set_workspace(technicallyflac *f, void *workspace, uint32_t len) {
+    if(len < technicallyflac_size_workspace(f->blocksize)) {
+        return -1;
+    }
+    f->workspace = workspace;
+    return 0;
+}
+
+int technicallyflac_set_seektable(technicallyflac *f, technicallyflac_seekpoint *points, uint32_t num_points, uint64_t spacing) {
+    if(spacing == 0 || num_points > 0xFFFFFF / 18) return -1;
+
+    f->seekpoints = points;
+    f->seekpoints_len = num_points;
+    f->seekpoints_used = 0;
+    f->seekpoint_spacing = spacing;
+    f->seekpoint_next = 0;
+    return 0;
+}
+
+int technicallyflac_streammarker(technicallyflac *f, uint8_t *output, uint32_t *bytes) {
+    int r = 1;
+
+    if(output == NULL || bytes == NULL || *bytes == 0) {
+        return 4;
+    }
+
+    f->bw.buffer = output;
+    f->bw.len = *bytes;
+    f->bw.pos = 0;
+
+    while(f->bw.pos < f->bw.len && r) {
+        technicallyflac_bitwriter_flush(&f->bw);
+
+        switch(f->sm_state.state) {
+            case TECHNICALLYFLAC_STREAMMARKER_START: {
+                technicallyflac_bitwriter_init(&f->bw);
+                f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_F;
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMMARKER_F: {
+                if(technicallyflac_bitwriter_add(&f->bw,8,'f')) {
+                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_L;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMMARKER_L: {
+                if(technicallyflac_bitwriter_add(&f->bw,8,'L')) {
+                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_A;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMMARKER_A: {
+                if(technicallyflac_bitwriter_add(&f->bw,8,'a')) {
+                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_C;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMMARKER_C: {
+                if(technicallyflac_bitwriter_add(&f->bw,8,'C')) {
+                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_END;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMMARKER_END: {
+                if(f->bw.bits == 0) {
+                    r = 0;
+                    f->sm_state.state = TECHNICALLYFLAC_STREAMMARKER_START;
+                }
+                break;
+            }
+        }
+    }
+
+    assert(f->bw.pos > 0);
+    *bytes = f->bw.pos;
+
+    return r;
+}
+
+int technicallyflac_streaminfo(technicallyflac *f,uint8_t *output, uint32_t *bytes, uint8_t last_flag) {
+    int r = 1;
+
+    if(output == NULL || bytes == NULL || *bytes == 0) {
+        return TECHNICALLYFLAC_STREAMINFO_SIZE;
+    }
+
+    f->bw.buffer = output;
+    f->bw.len = *bytes;
+    f->bw.pos = 0;
+
+    while(f->bw.pos < f->bw.len && r) {
+        technicallyflac_bitwriter_flush(&f->bw);
+
+        switch(f->si_state.state) {
+            case TECHNICALLYFLAC_STREAMINFO_START: {
+                technicallyflac_bitwriter_init(&f->bw);
+                technicallyflac_streaminfo_md5(f,f->si_state.md5);
+                f->si_state.state = TECHNICALLYFLAC_STREAMINFO_LAST_FLAG;
+                break;
+            }
+            /* last-metadata-block-flag */
+            case TECHNICALLYFLAC_STREAMINFO_LAST_FLAG: {
+                if(technicallyflac_bitwriter_add(&f->bw,1,last_flag)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_BLOCK_TYPE;
+                }
+                break;
+            }
+            /* BLOCK_TYPE */
+            case TECHNICALLYFLAC_STREAMINFO_BLOCK_TYPE: {
+                if(technicallyflac_bitwriter_add(&f->bw,7,0)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_BLOCK_LENGTH;
+                }
+                break;
+            }
+            /* BLOCK_LENGTH */
+            case TECHNICALLYFLAC_STREAMINFO_BLOCK_LENGTH: {
+                if(technicallyflac_bitwriter_add(&f->bw,24,34)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MIN_BLOCK_SIZE;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_MIN_BLOCK_SIZE: {
+                if(technicallyflac_bitwriter_add(&f->bw,16,technicallyflac_streaminfo_blocksize(f,0))) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MAX_BLOCK_SIZE;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_MAX_BLOCK_SIZE: {
+                if(technicallyflac_bitwriter_add(&f->bw,16,technicallyflac_streaminfo_blocksize(f,1))) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MIN_FRAME_SIZE;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_MIN_FRAME_SIZE: {
+                if(technicallyflac_bitwriter_add(&f->bw,24,f->min_framesize)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MAX_FRAME_SIZE;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_MAX_FRAME_SIZE: {
+                if(technicallyflac_bitwriter_add(&f->bw,24,f->max_framesize)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_SAMPLE_RATE;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_SAMPLE_RATE: {
+                if(technicallyflac_bitwriter_add(&f->bw,20,f->samplerate)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_CHANNELS;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_CHANNELS: {
+                if(technicallyflac_bitwriter_add(&f->bw,3,f->channels > 8 ? 1 : f->channels - 1)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_BIT_DEPTH;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_BIT_DEPTH: {
+                if(technicallyflac_bitwriter_add(&f->bw,5,f->bitdepth - 1)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_TOTAL_SAMPLES;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_TOTAL_SAMPLES: {
+                if(technicallyflac_bitwriter_add(&f->bw,36,f->total_samples)) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MD5_1;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_MD5_1: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,technicallyflac_load32be(&f->si_state.md5[0]))) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MD5_2;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_MD5_2: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,technicallyflac_load32be(&f->si_state.md5[4]))) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MD5_3;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_MD5_3: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,technicallyflac_load32be(&f->si_state.md5[8]))) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MD5_4;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_STREAMINFO_MD5_4: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,technicallyflac_load32be(&f->si_state.md5[12]))) {
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_END;
+                }
+                break;
+            }
+
+            case TECHNICALLYFLAC_STREAMINFO_END: {
+                if(f->bw.bits == 0) {
+                    r = 0;
+                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_START;
+                }
+                break;
+            }
+
+        }
+    }
+
+    assert(f->bw.pos > 0);
+    *bytes = f->bw.pos;
+    return r;
+}
+
+int technicallyflac_streaminfo_finalize(technicallyflac *f, uint8_t *output, uint32_t *bytes) {
+    technicallyflac_fastwriter fw;
+    uint8_t md5[16];
+    uint8_t i;
+
+    if(output == NULL || bytes == NULL || *bytes < TECHNICALLYFLAC_STREAMINFO_SIZE - 4) {
+        return -1;
+    }
+
+    technicallyflac_streaminfo_md5(f,md5);
+
+    /* 272 bits, the fastwriter only stores whole words up to byte 32 */
+    technicallyflac_fastwriter_init(&fw,output,*bytes);
+    technicallyflac_fastwriter_add(&fw,16,technicallyflac_streaminfo_blocksize(f,0));
+    technicallyflac_fastwriter_add(&fw,16,technicallyflac_streaminfo_blocksize(f,1));
+    technicallyflac_fastwriter_add(&fw,24,f->min_framesize);
+    technicallyflac_fastwriter_add(&fw,24,f->max_framesize);
+    technicallyflac_fastwriter_add(&fw,20,f->samplerate);
+    technicallyflac_fastwriter_add(&fw,3,f->channels > 8 ? 1 : f->channels - 1);
+    technicallyflac_fastwriter_add(&fw,5,f->bitdepth - 1);
+    technicallyflac_fastwriter_add(&fw,36,f->total_samples);
+    for(i=0;i<16;i+=4) {
+        technicallyflac_fastwriter_add(&fw,32,technicallyflac_load32be(&md5[i]));
+    }
+    technicallyflac_fastwriter_flush(&fw);
+
+    assert(fw.pos == TECHNICALLYFLAC_STREAMINFO_SIZE - 4);
+    *bytes = fw.pos;
+    return 0;
+}
+
+int technicallyflac_seektable(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag) {
+    const technicallyflac_seekpoint *p;
+    uint64_t sample;
+    int r = 1;
+
+    if(output == NULL || bytes == NULL || *bytes == 0) {
+        return technicallyflac_size_seektable(f->seekpoints_len);
+    }
+
+    f->bw.buffer = output;
+    f->bw.len = *bytes;
+    f->bw.pos = 0;
+
+    while(f->bw.pos < f->bw.len && r) {
+        technicallyflac_bitwriter_flush(&f->bw);
+
+        /* placeholders are all ones for the sample number, zeroes otherwise */
+        p = NULL;
+        sample = (uint64_t)-1;
+        if(f->st_state.pos < f->seekpoints_used) {
+            p = &f->seekpoints[f->st_state.pos];
+            sample = p->sample;
+        }
+
+        switch(f->st_state.state) {
+            case TECHNICALLYFLAC_SEEKTABLE_START: {
+                technicallyflac_bitwriter_init(&f->bw);
+                f->st_state.state = TECHNICALLYFLAC_SEEKTABLE_HEADER;
+                f->st_state.pos = 0;
+                break;
+            }
+            case TECHNICALLYFLAC_SEEKTABLE_HEADER: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,((uint32_t)(last_flag & 1) << 31) | (3 << 24) | (18 * f->seekpoints_len))) {
+                    f->st_state.state = f->seekpoints_len ? TECHNICALLYFLAC_SEEKTABLE_SAMPLE_HI : TECHNICALLYFLAC_SEEKTABLE_END;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_SEEKTABLE_SAMPLE_HI: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,sample >> 32)) {
+                    f->st_state.state = TECHNICALLYFLAC_SEEKTABLE_SAMPLE_LO;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_SEEKTABLE_SAMPLE_LO: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,sample)) {
+                    f->st_state.state = TECHNICALLYFLAC_SEEKTABLE_OFFSET_HI;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_SEEKTABLE_OFFSET_HI: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,p != NULL ? p->offset >> 32 : 0)) {
+                    f->st_state.state = TECHNICALLYFLAC_SEEKTABLE_OFFSET_LO;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_SEEKTABLE_OFFSET_LO: {
+                if(technicallyflac_bitwriter_add(&f->bw,32,p != NULL ? p->offset : 0)) {
+                    f->st_state.state = TECHNICALLYFLAC_SEEKTABLE_SAMPLES;
+                }
                 break;
             }
-            /* BLOCK_TYPE */
-            case TECHNICALLYFLAC_STREAMINFO_BLOCK_TYPE: {
-                if(technicallyflac_bitwriter_add(&f->bw,7,0)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_BLOCK_LENGTH;
+            case TECHNICALLYFLAC_SEEKTABLE_SAMPLES: {
+                if(technicallyflac_bitwriter_add(&f->bw,16,p != NULL ? p->samples : 0)) {
+                    f->st_state.pos++;
+                    f->st_state.state = f->st_state.pos == f->seekpoints_len ? TECHNICALLYFLAC_SEEKTABLE_END : TECHNICALLYFLAC_SEEKTABLE_SAMPLE_HI;
                 }
                 break;
             }
-            /* BLOCK_LENGTH */
-            case TECHNICALLYFLAC_STREAMINFO_BLOCK_LENGTH: {
-                if(technicallyflac_bitwriter_add(&f->bw,24,34)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MIN_BLOCK_SIZE;
+            case TECHNICALLYFLAC_SEEKTABLE_END: {
+                if(f->bw.bits == 0) {
+                    r = 0;
+                    f->st_state.state = TECHNICALLYFLAC_SEEKTABLE_START;
+                }
+                break;
+            }
+        }
+    }
+
+    assert(f->bw.pos > 0);
+    *bytes = f->bw.pos;
+    return r;
+}
+
+/* writes a metadata block from either block or the read callback */
+static int technicallyflac_metadata_block(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag, uint8_t block_type, uint32_t block_length, uint8_t *block, technicallyflac_read_func reader, void *userdata) {
+    int r = 1;
+    uint32_t n;
+
+    if(output == NULL || bytes == NULL || *bytes == 0) {
+        return 4 + block_length;
+    }
+
+    f->bw.buffer = output;
+    f->bw.len = *bytes;
+    f->bw.pos = 0;
+
+    while(f->bw.pos < f->bw.len && r) {
+        technicallyflac_bitwriter_flush(&f->bw);
+
+        switch(f->md_state.state) {
+            case TECHNICALLYFLAC_METADATA_START: {
+                technicallyflac_bitwriter_init(&f->bw);
+                f->md_state.state = TECHNICALLYFLAC_METADATA_LAST_FLAG;
+                f->md_state.pos = 0;
+                break;
+            }
+            case TECHNICALLYFLAC_METADATA_LAST_FLAG: {
+                if(technicallyflac_bitwriter_add(&f->bw,1,last_flag)) {
+                    f->md_state.state = TECHNICALLYFLAC_METADATA_BLOCK_TYPE;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_METADATA_BLOCK_TYPE: {
+                if(technicallyflac_bitwriter_add(&f->bw,7,block_type)) {
+                    f->md_state.state = TECHNICALLYFLAC_METADATA_BLOCK_LENGTH;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_METADATA_BLOCK_LENGTH: {
+                if(technicallyflac_bitwriter_add(&f->bw,24,block_length)) {
+                    f->md_state.state = block_length ? TECHNICALLYFLAC_METADATA_METADATA : TECHNICALLYFLAC_METADATA_END;
+                }
+                break;
+            }
+            case TECHNICALLYFLAC_METADATA_METADATA: {
+                if(f->bw.bits == 0) {
+                    /* byte-aligned, so the block can be copied (or read) as-is */
+                    n = block_length - f->md_state.pos;
+                    if(n > f->bw.len - f->bw.pos) n = f->bw.len - f->bw.pos;
+                    if(reader != NULL) {
+                        if(n == 0) break;
+                        n = reader(&f->bw.buffer[f->bw.pos],n,userdata);
+                        if(n == 0) {
+                            /* the source ended early, start over on the next block */
+                            f->md_state.state = TECHNICALLYFLAC_METADATA_START;
+                            return -1;
+                        }
+                        f->bw.pos += n;
+                        f->md_state.pos += n;
+                    }
+                    else {
+                        technicallyflac_copy(f->cpu,&f->bw.buffer[f->bw.pos],&block[f->md_state.pos],n);
+                        f->bw.pos += n;
+                        f->md_state.pos += n;
+                    }
+                    if(f->md_state.pos == block_length) {
+                        /* nothing left in the bitwriter, the block is done */
+                        r = 0;
+                        f->md_state.state = TECHNICALLYFLAC_METADATA_START;
+                    }
+                }
+                else if(reader == NULL && technicallyflac_bitwriter_add(&f->bw,8,block[f->md_state.pos])) {
+                    f->md_state.pos++;
+                    if(f->md_state.pos == block_length) {
+                        f->md_state.state = TECHNICALLYFLAC_METADATA_END;
+                    }
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_MIN_BLOCK_SIZE: {
-                if(technicallyflac_bitwriter_add(&f->bw,16,f->blocksize)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MAX_BLOCK_SIZE;
-                }
-                break;
+            case TECHNICALLYFLAC_METADATA_END: {
+                if(f->bw.bits == 0) {
+                    r = 0;
+                    f->md_state.state = TECHNICALLYFLAC_METADATA_START;
+                }
+            }
+        }
+    }
+
+    assert(f->bw.pos > 0);
+    *bytes = f->bw.pos;
+    return r;
+}
+
+int technicallyflac_metadata(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag, uint8_t block_type, uint32_t block_length, uint8_t *block) {
+    return technicallyflac_metadata_block(f,output,bytes,last_flag,block_type,block_length,block,NULL,NULL);
+}
+
+int technicallyflac_metadata_read(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag, uint8_t block_type, uint32_t block_length, technicallyflac_read_func reader, void *userdata) {
+    if(reader == NULL) return -1;
+    return technicallyflac_metadata_block(f,output,bytes,last_flag,block_type,block_length,NULL,reader,userdata);
+}
+
+int technicallyflac_metadata_header(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag, uint8_t block_type, uint32_t block_length) {
+    (void)f;
+
+    if(output == NULL || bytes == NULL || *bytes < 4 || block_length > 0xFFFFFF) {
+        return -1;
+    }
+
+    output[0] = (uint8_t)((last_flag << 7) | (block_type & 0x7F));
+    output[1] = (uint8_t)(block_length >> 16);
+    output[2] = (uint8_t)(block_length >>  8);
+    output[3] = (uint8_t)(block_length      );
+    *bytes = 4;
+    return 0;
+}
+
+int technicallyflac_metadata_iov(technicallyflac *f, uint8_t *header, technicallyflac_iovec *iov, uint8_t last_flag, uint8_t block_type, uint32_t block_length, uint8_t *block) {
+    uint32_t len = 4;
+
+    if(iov == NULL || technicallyflac_metadata_header(f,header,&len,last_flag,block_type,block_length) != 0) {
+        return -1;
+    }
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = len;
+    if(block_length == 0) return 1;
+
+    iov[1].iov_base = block;
+    iov[1].iov_len = block_length;
+    return 2;
+}
+
+#define TECHNICALLYFLAC_INPUT_LOOP(expr) \
+    for(i=0;i<count;i++) { \
+        dst[i] = (expr); \
+        p += in->stride; \
+    }
+
+/* returns count samples of a channel starting at start, planar input is
+ * returned directly, interleaved input is converted into dst */
+static const int32_t *technicallyflac_input_read(const technicallyflac_input *in, uint8_t channel, uint32_t start, uint32_t count, int32_t *dst) {
+    const uint8_t *p;
+    uint32_t i;
+
+    if(in->planar != NULL) {
+        return &in->planar[channel][start];
+    }
+
+    p = &in->interleaved[(start * in->stride) + (channel * in->samplesize)];
+
+    switch(in->format) {
+        case TECHNICALLYFLAC_FORMAT_S16LE: {
+            TECHNICALLYFLAC_INPUT_LOOP((int16_t)((uint16_t)p[0] | ((uint16_t)p[1] << 8)))
+            break;
+        }
+        case TECHNICALLYFLAC_FORMAT_S16BE: {
+            TECHNICALLYFLAC_INPUT_LOOP((int16_t)((uint16_t)p[1] | ((uint16_t)p[0] << 8)))
+            break;
+        }
+        case TECHNICALLYFLAC_FORMAT_S24LE: {
+            TECHNICALLYFLAC_INPUT_LOOP((int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8)
+            break;
+        }
+        case TECHNICALLYFLAC_FORMAT_S24BE: {
+            TECHNICALLYFLAC_INPUT_LOOP((int32_t)(((uint32_t)p[2] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[0] << 24)) >> 8)
+            break;
+        }
+        case TECHNICALLYFLAC_FORMAT_S32LE: {
+            TECHNICALLYFLAC_INPUT_LOOP((int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24)))
+            break;
+        }
+        case TECHNICALLYFLAC_FORMAT_S32BE: {
+            TECHNICALLYFLAC_INPUT_LOOP((int32_t)((uint32_t)p[3] | ((uint32_t)p[2] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[0] << 24)))
+            break;
+        }
+    }
+
+    return dst;
+}
+
+#undef TECHNICALLYFLAC_INPUT_LOOP
+
+static void technicallyflac_input_interleaved(const technicallyflac *f, technicallyflac_input *in, const void *samples, enum TECHNICALLYFLAC_FORMAT format) {
+    in->planar = NULL;
+    in->interleaved = (const uint8_t *)samples;
+    in->format = format;
+
+    switch(format) {
+        case TECHNICALLYFLAC_FORMAT_S16LE: /* fall-through */
+        case TECHNICALLYFLAC_FORMAT_S16BE: in->samplesize = 2; break;
+        case TECHNICALLYFLAC_FORMAT_S24LE: /* fall-through */
+        case TECHNICALLYFLAC_FORMAT_S24BE: in->samplesize = 3; break;
+        default: in->samplesize = 4;
+    }
+    in->stride = in->samplesize * f->fr_state.subframe.channels;
+}
+
+static int32_t technicallyflac_input_sample(const technicallyflac_input *in, uint8_t channel, uint32_t index) {
+    int32_t sample;
+    return *technicallyflac_input_read(in,channel,index,1,&sample);
+}
+
+/* adds num_frames of audio to the MD5 as interleaved, little-endian,
+ * (bitdepth+7)/8-byte samples - the layout the spec hashes */
+static void technicallyflac_md5_input(technicallyflac *f, uint32_t num_frames, const technicallyflac_input *in) {
+    int32_t buf[64];
+    uint8_t bytes[64 * 8 * 4];
+    const int32_t *src;
+    uint8_t width = (f->bitdepth + 7) / 8;
+    uint8_t channels = f->fr_state.subframe.channels;
+    uint8_t ch;
+    uint8_t b;
+    uint32_t start;
+    uint32_t count;
+    uint32_t i;
+
+    /* interleaved LE input of the right width is already in that layout */
+    if(in->planar == NULL && in->samplesize == width &&
+      (in->format == TECHNICALLYFLAC_FORMAT_S16LE || in->format == TECHNICALLYFLAC_FORMAT_S24LE || in->format == TECHNICALLYFLAC_FORMAT_S32LE)) {
+        technicallyflac_md5_update(&f->md5,in->interleaved,num_frames * in->stride);
+        return;
+    }
+
+    for(start=0;start<num_frames;start+=count) {
+        count = num_frames - start;
+        if(count > 64) count = 64;
+        for(ch=0;ch<channels;ch++) {
+            src = technicallyflac_input_read(in,ch,start,count,buf);
+            for(i=0;i<count;i++) {
+                for(b=0;b<width;b++) {
+                    bytes[(((i * channels) + ch) * width) + b] = (uint8_t)((uint32_t)src[i] >> (b * 8));
+                }
+            }
+        }
+        technicallyflac_md5_update(&f->md5,bytes,count * channels * width);
+    }
+}
+
+/* called once a frame has been completely written */
+static void technicallyflac_streaminfo_frame(technicallyflac *f, uint32_t num_frames, uint32_t frame_bytes, const technicallyflac_input *in) {
+    technicallyflac_seekpoint *p;
+
+    if(f->seekpoints_used < f->seekpoints_len && f->total_samples >= f->seekpoint_next) {
+        p = &f->seekpoints[f->seekpoints_used++];
+        p->sample = f->total_samples;
+        p->offset = f->stream_bytes;
+        p->samples = (uint16_t)num_frames;
+        f->seekpoint_next = ((f->total_samples / f->seekpoint_spacing) + 1) * f->seekpoint_spacing;
+    }
+
+    f->stream_bytes += frame_bytes;
+    f->total_samples += num_frames;
+    if(f->min_blocksize == 0 || num_frames < f->min_blocksize) f->min_blocksize = num_frames;
+    if(num_frames > f->max_blocksize) f->max_blocksize = num_frames;
+    if(f->min_framesize == 0 || frame_bytes < f->min_framesize) f->min_framesize = frame_bytes;
+    if(frame_bytes > f->max_framesize) f->max_framesize = frame_bytes;
+    if(f->flags & TECHNICALLYFLAC_FLAG_MD5) {
+        technicallyflac_md5_input(f,num_frames,in);
+    }
+}
+
+/* all zeroes means "not computed" */
+static void technicallyflac_streaminfo_md5(const technicallyflac *f, uint8_t *digest) {
+    uint8_t i;
+
+    if((f->flags & TECHNICALLYFLAC_FLAG_MD5) && f->total_samples > 0) {
+        technicallyflac_md5_final(&f->md5,digest);
+        return;
+    }
+    for(i=0;i<16;i++) {
+        digest[i] = 0;
+    }
+}
+
+/* encodes a frame number into 1-6 bytes or a 36-bit sample number into 1-7
+ * bytes, returns the number of bytes */
+static uint8_t technicallyflac_utf8_encode(uint64_t val, uint8_t *out) {
+    if(val < ((uint32_t)1<<7)) {
+        out[0] = (uint8_t)val;
+        return 1;
+    }
+    if(val < ((uint32_t)1<<11)) {
+        out[0] = 0xC0 | ((val >> 6 ) & 0x1F);
+        out[1] = 0x80 | ((val      ) & 0x3F);
+        return 2;
+    }
+    if(val < ((uint32_t)1<<16)) {
+        out[0] = 0xE0 | ((val >> 12) & 0x0F);
+        out[1] = 0x80 | ((val >> 6 ) & 0x3F);
+        out[2] = 0x80 | ((val      ) & 0x3F);
+        return 3;
+    }
+    if(val < ((uint32_t)1 << 21)) {
+        out[0] = 0xF0 | ((val >> 18) & 0x07);
+        out[1] = 0x80 | ((val >> 12) & 0x3F);
+        out[2] = 0x80 | ((val >>  6) & 0x3F);
+        out[3] = 0x80 | ((val      ) & 0x3F);
+        return 4;
+    }
+    if(val < ((uint32_t)1 << 26)) {
+        out[0] = 0xF8 | ((val >> 24) & 0x03);
+        out[1] = 0x80 | ((val >> 18) & 0x3F);
+        out[2] = 0x80 | ((val >> 12) & 0x3F);
+        out[3] = 0x80 | ((val >>  6) & 0x3F);
+        out[4] = 0x80 | ((val      ) & 0x3F);
+        return 5;
+    }
+    if(val < ((uint32_t)1 << 31)) {
+        out[0] = 0xFC | ((val >> 30) & 0x01);
+        out[1] = 0x80 | ((val >> 24) & 0x3F);
+        out[2] = 0x80 | ((val >> 18) & 0x3F);
+        out[3] = 0x80 | ((val >> 12) & 0x3F);
+        out[4] = 0x80 | ((val >>  6) & 0x3F);
+        out[5] = 0x80 | ((val      ) & 0x3F);
+        return 6;
+    }
+    out[0] = 0xFE;
+    out[1] = 0x80 | ((val >> 30) & 0x3F);
+    out[2] = 0x80 | ((val >> 24) & 0x3F);
+    out[3] = 0x80 | ((val >> 18) & 0x3F);
+    out[4] = 0x80 | ((val >> 12) & 0x3F);
+    out[5] = 0x80 | ((val >>  6) & 0x3F);
+    out[6] = 0x80 | ((val      ) & 0x3F);
+    return 7;
+}
+
+/* returns the number for the next frame header, the frame number or with
+ * TECHNICALLYFLAC_FLAG_VARIABLE the sample number. Both are kept going */
+static uint64_t technicallyflac_frameindex_next(technicallyflac *f, uint32_t num_frames) {
+    uint32_t frameindex = f->frameindex++;
+    uint64_t sampleindex = f->sampleindex;
+
+    if(f->frameindex > 0x7FFFFFFF) {
+        f->frameindex -= 0x80000000;
+    }
+    f->sampleindex = (f->sampleindex + num_frames) & 0xFFFFFFFFF;
+
+    if(f->flags & TECHNICALLYFLAC_FLAG_VARIABLE) {
+        return sampleindex;
+    }
+    return frameindex;
+}
+
+/* side channels are stored with an extra bit */
+static uint8_t technicallyflac_subframe_side(const technicallyflac *f, uint8_t channel) {
+    return (f->channels ==  9 && channel == 1) ||
+           (f->channels == 10 && channel == 0) ||
+           (f->channels == 11 && channel == 1);
+}
+
+/* the subframe helpers below all leave out the wasted bits of the
+ * subframe being written */
+static uint8_t technicallyflac_subframe_bits(const technicallyflac *f, uint8_t channel) {
+    return f->bitdepth + technicallyflac_subframe_side(f,channel) - f->fr_state.subframe.wasted;
+}
+
+/* returns a single sample of a subframe */
+static int64_t technicallyflac_subframe_sample(const technicallyflac *f, uint8_t channel, uint32_t index, const technicallyflac_input *in) {
+    int32_t left;
+    int32_t right;
+    int64_t sample;
+
+    if(f->channels < 9) {
+        sample = technicallyflac_input_sample(in,channel,index);
+    } else {
+        left = technicallyflac_input_sample(in,0,index);
+        right = technicallyflac_input_sample(in,1,index);
+
+        if(technicallyflac_subframe_side(f,channel)) {
+            sample = (int64_t)left - (int64_t)right;
+        } else if(f->channels == 11) {
+            sample = (left >> 1) + (right >> 1) + (left & right & 1);
+        } else {
+            sample = channel == 0 ? left : right;
+        }
+    }
+    return sample >> f->fr_state.subframe.wasted;
+}
+
+/* reads count samples of a subframe into c->s32 or c->s64 */
+static void technicallyflac_subframe_read(const technicallyflac *f, technicallyflac_chunk *c, uint8_t channel, uint32_t start, uint32_t count, const technicallyflac_input *in) {
+    const int32_t *left;
+    const int32_t *right;
+    uint8_t wasted = f->fr_state.subframe.wasted;
+
+    c->s32 = NULL;
+    c->s64 = NULL;
+
+    if(f->channels < 9 || (f->channels == 9 && channel == 0) || (f->channels == 10 && channel == 1)) {
+        c->s32 = technicallyflac_input_read(in,channel,start,count,c->lbuf);
+        if(wasted) {
+            /* planar input is the caller's, shift into lbuf */
+            technicallyflac_shift_int32_t(c->s32,c->lbuf,count,wasted);
+            c->s32 = c->lbuf;
+        }
+        return;
+    }
+
+    left = technicallyflac_input_read(in,0,start,count,c->lbuf);
+    right = technicallyflac_input_read(in,1,start,count,c->rbuf);
+
+    if(technicallyflac_subframe_side(f,channel)) {
+        technicallyflac_stereo_side(left,right,c->sbuf,count);
+        if(wasted) technicallyflac_shift_int64_t(c->sbuf,c->sbuf,count,wasted);
+        c->s64 = c->sbuf;
+    } else {
+        technicallyflac_stereo_mid(left,right,c->mbuf,count);
+        if(wasted) technicallyflac_shift_int32_t(c->mbuf,c->mbuf,count,wasted);
+        c->s32 = c->mbuf;
+    }
+}
+
+/* counts the low bits that are zero in every sample of the subframe, call
+ * with wasted set to 0. Stops early once an odd sample turns up */
+static uint8_t technicallyflac_subframe_wasted(const technicallyflac *f, uint8_t channel, uint32_t num_frames, const technicallyflac_input *in) {
+    technicallyflac_chunk c;
+    uint32_t start;
+    uint32_t count;
+    uint32_t i;
+    uint64_t acc = 0;
+    uint8_t bits;
+    uint8_t wasted = 0;
+
+    if(!(f->flags & TECHNICALLYFLAC_FLAG_WASTED)) {
+        return 0;
+    }
+
+    for(start=0;start<num_frames && !(acc & 1);start+=count) {
+        count = num_frames - start;
+        if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+        technicallyflac_subframe_read(f,&c,channel,start,count,in);
+        if(c.s64 != NULL) {
+            for(i=0;i<count;i++) {
+                acc |= (uint64_t)c.s64[i];
+            }
+        } else {
+            for(i=0;i<count;i++) {
+                acc |= (uint32_t)c.s32[i];
+            }
+        }
+    }
+
+    /* a subframe needs at least 1 bit per sample, this is also where an
+     * all-zero subframe ends up */
+    bits = technicallyflac_subframe_bits(f,channel);
+    while(wasted < bits - 1 && !(acc & 1)) {
+        acc >>= 1;
+        wasted++;
+    }
+    return wasted;
+}
+
+/* picks the rice parameter with the smallest estimate for a partition of
+ * count residuals summing to sum. The estimate is an upper bound since
+ * sum(u >> k) <= sum >> k */
+static uint8_t technicallyflac_rice_param(uint64_t sum, uint32_t count) {
+    uint8_t k = 0;
+    uint8_t c = 0;
+    uint8_t step;
+
+    /* start a bit under log2(sum / count), then step up */
+    for(step=32;step;step>>=1) {
+        if(sum >> (k + step)) k += step;
+    }
+    for(step=16;step;step>>=1) {
+        if(count >> (c + step)) c += step;
+    }
+    k = k > c + 1 ? k - c - 2 : 0;
+    while(k < 30 && (sum >> k) - (sum >> (k + 1)) > count) {
+        k++;
+    }
+    return k;
+}
+
+/* runs every FIXED predictor over the subframe in one pass, collecting the
+ * residual sums per partition at the finest partition order. Coarser orders
+ * are found by adding neighbouring partitions. The best predictor order,
+ * partition order and rice parameters are left in the workspace, returns
+ * the estimated subframe size in bits. */
+static uint64_t technicallyflac_fixed_analyze(const technicallyflac *f, uint8_t channel, uint32_t num_frames, const technicallyflac_input *in) {
+    technicallyflac_fixed *ws = (technicallyflac_fixed *)f->workspace;
+    technicallyflac_chunk c;
+    uint8_t params[1 << TECHNICALLYFLAC_MAX_PARTITION_ORDER];
+    uint64_t mag[TECHNICALLYFLAC_MAX_FIXED_ORDER + 1];
+    uint64_t sum;
+    int64_t d0, d1, d2, d3, d4;
+    int64_t p0 = 0, p1 = 0, p2 = 0, p3 = 0;
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+    uint64_t m0 = 0, m1 = 0, m2 = 0, m3 = 0, m4 = 0;
+    uint64_t best = (uint64_t)-1;
+    uint64_t total;
+    uint32_t start;
+    uint32_t count;
+    uint32_t psize;
+    uint32_t part;
+    uint32_t partend;
+    uint32_t n;
+    uint32_t i;
+    uint32_t j;
+    uint8_t bits;
+    uint8_t maxorder;
+    uint8_t maxporder;
+    uint8_t order;
+    uint8_t porder;
+    uint8_t maxk;
+    uint8_t o;
+
+    bits = technicallyflac_subframe_bits(f,channel);
+    maxorder = num_frames > TECHNICALLYFLAC_MAX_FIXED_ORDER ? TECHNICALLYFLAC_MAX_FIXED_ORDER : (uint8_t)(num_frames - 1);
+
+    /* partitions need more samples than the predictor order */
+    maxporder = 0;
+    while(maxporder < TECHNICALLYFLAC_MAX_PARTITION_ORDER &&
+          num_frames % (2u << maxporder) == 0 &&
+          (num_frames >> (maxporder + 1)) > maxorder) {
+        maxporder++;
+    }
+    psize = num_frames >> maxporder;
+
+    /* everything is kept in locals, the residuals of each order depend on
+     * the last ones so this can't be vectorized, but it can stay in registers */
+    part = 0;
+    partend = psize;
+    for(start=0;start<num_frames;start+=count) {
+        count = num_frames - start;
+        if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+        technicallyflac_subframe_read(f,&c,channel,start,count,in);
+        for(i=0;i<count;i++) {
+            /* the order-n residual is the difference of the order n-1 residuals */
+            d0 = c.s64 != NULL ? c.s64[i] : c.s32[i];
+            d1 = d0 - p0;
+            d2 = d1 - p1;
+            d3 = d2 - p2;
+            d4 = d3 - p3;
+            p0 = d0;
+            p1 = d1;
+            p2 = d2;
+            p3 = d3;
+
+            /* warmup samples aren't predicted */
+            if(start + i < TECHNICALLYFLAC_MAX_FIXED_ORDER) {
+                if(start + i < 1) d1 = 0;
+                if(start + i < 2) d2 = 0;
+                if(start + i < 3) d3 = 0;
+                d4 = 0;
+            }
+
+            s0 += ((uint64_t)d0 << 1) ^ (uint64_t)(d0 >> 63);
+            s1 += ((uint64_t)d1 << 1) ^ (uint64_t)(d1 >> 63);
+            s2 += ((uint64_t)d2 << 1) ^ (uint64_t)(d2 >> 63);
+            s3 += ((uint64_t)d3 << 1) ^ (uint64_t)(d3 >> 63);
+            s4 += ((uint64_t)d4 << 1) ^ (uint64_t)(d4 >> 63);
+            m0 |= (uint64_t)(d0 ^ (d0 >> 63));
+            m1 |= (uint64_t)(d1 ^ (d1 >> 63));
+            m2 |= (uint64_t)(d2 ^ (d2 >> 63));
+            m3 |= (uint64_t)(d3 ^ (d3 >> 63));
+            m4 |= (uint64_t)(d4 ^ (d4 >> 63));
+
+            if(start + i + 1 == partend) {
+                ws->sums[0][part] = s0;
+                ws->sums[1][part] = s1;
+                ws->sums[2][part] = s2;
+                ws->sums[3][part] = s3;
+                ws->sums[4][part] = s4;
+                s0 = s1 = s2 = s3 = s4 = 0;
+                part++;
+                partend += psize;
+            }
+        }
+    }
+
+    mag[0] = m0;
+    mag[1] = m1;
+    mag[2] = m2;
+    mag[3] = m3;
+    mag[4] = m4;
+
+    /* pick the predictor order on the unpartitioned estimate like libFLAC
+     * does, then only search partition orders for that one */
+    order = TECHNICALLYFLAC_MAX_FIXED_ORDER + 1;
+    for(o=0;o<=maxorder;o++) {
+        /* residuals have to fit in 32 bits */
+        if(mag[o] > 0x7FFFFFFF) continue;
+
+        sum = 0;
+        for(j=0;j < (1u << maxporder);j++) {
+            sum += ws->sums[o][j];
+        }
+        maxk = technicallyflac_rice_param(sum,num_frames - o);
+        total = (uint64_t)o * bits + (uint64_t)(num_frames - o) * (maxk + 1) + (sum >> maxk);
+        if(total < best) {
+            best = total;
+            order = o;
+        }
+    }
+    if(order > TECHNICALLYFLAC_MAX_FIXED_ORDER) {
+        return (uint64_t)-1;
+    }
+
+    best = (uint64_t)-1;
+    for(porder=maxporder;;porder--) {
+        n = num_frames >> porder;
+        total = 8 + (uint64_t)order * bits + 6;
+        maxk = 0;
+        for(j=0;j < (1u << porder);j++) {
+            count = j == 0 ? n - order : n;
+            params[j] = technicallyflac_rice_param(ws->sums[order][j],count);
+            if(params[j] > maxk) maxk = params[j];
+            total += (uint64_t)count * (params[j] + 1) + (ws->sums[order][j] >> params[j]);
+        }
+        total += (uint64_t)(maxk > 14 ? 5 : 4) << porder;
+
+        if(total < best) {
+            best = total;
+            ws->order = order;
+            ws->porder = porder;
+            ws->parambits = maxk > 14 ? 5 : 4;
+            for(j=0;j < (1u << porder);j++) {
+                ws->params[j] = params[j];
+            }
+        }
+
+        if(porder == 0) break;
+        for(j=0;j < (1u << (porder - 1));j++) {
+            ws->sums[order][j] = ws->sums[order][j*2] + ws->sums[order][j*2+1];
+        }
+    }
+
+    return best;
+}
+
+/* stores the residuals of the chosen predictor order in the workspace */
+static void technicallyflac_fixed_residuals(const technicallyflac *f, uint8_t channel, uint32_t num_frames, const technicallyflac_input *in) {
+    technicallyflac_fixed *ws = (technicallyflac_fixed *)f->workspace;
+    int32_t *residuals = (int32_t *)(ws + 1);
+    technicallyflac_chunk c;
+    int64_t d[TECHNICALLYFLAC_MAX_FIXED_ORDER + 1];
+    int64_t prev[TECHNICALLYFLAC_MAX_FIXED_ORDER];
+    uint32_t start;
+    uint32_t count;
+    uint32_t i;
+    uint8_t o;
+
+    for(o=0;o<TECHNICALLYFLAC_MAX_FIXED_ORDER;o++) {
+        prev[o] = 0;
+    }
+
+    for(start=0;start<num_frames;start+=count) {
+        count = num_frames - start;
+        if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+        technicallyflac_subframe_read(f,&c,channel,start,count,in);
+        for(i=0;i<count;i++) {
+            d[0] = c.s64 != NULL ? c.s64[i] : c.s32[i];
+            for(o=1;o<=ws->order;o++) {
+                d[o] = d[o-1] - prev[o-1];
+                prev[o-1] = d[o-1];
+            }
+            residuals[start + i] = (int32_t)d[ws->order];
+        }
+    }
+}
+
+/* checks if every sample of the subframe is the same */
+static int technicallyflac_subframe_constant(const technicallyflac *f, uint8_t channel, uint32_t num_frames, const technicallyflac_input *in) {
+    technicallyflac_chunk c;
+    uint32_t start;
+    uint32_t count;
+    uint32_t i;
+    int64_t first;
+    uint64_t diff = 0;
+
+    first = technicallyflac_subframe_sample(f,channel,0,in);
+    for(start=0;start<num_frames && diff == 0;start+=count) {
+        count = num_frames - start;
+        if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+        technicallyflac_subframe_read(f,&c,channel,start,count,in);
+        if(c.s64 != NULL) {
+            for(i=0;i<count;i++) {
+                diff |= (uint64_t)(c.s64[i] ^ first);
+            }
+        } else {
+            for(i=0;i<count;i++) {
+                diff |= (uint32_t)(c.s32[i] ^ (int32_t)first);
+            }
+        }
+    }
+
+    return diff == 0;
+}
+
+/* picks the subframe type: CONSTANT if enabled and every sample matches,
+ * FIXED if enabled and smaller than verbatim, otherwise VERBATIM */
+static uint8_t technicallyflac_subframe_type(const technicallyflac *f, uint8_t channel, uint32_t num_frames, const technicallyflac_input *in) {
+    const technicallyflac_fixed *ws = (const technicallyflac_fixed *)f->workspace;
+
+    if((f->flags & TECHNICALLYFLAC_FLAG_CONSTANT) &&
+       technicallyflac_subframe_constant(f,channel,num_frames,in)) {
+        return TECHNICALLYFLAC_TYPE_CONSTANT;
+    }
+
+    if((f->flags & TECHNICALLYFLAC_FLAG_FIXED) &&
+       technicallyflac_fixed_analyze(f,channel,num_frames,in) < 8 + (uint64_t)num_frames * technicallyflac_subframe_bits(f,channel)) {
+        technicallyflac_fixed_residuals(f,channel,num_frames,in);
+        return TECHNICALLYFLAC_TYPE_FIXED | ws->order;
+    }
+
+    return TECHNICALLYFLAC_TYPE_VERBATIM;
+}
+
+static int technicallyflac_subframe_verbatim(technicallyflac *f, uint32_t num_frames, const technicallyflac_input *in) {
+    int r = 1;
+    uint8_t channel = f->fr_state.subframe.channel;
+    uint8_t bits = technicallyflac_subframe_bits(f,channel);
+
+    while(f->bw.pos < f->bw.len && r) {
+        technicallyflac_bitwriter_flush(&f->bw);
+        if(technicallyflac_bitwriter_add(&f->bw,bits,technicallyflac_subframe_sample(f,channel,f->fr_state.subframe.frame,in))) {
+            f->fr_state.subframe.frame++;
+            if(f->fr_state.subframe.frame == num_frames) {
+                r = 0;
+            }
+        }
+    }
+    return r;
+}
+
+/* writes rice codes until the end of the current partition. Long unary
+ * runs are split up so no single write is over 56 bits */
+static int technicallyflac_subframe_residual(technicallyflac *f) {
+    int r = 1;
+    const technicallyflac_fixed *ws = (const technicallyflac_fixed *)f->workspace;
+    const int32_t *residuals = (const int32_t *)(ws + 1);
+    uint8_t k = ws->params[f->fr_state.subframe.partition];
+    uint32_t mask = ((uint32_t)1 << k) - 1;
+    uint32_t u;
+    uint32_t q;
+
+    while(f->bw.pos < f->bw.len && r) {
+        technicallyflac_bitwriter_flush(&f->bw);
+        u = technicallyflac_zigzag(residuals[f->fr_state.subframe.frame]);
+        q = (u >> k) - f->fr_state.subframe.zeros;
+        if(q > 24) {
+            if(technicallyflac_bitwriter_add(&f->bw,24,0)) {
+                f->fr_state.subframe.zeros += 24;
             }
-            case TECHNICALLYFLAC_STREAMINFO_MAX_BLOCK_SIZE: {
-                if(technicallyflac_bitwriter_add(&f->bw,16,f->blocksize)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MIN_FRAME_SIZE;
-                }
-                break;
+        } else if(technicallyflac_bitwriter_add(&f->bw,(uint8_t)(q + 1 + k),(u & mask) | (mask + 1))) {
+            f->fr_state.subframe.zeros = 0;
+            f->fr_state.subframe.frame++;
+            if(f->fr_state.subframe.frame == f->fr_state.subframe.partend) {
+                r = 0;
             }
-            case TECHNICALLYFLAC_STREAMINFO_MIN_FRAME_SIZE: {
-                if(technicallyflac_bitwriter_add(&f->bw,24,0)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MAX_FRAME_SIZE;
-                }
+        }
+    }
+    return r;
+}
+
+static int technicallyflac_subframe(technicallyflac *f, uint32_t num_frames, const technicallyflac_input *in) {
+    int r = 1;
+    const technicallyflac_fixed *ws = (const technicallyflac_fixed *)f->workspace;
+
+    while(f->bw.pos < f->bw.len && r) {
+        technicallyflac_bitwriter_flush(&f->bw);
+        switch(f->fr_state.subframe.state) {
+            case TECHNICALLYFLAC_SUBFRAME_START: {
+                f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_PAD;
+                f->fr_state.subframe.frame = 0;
+                f->fr_state.subframe.wasted = 0;
+                f->fr_state.subframe.wasted = technicallyflac_subframe_wasted(f,f->fr_state.subframe.channel,num_frames,in);
+                f->fr_state.subframe.type = technicallyflac_subframe_type(f,f->fr_state.subframe.channel,num_frames,in);
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_MAX_FRAME_SIZE: {
-                if(technicallyflac_bitwriter_add(&f->bw,24,0)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_SAMPLE_RATE;
+            case TECHNICALLYFLAC_SUBFRAME_PAD: {
+                if(technicallyflac_bitwriter_add(&f->bw,1,0)) {
+                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_TYPE;
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_SAMPLE_RATE: {
-                if(technicallyflac_bitwriter_add(&f->bw,20,f->samplerate)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_CHANNELS;
+            case TECHNICALLYFLAC_SUBFRAME_TYPE: {
+                if(technicallyflac_bitwriter_add(&f->bw,6,f->fr_state.subframe.type)) {
+                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_WASTED;
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_CHANNELS: {
-                if(technicallyflac_bitwriter_add(&f->bw,3,f->channels > 8 ? 1 : f->channels - 1)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_BIT_DEPTH;
+            case TECHNICALLYFLAC_SUBFRAME_WASTED: {
+                /* flag, then the count in unary (count-1 zeros and a 1) */
+                if(technicallyflac_bitwriter_add(&f->bw,f->fr_state.subframe.wasted + 1,
+                     f->fr_state.subframe.wasted ? ((uint64_t)1 << f->fr_state.subframe.wasted) | 1 : 0)) {
+                    if(f->fr_state.subframe.type == TECHNICALLYFLAC_TYPE_CONSTANT) {
+                        f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_CONSTANT;
+                    } else if(f->fr_state.subframe.type == TECHNICALLYFLAC_TYPE_VERBATIM) {
+                        f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_VERBATIM;
+                    } else {
+                        f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_WARMUP;
+                    }
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_BIT_DEPTH: {
-                if(technicallyflac_bitwriter_add(&f->bw,5,f->bitdepth - 1)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_TOTAL_SAMPLES;
+            case TECHNICALLYFLAC_SUBFRAME_CONSTANT: {
+                if(technicallyflac_bitwriter_add(&f->bw,technicallyflac_subframe_bits(f,f->fr_state.subframe.channel),
+                     technicallyflac_subframe_sample(f,f->fr_state.subframe.channel,0,in))) {
+                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_END;
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_TOTAL_SAMPLES: {
-                if(technicallyflac_bitwriter_add(&f->bw,36,0)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MD5_1;
+            case TECHNICALLYFLAC_SUBFRAME_VERBATIM: {
+                if(technicallyflac_subframe_verbatim(f,num_frames,in) == 0) {
+                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_END;
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_MD5_1: {
-                if(technicallyflac_bitwriter_add(&f->bw,32,0)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MD5_2;
+            case TECHNICALLYFLAC_SUBFRAME_WARMUP: {
+                if(f->fr_state.subframe.frame == ws->order) {
+                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_RESIDUAL_CODING;
+                } else if(technicallyflac_bitwriter_add(&f->bw,technicallyflac_subframe_bits(f,f->fr_state.subframe.channel),
+                     technicallyflac_subframe_sample(f,f->fr_state.subframe.channel,f->fr_state.subframe.frame,in))) {
+                    f->fr_state.subframe.frame++;
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_MD5_2: {
-                if(technicallyflac_bitwriter_add(&f->bw,32,0)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MD5_3;
+            case TECHNICALLYFLAC_SUBFRAME_RESIDUAL_CODING: {
+                /* rice coding method (4 or 5-bit parameters), partition order */
+                if(technicallyflac_bitwriter_add(&f->bw,6,((ws->parambits == 5) << 4) | ws->porder)) {
+                    f->fr_state.subframe.partition = 0;
+                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_RICE_PARAM;
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_MD5_3: {
-                if(technicallyflac_bitwriter_add(&f->bw,32,0)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_MD5_4;
+            case TECHNICALLYFLAC_SUBFRAME_RICE_PARAM: {
+                if(technicallyflac_bitwriter_add(&f->bw,ws->parambits,ws->params[f->fr_state.subframe.partition])) {
+                    f->fr_state.subframe.partend = (f->fr_state.subframe.partition + 1) * (num_frames >> ws->porder);
+                    f->fr_state.subframe.zeros = 0;
+                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_RESIDUAL;
                 }
                 break;
             }
-            case TECHNICALLYFLAC_STREAMINFO_MD5_4: {
-                if(technicallyflac_bitwriter_add(&f->bw,32,0)) {
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_END;
+            case TECHNICALLYFLAC_SUBFRAME_RESIDUAL: {
+                if(technicallyflac_subframe_residual(f) == 0) {
+                    f->fr_state.subframe.partition++;
+                    if(f->fr_state.subframe.partition == (1u << ws->porder)) {
+                        f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_END;
+                    } else {
+                        f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_RICE_PARAM;
+                    }
                 }
                 break;
             }
-
-            case TECHNICALLYFLAC_STREAMINFO_END: {
-                if(f->bw.bits == 0) {
+            case TECHNICALLYFLAC_SUBFRAME_END: {
+                f->fr_state.subframe.channel++;
+                f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_START;
+                if(f->fr_state.subframe.channel == f->fr_state.subframe.channels) {
                     r = 0;
-                    f->si_state.state = TECHNICALLYFLAC_STREAMINFO_START;
                 }
-                break;
             }
+        }
+
+    }
+    return r;
+}
+
+static void technicallyflac_subframe_verbatim_fast(technicallyflac *f, technicallyflac_fastwriter *fw, uint8_t channel, uint32_t num_frames, const technicallyflac_input *in) {
+    technicallyflac_chunk c;
+    uint32_t start;
+    uint32_t count;
+    uint8_t bits;
+    uint8_t aligned;
+
+    bits = technicallyflac_subframe_bits(f,channel);
+
+    technicallyflac_fastwriter_flush(fw);
+    aligned = bits % 8 == 0 && fw->bits == 0;
+
+    for(start=0;start<num_frames;start+=count) {
+        count = num_frames - start;
+        if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+        technicallyflac_subframe_read(f,&c,channel,start,count,in);
 
+        if(c.s64 != NULL) {
+            technicallyflac_pack_bits_int64_t(fw,c.s64,count,bits);
+        } else if(aligned) {
+            /* everything is byte-aligned, samples are stored directly and the
+             * CRC runs over each chunk while it's still in cache */
+            technicallyflac_pack_be(f->cpu,&fw->buffer[fw->pos],c.s32,count,bits / 8);
+            fw->pos += count * (bits / 8);
+            technicallyflac_fastwriter_crc(fw,f->cpu);
+        } else {
+            technicallyflac_pack_bits_int32_t(fw,c.s32,count,bits);
         }
     }
+}
 
-    assert(f->bw.pos > 0);
-    *bytes = f->bw.pos;
-    return r;
+static void technicallyflac_subframe_fixed_fast(technicallyflac *f, technicallyflac_fastwriter *fw, uint8_t channel, uint32_t num_frames, const technicallyflac_input *in) {
+    const technicallyflac_fixed *ws = (const technicallyflac_fixed *)f->workspace;
+    const int32_t *residuals = (const int32_t *)(ws + 1);
+    uint32_t psize;
+    uint32_t start;
+    uint32_t j;
+    uint8_t bits;
+
+    bits = technicallyflac_subframe_bits(f,channel);
+    for(j=0;j<ws->order;j++) {
+        technicallyflac_fastwriter_add(fw,bits,(uint64_t)technicallyflac_subframe_sample(f,channel,j,in));
+    }
+
+    technicallyflac_fastwriter_add(fw,6,((ws->parambits == 5) << 4) | ws->porder);
+    psize = num_frames >> ws->porder;
+    start = ws->order;
+    for(j=0;j < (1u << ws->porder);j++) {
+        technicallyflac_fastwriter_add(fw,ws->parambits,ws->params[j]);
+        technicallyflac_pack_rice(fw,&residuals[start],(j + 1) * psize - start,ws->params[j]);
+        start = (j + 1) * psize;
+    }
 }
 
-int technicallyflac_metadata(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint8_t last_flag, uint8_t block_type, uint32_t block_length, uint8_t *block) {
-    int r = 1;
+/* writes the whole frame header into out, starting from the template, and
+ * returns its length. Only a short last block needs a different block size code */
+static uint8_t technicallyflac_frame_header(const technicallyflac *f, uint64_t frameindex, uint32_t num_frames, uint8_t *out) {
+    uint8_t crc8 = f->header_crc8;
+    uint8_t code = f->header[2] >> 4;
+    uint8_t len;
 
-    if(output == NULL || bytes == NULL || *bytes == 0) {
-        return 4 + block_length;
+    out[0] = f->header[0];
+    out[1] = f->header[1];
+    out[2] = f->header[2];
+    out[3] = f->header[3];
+    if(num_frames != f->blocksize) {
+        code = technicallyflac_blocksize_code(num_frames);
+        out[2] = (uint8_t)((code << 4) | (f->header[2] & 0x0F));
+        crc8 = technicallyflac_crc8(0,out,4);
     }
+    len = 4 + technicallyflac_utf8_encode(frameindex,&out[4]);
 
-    f->bw.buffer = output;
-    f->bw.len = *bytes;
-    f->bw.pos = 0;
+    /* 8 or 16-bit (blocksize-1), 8-bit kHz, 16-bit Hz or 16-bit tens of Hz */
+    if(code == 7) {
+        out[len++] = (uint8_t)((num_frames - 1) >> 8);
+    }
+    if(code == 6 || code == 7) {
+        out[len++] = (uint8_t)((num_frames - 1)     );
+    }
+    if(f->samplerate_header == 13 || f->samplerate_header == 14) {
+        out[len++] = (uint8_t)(f->samplerate_value >> 8);
+    }
+    if(f->samplerate_header >= 12) {
+        out[len++] = (uint8_t)(f->samplerate_value     );
+    }
+    out[len] = technicallyflac_crc8(crc8,&out[4],len - 4);
+    return len + 1;
+}
 
-    while(f->bw.pos < f->bw.len && r) {
-        technicallyflac_bitwriter_flush(&f->bw);
+/* technicallyflac_size_frame_index assumes the 16-bit block size and sample
+ * rate at the end of the header, this takes off what f leaves out */
+static uint32_t technicallyflac_frame_size_at(const technicallyflac *f, uint32_t num_frames, uint64_t frameindex) {
+    uint32_t size = technicallyflac_size_frame_index(num_frames,f->channels,f->bitdepth,frameindex);
+    uint8_t code = f->header[2] >> 4;
 
-        switch(f->md_state.state) {
-            case TECHNICALLYFLAC_METADATA_START: {
-                technicallyflac_bitwriter_init(&f->bw);
-                f->md_state.state = TECHNICALLYFLAC_METADATA_LAST_FLAG;
-                f->md_state.pos = 0;
-                break;
-            }
-            case TECHNICALLYFLAC_METADATA_LAST_FLAG: {
-                if(technicallyflac_bitwriter_add(&f->bw,1,last_flag)) {
-                    f->md_state.state = TECHNICALLYFLAC_METADATA_BLOCK_TYPE;
-                }
-                break;
+    if(num_frames != f->blocksize) {
+        code = technicallyflac_blocksize_code(num_frames);
+    }
+    if(code != 7) size--;
+    if(code != 6 && code != 7) size--;
+    if(f->samplerate_header != 13 && f->samplerate_header != 14) size--;
+    if(f->samplerate_header < 12) size--;
+    return size;
+}
+
+/* size of the next frame */
+static uint32_t technicallyflac_frame_size_max(const technicallyflac *f, uint32_t num_frames) {
+    return technicallyflac_frame_size_at(f,num_frames,
+      (f->flags & TECHNICALLYFLAC_FLAG_VARIABLE) ? f->sampleindex : f->frameindex);
+}
+
+uint64_t technicallyflac_frame_offset(const technicallyflac *f, uint64_t frame_n) {
+    /* frames only differ in the length of their number, which is 1 byte
+     * below the first of these and a byte longer from each one on */
+    static const uint64_t lengths[6] = {
+        (uint64_t)1 << 7, (uint64_t)1 << 11, (uint64_t)1 << 16,
+        (uint64_t)1 << 21, (uint64_t)1 << 26, (uint64_t)1 << 31
+    };
+    uint64_t step = (f->flags & TECHNICALLYFLAC_FLAG_VARIABLE) ? f->blocksize : 1;
+    uint64_t offset = frame_n * technicallyflac_frame_size_at(f,f->blocksize,0);
+    uint64_t first;
+    uint8_t i;
+
+    for(i=0;i<6;i++) {
+        /* the first frame numbered (or starting at a sample) past it */
+        first = (lengths[i] + step - 1) / step;
+        if(frame_n > first) offset += frame_n - first;
+    }
+    return offset;
+}
+
+uint64_t technicallyflac_stream_size(const technicallyflac *f, uint64_t total_samples) {
+    uint64_t frames = total_samples / f->blocksize;
+    uint32_t rest = (uint32_t)(total_samples % f->blocksize);
+    uint64_t size = technicallyflac_frame_offset(f,frames);
+
+    if(rest) {
+        size += technicallyflac_frame_size_at(f,rest,
+          (f->flags & TECHNICALLYFLAC_FLAG_VARIABLE) ? frames * f->blocksize : frames);
+    }
+    return size;
+}
+
+/* writes an entire frame in one go, the output buffer must be able to hold it */
+static uint32_t technicallyflac_frame_fast(technicallyflac *f, uint8_t *output, uint32_t len, uint32_t num_frames, const technicallyflac_input *in) {
+    technicallyflac_fastwriter fw;
+    uint8_t type;
+    uint8_t i;
+
+    /* the header goes straight into the output, the CRC-16 still starts at byte 0 */
+    technicallyflac_fastwriter_init(&fw,output,len);
+    fw.pos = technicallyflac_frame_header(f,technicallyflac_frameindex_next(f,num_frames),num_frames,output);
+
+    for(i=0;i<f->fr_state.subframe.channels;i++) {
+        f->fr_state.subframe.wasted = 0;
+        f->fr_state.subframe.wasted = technicallyflac_subframe_wasted(f,i,num_frames,in);
+        type = technicallyflac_subframe_type(f,i,num_frames,in);
+
+        /* pad, subframe type, wasted bits flag and count */
+        technicallyflac_fastwriter_add(&fw,8,(type << 1) | (f->fr_state.subframe.wasted != 0));
+        if(f->fr_state.subframe.wasted) {
+            technicallyflac_fastwriter_add(&fw,f->fr_state.subframe.wasted,1);
+        }
+        if(type == TECHNICALLYFLAC_TYPE_CONSTANT) {
+            technicallyflac_fastwriter_add(&fw,technicallyflac_subframe_bits(f,i),(uint64_t)technicallyflac_subframe_sample(f,i,0,in));
+        } else if(type & TECHNICALLYFLAC_TYPE_FIXED) {
+            technicallyflac_subframe_fixed_fast(f,&fw,i,num_frames,in);
+        } else {
+            technicallyflac_subframe_verbatim_fast(f,&fw,i,num_frames,in);
+        }
+    }
+
+    technicallyflac_fastwriter_align(&fw);
+    technicallyflac_fastwriter_flush(&fw);
+    technicallyflac_fastwriter_crc(&fw,f->cpu);
+    technicallyflac_fastwriter_add(&fw,16,fw.crc16);
+    technicallyflac_fastwriter_flush(&fw);
+
+    return fw.pos;
+}
+
+/* reads bits MSB-first, val is left-aligned and only the top bits bits are valid */
+struct technicallyflac_bitreader_s {
+    const uint8_t *data;
+    uint32_t len;
+    uint32_t pos;    /* next byte to load into val */
+    uint64_t val;
+    uint8_t bits;
+    uint8_t error;   /* ran out of data */
+};
+
+typedef struct technicallyflac_bitreader_s technicallyflac_bitreader;
+
+/* one subframe being decoded, samples come out a chunk at a time */
+struct technicallyflac_subframe_decoder_s {
+    uint8_t type;
+    uint8_t order;      /* FIXED predictor order */
+    uint8_t bits;       /* bits per sample, without the wasted bits */
+    uint8_t wasted;
+    uint8_t porder;
+    uint8_t parambits;
+    uint8_t param;
+    uint8_t escape;     /* bits per residual in an escaped partition, 0 if not escaped */
+    uint32_t blocksize;
+    uint32_t pos;       /* samples decoded so far */
+    uint32_t partleft;  /* residuals left in the current partition */
+    int64_t constant;
+    int64_t hist[TECHNICALLYFLAC_MAX_FIXED_ORDER];
+};
+
+typedef struct technicallyflac_subframe_decoder_s technicallyflac_subframe_decoder;
+
+static void technicallyflac_bitreader_init(technicallyflac_bitreader *br, const uint8_t *data, uint32_t len) {
+    br->data = data;
+    br->len = len;
+    br->pos = 0;
+    br->val = 0;
+    br->bits = 0;
+    br->error = 0;
+}
+
+static void technicallyflac_bitreader_refill(technicallyflac_bitreader *br) {
+    while(br->bits <= 56 && br->pos < br->len) {
+        br->val |= (uint64_t)br->data[br->pos++] << (56 - br->bits);
+        br->bits += 8;
+    }
+}
+
+/* reads up to 57 bits */
+static uint64_t technicallyflac_bitreader_read(technicallyflac_bitreader *br, uint8_t bits) {
+    uint64_t val;
+
+    if(bits == 0) return 0;
+    if(br->bits < bits) {
+        technicallyflac_bitreader_refill(br);
+        if(br->bits < bits) {
+            br->error = 1;
+            return 0;
+        }
+    }
+    val = br->val >> (64 - bits);
+    br->val <<= bits;
+    br->bits -= bits;
+    return val;
+}
+
+/* reads a two's complement value of up to 57 bits */
+static int64_t technicallyflac_bitreader_read_signed(technicallyflac_bitreader *br, uint8_t bits) {
+    uint64_t sign;
+
+    if(bits == 0) return 0;
+    sign = (uint64_t)1 << (bits - 1);
+    return (int64_t)(technicallyflac_bitreader_read(br,bits) ^ sign) - (int64_t)sign;
+}
+
+static uint8_t technicallyflac_clz64(uint64_t val) {
+#if defined(__GNUC__)
+    return (uint8_t)__builtin_clzll(val);
+#else
+    uint8_t n = 0;
+    while(!(val & 0x8000000000000000ULL)) {
+        val <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* reads a run of 0 bits ended by a 1, returns the number of 0s */
+static uint32_t technicallyflac_bitreader_unary(technicallyflac_bitreader *br) {
+    uint32_t q = 0;
+    uint8_t z;
+
+    for(;;) {
+        if(br->val == 0) {
+            /* every bit held is a 0 (the bits past br->bits are always 0) */
+            q += br->bits;
+            br->bits = 0;
+            technicallyflac_bitreader_refill(br);
+            if(br->bits == 0) {
+                br->error = 1;
+                return 0;
             }
-            case TECHNICALLYFLAC_METADATA_BLOCK_TYPE: {
-                if(technicallyflac_bitwriter_add(&f->bw,7,block_type)) {
-                    f->md_state.state = TECHNICALLYFLAC_METADATA_BLOCK_LENGTH;
-                }
-                break;
+            continue;
+        }
+        z = technicallyflac_clz64(br->val);
+        br->val <<= z;
+        br->val <<= 1;
+        br->bits -= z + 1;
+        return q + z;
+    }
+}
+
+static void technicallyflac_bitreader_align(technicallyflac_bitreader *br) {
+    technicallyflac_bitreader_read(br,br->bits % 8);
+}
+
+/* bytes read so far */
+static uint32_t technicallyflac_bitreader_tell(const technicallyflac_bitreader *br) {
+    return br->pos - (br->bits / 8);
+}
+
+/* same as technicallyflac_subframe_side for a decoded frame */
+static uint8_t technicallyflac_decode_side(const technicallyflac_decoder *d, uint8_t channel) {
+    return (d->frame_channels ==  9 && channel == 1) ||
+           (d->frame_channels == 10 && channel == 0) ||
+           (d->frame_channels == 11 && channel == 1);
+}
+
+/* reads a frame header and checks its CRC-8, returns -1 if it isn't valid */
+static int technicallyflac_decode_frame_header(technicallyflac_decoder *d, technicallyflac_bitreader *br) {
+    uint8_t bscode;
+    uint8_t ratecode;
+    uint8_t sizecode;
+    uint8_t n;
+    uint8_t i;
+    uint64_t c;
+
+    if(technicallyflac_bitreader_read(br,15) != 0x7FFC) return -1;
+    d->frame_variable = (uint8_t)technicallyflac_bitreader_read(br,1);
+    bscode = (uint8_t)technicallyflac_bitreader_read(br,4);
+    ratecode = (uint8_t)technicallyflac_bitreader_read(br,4);
+    d->frame_channels = (uint8_t)technicallyflac_bitreader_read(br,4) + 1;
+    sizecode = (uint8_t)technicallyflac_bitreader_read(br,3);
+    if(technicallyflac_bitreader_read(br,1) != 0) return -1;
+
+    /* frame or sample number, UTF-8 coded */
+    d->frame_number = technicallyflac_bitreader_read(br,8);
+    if(d->frame_number & 0x80) {
+        for(n=0;d->frame_number & (0x80 >> n);n++);
+        if(n == 1 || n > (d->frame_variable ? 7 : 6)) return -1;
+        d->frame_number &= 0x7F >> n;
+        for(i=1;i<n;i++) {
+            c = technicallyflac_bitreader_read(br,8);
+            if((c & 0xC0) != 0x80) return -1;
+            d->frame_number = (d->frame_number << 6) | (c & 0x3F);
+        }
+    }
+
+    switch(bscode) {
+        case 0: return -1;
+        case 1: d->frame_blocksize = 192; break;
+        case 6: d->frame_blocksize = (uint32_t)technicallyflac_bitreader_read(br,8) + 1; break;
+        case 7: d->frame_blocksize = (uint32_t)technicallyflac_bitreader_read(br,16) + 1; break;
+        default: {
+            d->frame_blocksize = bscode < 6 ? 576u << (bscode - 2) : 256u << (bscode - 8);
+        }
+    }
+
+    switch(ratecode) {
+        case 0:  d->frame_samplerate = d->samplerate; break;
+        case 1:  d->frame_samplerate = 88200;  break;
+        case 2:  d->frame_samplerate = 176400; break;
+        case 3:  d->frame_samplerate = 192000; break;
+        case 4:  d->frame_samplerate = 8000;   break;
+        case 5:  d->frame_samplerate = 16000;  break;
+        case 6:  d->frame_samplerate = 22050;  break;
+        case 7:  d->frame_samplerate = 24000;  break;
+        case 8:  d->frame_samplerate = 32000;  break;
+        case 9:  d->frame_samplerate = 44100;  break;
+        case 10: d->frame_samplerate = 48000;  break;
+        case 11: d->frame_samplerate = 96000;  break;
+        case 12: d->frame_samplerate = (uint32_t)technicallyflac_bitreader_read(br,8) * 1000; break;
+        case 13: d->frame_samplerate = (uint32_t)technicallyflac_bitreader_read(br,16); break;
+        case 14: d->frame_samplerate = (uint32_t)technicallyflac_bitreader_read(br,16) * 10; break;
+        default: return -1;
+    }
+
+    switch(sizecode) {
+        case 0: d->frame_bitdepth = d->bitdepth; break;
+        case 1: d->frame_bitdepth = 8;  break;
+        case 2: d->frame_bitdepth = 12; break;
+        case 4: d->frame_bitdepth = 16; break;
+        case 5: d->frame_bitdepth = 20; break;
+        case 6: d->frame_bitdepth = 24; break;
+        case 7: d->frame_bitdepth = 32; break;
+        default: return -1;
+    }
+
+    if(d->frame_channels > 11 || d->frame_bitdepth < 4) return -1;
+
+    n = (uint8_t)technicallyflac_bitreader_read(br,8);
+    if(br->error) return -1;
+    if(technicallyflac_crc8(0,br->data,technicallyflac_bitreader_tell(br) - 1) != n) return -1;
+    return 0;
+}
+
+/* reads a subframe header (and the CONSTANT value), returns -1 on types this can't decode */
+static int technicallyflac_decode_subframe_start(technicallyflac_bitreader *br, technicallyflac_subframe_decoder *sd, uint8_t bits, uint32_t blocksize) {
+    uint8_t type;
+
+    if(technicallyflac_bitreader_read(br,1) != 0) return -1;
+    type = (uint8_t)technicallyflac_bitreader_read(br,6);
+    sd->wasted = 0;
+    if(technicallyflac_bitreader_read(br,1)) {
+        sd->wasted = (uint8_t)(technicallyflac_bitreader_unary(br) + 1);
+        if(sd->wasted >= bits) return -1;
+    }
+    sd->bits = bits - sd->wasted;
+    sd->blocksize = blocksize;
+    sd->pos = 0;
+    sd->order = 0;
+    sd->partleft = 0;
+
+    if(type == TECHNICALLYFLAC_TYPE_CONSTANT || type == TECHNICALLYFLAC_TYPE_VERBATIM) {
+        sd->type = type;
+        if(type == TECHNICALLYFLAC_TYPE_CONSTANT) {
+            sd->constant = technicallyflac_bitreader_read_signed(br,sd->bits);
+        }
+    } else if((type & 0x38) == TECHNICALLYFLAC_TYPE_FIXED && (type & 0x07) <= TECHNICALLYFLAC_MAX_FIXED_ORDER) {
+        sd->type = TECHNICALLYFLAC_TYPE_FIXED;
+        sd->order = type & 0x07;
+        if(sd->order >= blocksize && blocksize > 1) return -1;
+    } else {
+        return -1;
+    }
+    return br->error ? -1 : 0;
+}
+
+/* decodes the next count samples of a subframe into dst, with the wasted bits
+ * put back. returns -1 on bad data (or if it ran out, check br->error) */
+static int technicallyflac_decode_samples(technicallyflac_bitreader *br, technicallyflac_subframe_decoder *sd, int64_t *dst, uint32_t count) {
+    int64_t *h = sd->hist;
+    int64_t r;
+    uint64_t u;
+    uint32_t i;
+
+    switch(sd->type) {
+        case TECHNICALLYFLAC_TYPE_CONSTANT: {
+            for(i=0;i<count;i++) {
+                dst[i] = sd->constant;
             }
-            case TECHNICALLYFLAC_METADATA_BLOCK_LENGTH: {
-                if(technicallyflac_bitwriter_add(&f->bw,24,block_length)) {
-                    f->md_state.state = TECHNICALLYFLAC_METADATA_METADATA;
-                }
-                break;
+            break;
+        }
+        case TECHNICALLYFLAC_TYPE_VERBATIM: {
+            for(i=0;i<count;i++) {
+                dst[i] = technicallyflac_bitreader_read_signed(br,sd->bits);
             }
-            case TECHNICALLYFLAC_METADATA_METADATA: {
-                if(technicallyflac_bitwriter_add(&f->bw,8,block[f->md_state.pos])) {
-                    f->md_state.pos++;
-                    if(f->md_state.pos == block_length) {
-                        f->md_state.state = TECHNICALLYFLAC_METADATA_END;
+            break;
+        }
+        default: {
+            for(i=0;i<count;i++,sd->pos++) {
+                if(sd->pos < sd->order) {
+                    /* warmup samples */
+                    dst[i] = technicallyflac_bitreader_read_signed(br,sd->bits);
+                } else {
+                    if(sd->pos == sd->order) {
+                        /* residual coding method (4 or 5-bit Rice parameters, 2 and 3
+                         * are reserved) and partition order */
+                        sd->parambits = (uint8_t)technicallyflac_bitreader_read(br,2);
+                        if(sd->parambits > 1) return -1;
+                        sd->parambits += 4;
+                        sd->porder = (uint8_t)technicallyflac_bitreader_read(br,4);
+                        if(sd->blocksize % (1u << sd->porder) != 0 || (sd->blocksize >> sd->porder) < sd->order) return -1;
+                    }
+                    if(sd->partleft == 0) {
+                        sd->param = (uint8_t)technicallyflac_bitreader_read(br,sd->parambits);
+                        sd->escape = 0;
+                        if(sd->param == (1u << sd->parambits) - 1) {
+                            sd->escape = (uint8_t)technicallyflac_bitreader_read(br,5);
+                        }
+                        sd->partleft = (sd->blocksize >> sd->porder) - (sd->pos == sd->order ? sd->order : 0);
+                    }
+                    sd->partleft--;
+
+                    if(sd->escape) {
+                        r = technicallyflac_bitreader_read_signed(br,sd->escape);
+                    } else if(sd->param == (1u << sd->parambits) - 1) {
+                        r = 0;
+                    } else {
+                        u = (uint64_t)technicallyflac_bitreader_unary(br) << sd->param;
+                        u |= technicallyflac_bitreader_read(br,sd->param);
+                        r = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+                    }
+
+                    switch(sd->order) {
+                        case 0: dst[i] = r; break;
+                        case 1: dst[i] = r + h[0]; break;
+                        case 2: dst[i] = r + 2 * h[0] - h[1]; break;
+                        case 3: dst[i] = r + 3 * h[0] - 3 * h[1] + h[2]; break;
+                        default: dst[i] = r + 4 * h[0] - 6 * h[1] + 4 * h[2] - h[3]; break;
                     }
                 }
-                break;
-            }
-            case TECHNICALLYFLAC_METADATA_END: {
-                if(f->bw.bits == 0) {
-                    r = 0;
-                    f->md_state.state = TECHNICALLYFLAC_METADATA_START;
-                }
+                h[3] = h[2];
+                h[2] = h[1];
+                h[1] = h[0];
+                h[0] = dst[i];
             }
         }
     }
 
-    assert(f->bw.pos > 0);
-    *bytes = f->bw.pos;
-    return r;
+    if(sd->wasted) {
+        for(i=0;i<count;i++) {
+            dst[i] = (int64_t)((uint64_t)dst[i] << sd->wasted);
+        }
+    }
+    return br->error ? -1 : 0;
 }
 
-static int technicallyflac_subframe_verbatim(technicallyflac *f, uint32_t num_frames, int32_t **frames) {
-    int r = 1;
-    int a = 0;
-    int32_t left;
-    int32_t right;
+/* reads the frame footer, returns -1 if the CRC-16 doesn't match */
+static int technicallyflac_decode_footer(technicallyflac_bitreader *br, uint32_t cpu) {
+    uint16_t crc16;
+    uint32_t end;
 
-    while(f->bw.pos < f->bw.len && r) {
-        technicallyflac_bitwriter_flush(&f->bw);
-        if(f->channels < 9) {
-            a = technicallyflac_bitwriter_add(&f->bw,f->bitdepth,frames[f->fr_state.subframe.channel][f->fr_state.subframe.frame]);
-        } else {
-            left = frames[0][f->fr_state.subframe.frame];
-            right = frames[1][f->fr_state.subframe.frame];
-            if(f->channels == 9) {
-                if(f->fr_state.subframe.channel == 0) {
-                    a = technicallyflac_bitwriter_add(&f->bw,f->bitdepth,left);
-                } else {
-                    a = technicallyflac_bitwriter_add(&f->bw,f->bitdepth+1,left-right);
-                }
-            } else if(f->channels == 10) {
-                if(f->fr_state.subframe.channel == 1) {
-                    a = technicallyflac_bitwriter_add(&f->bw,f->bitdepth,right);
-                } else {
-                    a = technicallyflac_bitwriter_add(&f->bw,f->bitdepth+1,left - right);
+    technicallyflac_bitreader_align(br);
+    end = technicallyflac_bitreader_tell(br);
+    crc16 = (uint16_t)technicallyflac_bitreader_read(br,16);
+    if(br->error) return -1;
+    return technicallyflac_crc16(cpu,0,br->data,end) == crc16 ? 0 : -1;
+}
+
+/* decodes the frame just written by technicallyflac_frame_fast and checks it against
+ * the input, with left and right rebuilt from the stereo modes the way
+ * technicallyflac_decode_frame does it */
+static int technicallyflac_verify_frame(technicallyflac *f, const uint8_t *data, uint32_t len, uint32_t num_frames, const technicallyflac_input *in) {
+    technicallyflac_decoder d;
+    technicallyflac_bitreader br;
+    technicallyflac_bitreader first;
+    technicallyflac_subframe_decoder sd;
+    technicallyflac_subframe_decoder sd2;
+    int64_t buf[TECHNICALLYFLAC_CHUNK];
+    int64_t buf2[TECHNICALLYFLAC_CHUNK];
+    int64_t left;
+    int64_t right;
+    int64_t mid;
+    uint64_t number;
+    uint32_t start;
+    uint32_t count;
+    uint32_t i;
+    uint8_t variable = (f->flags & TECHNICALLYFLAC_FLAG_VARIABLE) != 0;
+    uint8_t ch;
+
+    /* technicallyflac_frameindex_next has already moved on to the next frame */
+    if(variable) {
+        number = (f->sampleindex - num_frames) & 0xFFFFFFFFF;
+    } else {
+        number = (f->frameindex + 0x7FFFFFFF) & 0x7FFFFFFF;
+    }
+
+    d.samplerate = f->samplerate;
+    d.bitdepth = f->bitdepth;
+    technicallyflac_bitreader_init(&br,data,len);
+    if(technicallyflac_decode_frame_header(&d,&br) != 0 ||
+       d.frame_variable != variable || d.frame_number != number ||
+       d.frame_blocksize != num_frames || d.frame_samplerate != f->samplerate ||
+       d.frame_channels != f->channels || d.frame_bitdepth != f->bitdepth) {
+        return -1;
+    }
+
+    if(d.frame_channels < 9) {
+        for(ch=0;ch<d.frame_channels;ch++) {
+            if(technicallyflac_decode_subframe_start(&br,&sd,d.frame_bitdepth,num_frames) != 0) return -1;
+
+            for(start=0;start<num_frames;start+=count) {
+                count = num_frames - start;
+                if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+                if(technicallyflac_decode_samples(&br,&sd,buf,count) != 0) return -1;
+                for(i=0;i<count;i++) {
+                    if(buf[i] != technicallyflac_input_sample(in,ch,start + i)) return -1;
                 }
             }
-            else if(f->channels == 11) {
-                if(f->fr_state.subframe.channel == 0) {
-                    a = technicallyflac_bitwriter_add(&f->bw,f->bitdepth,(left + right) >> 1);
+        }
+    } else {
+        /* left and right need both subframes at once, so the first one is
+         * read through to find where the second starts, then again alongside it */
+        first = br;
+        if(technicallyflac_decode_subframe_start(&br,&sd,d.frame_bitdepth + technicallyflac_decode_side(&d,0),num_frames) != 0) return -1;
+        for(start=0;start<num_frames;start+=count) {
+            count = num_frames - start;
+            if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+            if(technicallyflac_decode_samples(&br,&sd,buf,count) != 0) return -1;
+        }
+
+        if(technicallyflac_decode_subframe_start(&first,&sd,d.frame_bitdepth + technicallyflac_decode_side(&d,0),num_frames) != 0 ||
+           technicallyflac_decode_subframe_start(&br,&sd2,d.frame_bitdepth + technicallyflac_decode_side(&d,1),num_frames) != 0) {
+            return -1;
+        }
+
+        for(start=0;start<num_frames;start+=count) {
+            count = num_frames - start;
+            if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+            if(technicallyflac_decode_samples(&first,&sd,buf,count) != 0 ||
+               technicallyflac_decode_samples(&br,&sd2,buf2,count) != 0) {
+                return -1;
+            }
+
+            for(i=0;i<count;i++) {
+                if(d.frame_channels == 9) {
+                    left = buf[i];
+                    right = buf[i] - buf2[i];
+                } else if(d.frame_channels == 10) {
+                    left = buf[i] + buf2[i];
+                    right = buf2[i];
                 } else {
-                    a = technicallyflac_bitwriter_add(&f->bw,f->bitdepth+1,left - right);
+                    mid = (buf[i] * 2) | (buf2[i] & 1);
+                    left = (mid + buf2[i]) >> 1;
+                    right = (mid - buf2[i]) >> 1;
+                }
+                if(left != technicallyflac_input_sample(in,0,start + i) ||
+                   right != technicallyflac_input_sample(in,1,start + i)) {
+                    return -1;
                 }
             }
         }
-        if(a) {
-            f->fr_state.subframe.frame++;
-            if(f->fr_state.subframe.frame == num_frames) {
-                r = 0;
-            }
+    }
+
+    if(technicallyflac_decode_footer(&br,f->cpu) != 0) return -1;
+    return technicallyflac_bitreader_tell(&br) == len ? 0 : -1;
+}
+
+void technicallyflac_decoder_init(technicallyflac_decoder *d) {
+    uint8_t i;
+
+    d->min_blocksize = 0;
+    d->max_blocksize = 0;
+    d->min_framesize = 0;
+    d->max_framesize = 0;
+    d->samplerate = 0;
+    d->channels = 0;
+    d->bitdepth = 0;
+    d->total_samples = 0;
+    for(i=0;i<16;i++) {
+        d->md5[i] = 0;
+    }
+    d->block_type = 0;
+    d->block_length = 0;
+    d->frame_variable = 0;
+    d->frame_number = 0;
+    d->frame_blocksize = 0;
+    d->frame_samplerate = 0;
+    d->frame_channels = 0;
+    d->frame_bitdepth = 0;
+    d->streammarker = 0;
+    d->cpu = technicallyflac_cpu_detect();
+}
+
+int technicallyflac_decode_metadata(technicallyflac_decoder *d, const uint8_t *data, uint32_t len, uint32_t *used) {
+    technicallyflac_bitreader br;
+    uint32_t pos = 0;
+    uint8_t last;
+    uint8_t i;
+
+    *used = 0;
+    if(!d->streammarker) {
+        if(len < 4) return 1;
+        if(data[0] != 'f' || data[1] != 'L' || data[2] != 'a' || data[3] != 'C') return -1;
+        pos = 4;
+    }
+
+    if(len - pos < 4) return 1;
+    last = data[pos] >> 7;
+    d->block_type = data[pos] & 0x7F;
+    d->block_length = ((uint32_t)data[pos+1] << 16) | ((uint32_t)data[pos+2] << 8) | (uint32_t)data[pos+3];
+    pos += 4;
+    if(len - pos < d->block_length) return 1;
+
+    if(d->block_type == 0) {
+        if(d->block_length < 34) return -1;
+        technicallyflac_bitreader_init(&br,&data[pos],d->block_length);
+        d->min_blocksize = (uint32_t)technicallyflac_bitreader_read(&br,16);
+        d->max_blocksize = (uint32_t)technicallyflac_bitreader_read(&br,16);
+        d->min_framesize = (uint32_t)technicallyflac_bitreader_read(&br,24);
+        d->max_framesize = (uint32_t)technicallyflac_bitreader_read(&br,24);
+        d->samplerate = (uint32_t)technicallyflac_bitreader_read(&br,20);
+        d->channels = (uint8_t)technicallyflac_bitreader_read(&br,3) + 1;
+        d->bitdepth = (uint8_t)technicallyflac_bitreader_read(&br,5) + 1;
+        d->total_samples = technicallyflac_bitreader_read(&br,36);
+        for(i=0;i<16;i++) {
+            d->md5[i] = data[pos + 18 + i];
         }
+    } else if(!d->streammarker) {
+        /* STREAMINFO has to come first */
+        return -1;
     }
-    return r;
+
+    d->streammarker = 1;
+    *used = pos + d->block_length;
+    return last ? 0 : 1;
 }
 
-static int technicallyflac_subframe(technicallyflac *f, uint32_t num_frames, int32_t **frames) {
-    int r = 1;
+int technicallyflac_decode_frame(technicallyflac_decoder *d, const uint8_t *data, uint32_t len, uint32_t *used, int32_t **output) {
+    technicallyflac_bitreader br;
+    technicallyflac_subframe_decoder sd;
+    int64_t buf[TECHNICALLYFLAC_CHUNK];
+    int64_t mid;
+    uint32_t start;
+    uint32_t count;
+    uint32_t i;
+    uint8_t channels;
+    uint8_t ch;
 
-    while(f->bw.pos < f->bw.len && r) {
-        technicallyflac_bitwriter_flush(&f->bw);
-        switch(f->fr_state.subframe.state) {
-            case TECHNICALLYFLAC_SUBFRAME_START: {
-                f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_PAD;
-                f->fr_state.subframe.frame = 0;
-                break;
+    technicallyflac_bitreader_init(&br,data,len);
+    if(technicallyflac_decode_frame_header(d,&br) != 0) {
+        return br.error ? 1 : -1;
+    }
+
+    channels = d->frame_channels < 9 ? d->frame_channels : 2;
+    for(ch=0;ch<channels;ch++) {
+        if(technicallyflac_decode_subframe_start(&br,&sd,d->frame_bitdepth + technicallyflac_decode_side(d,ch),d->frame_blocksize) != 0) {
+            return br.error ? 1 : -1;
+        }
+
+        for(start=0;start<d->frame_blocksize;start+=count) {
+            count = d->frame_blocksize - start;
+            if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+            if(technicallyflac_decode_samples(&br,&sd,buf,count) != 0) {
+                return br.error ? 1 : -1;
             }
-            case TECHNICALLYFLAC_SUBFRAME_PAD: {
-                if(technicallyflac_bitwriter_add(&f->bw,1,0)) {
-                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_TYPE;
+
+            /* side channels can need 33 bits, but left and right always fit.
+             * The first channel of side-right is kept mod 2^32 until right turns up */
+            if(ch == 0 || d->frame_channels < 9) {
+                for(i=0;i<count;i++) {
+                    output[ch][start + i] = (int32_t)buf[i];
                 }
-                break;
-            }
-            case TECHNICALLYFLAC_SUBFRAME_TYPE: {
-                if(technicallyflac_bitwriter_add(&f->bw,6,1)) {
-                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_WASTED;
+            } else if(d->frame_channels == 9) {
+                for(i=0;i<count;i++) {
+                    output[1][start + i] = (int32_t)((uint32_t)output[0][start + i] - (uint32_t)buf[i]);
                 }
-                break;
-            }
-            case TECHNICALLYFLAC_SUBFRAME_WASTED: {
-                if(technicallyflac_bitwriter_add(&f->bw,1,0)) {
-                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_VERBATIM;
+            } else if(d->frame_channels == 10) {
+                for(i=0;i<count;i++) {
+                    output[0][start + i] = (int32_t)((uint32_t)output[0][start + i] + (uint32_t)buf[i]);
+                    output[1][start + i] = (int32_t)buf[i];
                 }
-                break;
-            }
-            case TECHNICALLYFLAC_SUBFRAME_VERBATIM: {
-                if(technicallyflac_subframe_verbatim(f,num_frames,frames) == 0) {
-                    f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_END;
+            } else {
+                for(i=0;i<count;i++) {
+                    mid = ((int64_t)output[0][start + i] * 2) | (buf[i] & 1);
+                    output[0][start + i] = (int32_t)((mid + buf[i]) >> 1);
+                    output[1][start + i] = (int32_t)((mid - buf[i]) >> 1);
                 }
-                break;
             }
-            case TECHNICALLYFLAC_SUBFRAME_END: {
-                f->fr_state.subframe.channel++;
-                f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_START;
-                if(f->fr_state.subframe.channel == f->fr_state.subframe.channels) {
-                    r = 0;
+        }
+    }
+
+    if(technicallyflac_decode_footer(&br,d->cpu) != 0) {
+        return br.error ? 1 : -1;
+    }
+    *used = technicallyflac_bitreader_tell(&br);
+    return 0;
+}
+
+/* multiplies two CRC-16 remainders, mod the CRC-16 polynomial */
+static uint16_t technicallyflac_crc16_mul(uint16_t a, uint16_t b) {
+    uint16_t r = 0;
+    uint8_t i;
+
+    for(i=0;i<16;i++) {
+        r = (r & 0x8000) ? (uint16_t)((r << 1) ^ 0x8005) : (uint16_t)(r << 1);
+        if(a & (0x8000 >> i)) r ^= b;
+    }
+    return r;
+}
+
+/* returns the CRC-16 crc would become after len more zero bytes, without
+ * going through them. The CRC-16 of A followed by B is
+ * technicallyflac_crc16_shift(crc16(A),len B) ^ crc16(B) */
+static uint16_t technicallyflac_crc16_shift(uint16_t crc, uint32_t len) {
+    uint16_t x = 0x0100; /* x^8, one byte */
+
+    while(len) {
+        if(len & 1) crc = technicallyflac_crc16_mul(crc,x);
+        x = technicallyflac_crc16_mul(x,x);
+        len >>= 1;
+    }
+    return crc;
+}
+
+/* skips n bits, which can be more than the reader holds */
+static void technicallyflac_bitreader_skip(technicallyflac_bitreader *br, uint32_t n) {
+    uint64_t bitpos;
+
+    if(n <= br->bits) {
+        technicallyflac_bitreader_read(br,(uint8_t)n);
+        return;
+    }
+    bitpos = ((uint64_t)br->pos * 8) - br->bits + n;
+    br->val = 0;
+    br->bits = 0;
+    if(bitpos > (uint64_t)br->len * 8) {
+        br->pos = br->len;
+        br->error = 1;
+        return;
+    }
+    br->pos = (uint32_t)(bitpos / 8);
+    technicallyflac_bitreader_read(br,(uint8_t)(bitpos % 8));
+}
+
+/* finds the end of the frame at data, which has to match the settings of f.
+ * Only FIXED subframes are decoded (a bad residual makes the frame invalid),
+ * the others are skipped over.
+ * returns 0, 1 if len doesn't hold the whole frame or -1 if it isn't valid */
+static int technicallyflac_remux_parse(const technicallyflac *f, const uint8_t *data, uint32_t len, uint32_t *header_len, uint32_t *frame_len, uint32_t *blocksize) {
+    technicallyflac_decoder d;
+    technicallyflac_bitreader br;
+    technicallyflac_subframe_decoder sd;
+    int64_t buf[TECHNICALLYFLAC_CHUNK];
+    uint32_t start;
+    uint32_t count;
+    uint8_t ch;
+
+    d.samplerate = f->samplerate;
+    d.bitdepth = f->bitdepth;
+    technicallyflac_bitreader_init(&br,data,len);
+    if(technicallyflac_decode_frame_header(&d,&br) != 0) {
+        return br.error ? 1 : -1;
+    }
+    /* the stereo mode can change from frame to frame */
+    if(d.frame_blocksize > f->blocksize || d.frame_samplerate != f->samplerate ||
+       (d.frame_channels < 9 ? d.frame_channels : 2) != f->fr_state.subframe.channels ||
+       d.frame_bitdepth != f->bitdepth) {
+        return -1;
+    }
+    *header_len = technicallyflac_bitreader_tell(&br);
+
+    for(ch=0;ch<f->fr_state.subframe.channels;ch++) {
+        if(technicallyflac_decode_subframe_start(&br,&sd,f->bitdepth + technicallyflac_decode_side(&d,ch),d.frame_blocksize) != 0) {
+            return br.error ? 1 : -1;
+        }
+        if(sd.type == TECHNICALLYFLAC_TYPE_VERBATIM) {
+            technicallyflac_bitreader_skip(&br,sd.bits * d.frame_blocksize);
+        } else if(sd.type == TECHNICALLYFLAC_TYPE_FIXED) {
+            for(start=0;start<d.frame_blocksize;start+=count) {
+                count = d.frame_blocksize - start;
+                if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+                if(technicallyflac_decode_samples(&br,&sd,buf,count) != 0) {
+                    return br.error ? 1 : -1;
                 }
             }
         }
+        if(br.error) return 1;
+    }
 
+    technicallyflac_bitreader_align(&br);
+    technicallyflac_bitreader_read(&br,16);
+    if(br.error) return 1;
+
+    *frame_len = technicallyflac_bitreader_tell(&br);
+    *blocksize = d.frame_blocksize;
+    return 0;
+}
+
+/* writes the renumbered frame header into out and the new CRC-16 into
+ * footer, moves f on a frame. returns the header length */
+static uint32_t technicallyflac_remux_header(technicallyflac *f, const uint8_t *data, uint32_t header_len, uint32_t frame_len, uint32_t blocksize, uint8_t *out, uint8_t *footer) {
+    uint32_t len;
+    uint16_t crc16;
+    uint8_t n;
+
+    /* length of the old frame/sample number, already checked by technicallyflac_decode_frame_header */
+    n = 1;
+    if(data[4] & 0x80) {
+        for(n=0;data[4] & (0x80 >> n);n++);
     }
-    return r;
+
+    out[0] = data[0];
+    out[1] = 0xF8 | ((f->flags & TECHNICALLYFLAC_FLAG_VARIABLE) != 0);
+    out[2] = data[2];
+    out[3] = data[3];
+    len = 4 + technicallyflac_utf8_encode(technicallyflac_frameindex_next(f,blocksize),&out[4]);
+
+    /* uncommon blocksize and samplerate */
+    technicallyflac_copy(f->cpu,&out[len],&data[4 + n],header_len - 5 - n);
+    len += header_len - 5 - n;
+    out[len] = technicallyflac_crc8(0,out,len);
+    len++;
+
+    /* swap the old header's part of the CRC-16 for the new one's, the rest of the frame is the same */
+    crc16 = ((uint16_t)data[frame_len - 2] << 8) | data[frame_len - 1];
+    crc16 ^= technicallyflac_crc16_shift(technicallyflac_crc16(f->cpu,0,data,header_len) ^ technicallyflac_crc16(f->cpu,0,out,len),frame_len - header_len - 2);
+    footer[0] = (uint8_t)(crc16 >> 8);
+    footer[1] = (uint8_t)crc16;
+
+    technicallyflac_streaminfo_frame(f,blocksize,len + frame_len - header_len,NULL);
+    return len;
 }
 
+int technicallyflac_remux_frame(technicallyflac *f, uint8_t *output, uint32_t *bytes, const uint8_t *data, uint32_t len, uint32_t *used) {
+    uint32_t header_len;
+    uint32_t frame_len;
+    uint32_t blocksize;
+    uint32_t out_len;
+    uint8_t footer[2];
+    int r;
 
-int technicallyflac_frame(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, int32_t **frames) {
+    if(f->flags & TECHNICALLYFLAC_FLAG_MD5 || f->fr_state.state != TECHNICALLYFLAC_FRAME_START) return -1;
+
+    r = technicallyflac_remux_parse(f,data,len,&header_len,&frame_len,&blocksize);
+    if(r != 0) return r;
+
+    /* the header can grow by 6 bytes at most, with a longer frame number */
+    if(*bytes < frame_len + 6) return -1;
+
+    out_len = technicallyflac_remux_header(f,data,header_len,frame_len,blocksize,output,footer);
+    technicallyflac_copy(f->cpu,&output[out_len],&data[header_len],frame_len - header_len - 2);
+    out_len += frame_len - header_len - 2;
+    output[out_len] = footer[0];
+    output[out_len + 1] = footer[1];
+
+    *bytes = out_len + 2;
+    *used = frame_len;
+    return 0;
+}
+
+int technicallyflac_remux_iov(technicallyflac *f, uint8_t *header, technicallyflac_iovec *iov, const uint8_t *data, uint32_t len, uint32_t *used) {
+    uint32_t header_len;
+    uint32_t frame_len;
+    uint32_t blocksize;
+    int r;
+
+    if(f->flags & TECHNICALLYFLAC_FLAG_MD5 || f->fr_state.state != TECHNICALLYFLAC_FRAME_START) return -1;
+
+    r = technicallyflac_remux_parse(f,data,len,&header_len,&frame_len,&blocksize);
+    if(r != 0) return r;
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = technicallyflac_remux_header(f,data,header_len,frame_len,blocksize,header,&header[TECHNICALLYFLAC_REMUX_HEADER_LEN - 2]);
+    iov[1].iov_base = (void *)&data[header_len];
+    iov[1].iov_len = frame_len - header_len - 2;
+    iov[2].iov_base = &header[TECHNICALLYFLAC_REMUX_HEADER_LEN - 2];
+    iov[2].iov_len = 2;
+
+    *used = frame_len;
+    return 0;
+}
+
+/* returns -1 if a frame of num_frames can't be written next. The workspace and
+ * the fixed predictors only have room for 1 to blocksize samples, and with
+ * TECHNICALLYFLAC_FLAG_VARIABLE only the last frame can go under STREAMINFO's
+ * smallest blocksize of 16, so nothing can come after one */
+static int technicallyflac_frame_check(const technicallyflac *f, uint32_t num_frames) {
+    if(num_frames == 0 || num_frames > f->blocksize) return -1;
+    if(f->flags & TECHNICALLYFLAC_FLAG_VARIABLE && f->min_blocksize != 0 && f->min_blocksize < 16) return -1;
+    return 0;
+}
+
+static int technicallyflac_frame_input(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, const technicallyflac_input *in) {
     int r = 1;
-    uint32_t frameindex;
+    uint32_t val;
+    uint8_t n;
+    uint8_t i;
+
+    if(technicallyflac_frame_check(f,num_frames) != 0) return -1;
 
     if(output == NULL || bytes == NULL || *bytes == 0) {
-        return technicallyflac_size_frame_index(f->blocksize,f->channels,f->bitdepth,f->frameindex);
+        return technicallyflac_frame_size_max(f,num_frames);
+    }
+
+    if(f->fr_state.state == TECHNICALLYFLAC_FRAME_START &&
+       *bytes >= technicallyflac_frame_size_max(f,num_frames)) {
+        *bytes = technicallyflac_frame_fast(f,output,*bytes,num_frames,in);
+        technicallyflac_streaminfo_frame(f,num_frames,*bytes,in);
+        if(f->flags & TECHNICALLYFLAC_FLAG_VERIFY) {
+            return technicallyflac_verify_frame(f,output,*bytes,num_frames,in);
+        }
+        return 0;
+    }
+
+    /* a frame written in pieces can't be checked */
+    if(f->flags & TECHNICALLYFLAC_FLAG_VERIFY) {
+        return -1;
     }
 
     f->bw.buffer = output;
     f->bw.len = *bytes;
     f->bw.pos = 0;
+    f->bw.crcpos = 0;
 
     while(f->bw.pos < f->bw.len && r) {
         technicallyflac_bitwriter_flush(&f->bw);
@@ -807,140 +4121,32 @@ int technicallyflac_frame(technicallyflac *f, uint8_t *output, uint32_t *bytes,
             case TECHNICALLYFLAC_FRAME_START: {
                 technicallyflac_bitwriter_init(&f->bw);
                 f->fr_state.subframe.state = TECHNICALLYFLAC_SUBFRAME_START;
-                f->fr_state.state = TECHNICALLYFLAC_FRAME_SYNC;
+                f->fr_state.state = TECHNICALLYFLAC_FRAME_HEADER;
+                f->fr_state.framesize = 0;
                 f->fr_state.subframe.channel = 0;
 
-                frameindex = f->frameindex++;
-                if(f->frameindex > 0x7FFFFFFF) {
-                    f->frameindex -= 0x80000000;
-                }
-
-                f->fr_state.frameindexlen = 0;
-                f->fr_state.frameindexpos = 0;
-                f->fr_state.frameindex[0] = 0;
-                f->fr_state.frameindex[1] = 0;
-                f->fr_state.frameindex[2] = 0;
-                f->fr_state.frameindex[3] = 0;
-                f->fr_state.frameindex[4] = 0;
-                f->fr_state.frameindex[5] = 0;
-
-                if(frameindex < ((uint32_t)1<<7)) {
-                    f->fr_state.frameindex[0] = frameindex;
-                    f->fr_state.frameindexlen = 1;
-                } else if(frameindex < ((uint32_t)1<<11)) {
-                    f->fr_state.frameindex[0] = 0xC0 | ((frameindex >> 6 ) & 0x1F);
-                    f->fr_state.frameindex[1] = 0x80 | ((frameindex      ) & 0x3F);
-                    f->fr_state.frameindexlen = 2;
-                } else if(frameindex < ((uint32_t)1<<16)) {
-                    f->fr_state.frameindex[0] = 0xE0 | ((frameindex >> 12) & 0x0F);
-                    f->fr_state.frameindex[1] = 0x80 | ((frameindex >> 6 ) & 0x3F);
-                    f->fr_state.frameindex[2] = 0x80 | ((frameindex      ) & 0x3F);
-                    f->fr_state.frameindexlen = 3;
-                } else if(frameindex < ((uint32_t)1 << 21)) {
-                    f->fr_state.frameindex[0] = 0xF0 | ((frameindex >> 18) & 0x07);
-                    f->fr_state.frameindex[1] = 0x80 | ((frameindex >> 12) & 0x3F);
-                    f->fr_state.frameindex[2] = 0x80 | ((frameindex >>  6) & 0x3F);
-                    f->fr_state.frameindex[3] = 0x80 | ((frameindex      ) & 0x3F);
-                    f->fr_state.frameindexlen = 4;
-                }
-                else if(frameindex < ((uint32_t)1 << 26)) {
-                    f->fr_state.frameindex[0] = 0xF8 | ((frameindex >> 24) & 0x03);
-                    f->fr_state.frameindex[1] = 0x80 | ((frameindex >> 18) & 0x3F);
-                    f->fr_state.frameindex[2] = 0x80 | ((frameindex >> 12) & 0x3F);
-                    f->fr_state.frameindex[3] = 0x80 | ((frameindex >>  6) & 0x3F);
-                    f->fr_state.frameindex[4] = 0x80 | ((frameindex      ) & 0x3F);
-                    f->fr_state.frameindexlen = 5;
-                }
-                else if(frameindex < ((uint32_t)1 << 31)) {
-                    f->fr_state.frameindex[0] = 0xFC | ((frameindex >> 30) & 0x01);
-                    f->fr_state.frameindex[1] = 0x80 | ((frameindex >> 24) & 0x3F);
-                    f->fr_state.frameindex[2] = 0x80 | ((frameindex >> 18) & 0x3F);
-                    f->fr_state.frameindex[3] = 0x80 | ((frameindex >> 12) & 0x3F);
-                    f->fr_state.frameindex[4] = 0x80 | ((frameindex >>  6) & 0x3F);
-                    f->fr_state.frameindex[5] = 0x80 | ((frameindex      ) & 0x3F);
-                    f->fr_state.frameindexlen = 6;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_SYNC: {
-                if(technicallyflac_bitwriter_add(&f->bw,14,0x3FFE)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_RES0;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_RES0: {
-                if(technicallyflac_bitwriter_add(&f->bw,1,0)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_BLOCKING_STRATEGY;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_BLOCKING_STRATEGY: {
-                if(technicallyflac_bitwriter_add(&f->bw,1,0)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_BLOCK_SIZE;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_BLOCK_SIZE: {
-                if(technicallyflac_bitwriter_add(&f->bw,4,7)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_SAMPLE_RATE;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_SAMPLE_RATE: {
-                if(technicallyflac_bitwriter_add(&f->bw,4,f->samplerate_header)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_CHANNEL_ASSIGNMENT;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_CHANNEL_ASSIGNMENT: {
-                if(technicallyflac_bitwriter_add(&f->bw,4,f->channels - 1)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_SAMPLE_SIZE;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_SAMPLE_SIZE: {
-                if(technicallyflac_bitwriter_add(&f->bw,3,f->bitdepth_header)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_RES1;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_RES1: {
-                if(technicallyflac_bitwriter_add(&f->bw,1,0)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_INDEX;
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_INDEX: {
-                if(technicallyflac_bitwriter_add(&f->bw,8,f->fr_state.frameindex[f->fr_state.frameindexpos])) {
-                    f->fr_state.frameindexpos++;
-                    if(f->fr_state.frameindexpos == f->fr_state.frameindexlen) {
-                        f->fr_state.state = TECHNICALLYFLAC_FRAME_OPT_BLOCK_SIZE;
-                    }
-                }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_OPT_BLOCK_SIZE: {
-                if(technicallyflac_bitwriter_add(&f->bw,16,num_frames-1)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_OPT_SAMPLE_RATE;
-                }
+                f->fr_state.headerlen = technicallyflac_frame_header(f,technicallyflac_frameindex_next(f,num_frames),num_frames,f->fr_state.header);
+                f->fr_state.headerpos = 0;
                 break;
             }
-            case TECHNICALLYFLAC_FRAME_OPT_SAMPLE_RATE: {
-                if(technicallyflac_bitwriter_add(&f->bw,16,f->samplerate_value)) {
-                    f->fr_state.state = TECHNICALLYFLAC_FRAME_CRC8;
+            /* the header is ready to go, copy it out up to 4 bytes at a time */
+            case TECHNICALLYFLAC_FRAME_HEADER: {
+                n = f->fr_state.headerlen - f->fr_state.headerpos;
+                if(n > 4) n = 4;
+                val = 0;
+                for(i=0;i<n;i++) {
+                    val = (val << 8) | f->fr_state.header[f->fr_state.headerpos + i];
                 }
-                break;
-            }
-            case TECHNICALLYFLAC_FRAME_CRC8: {
-                if(f->bw.bits == 0) {
-                    if(technicallyflac_bitwriter_add(&f->bw,8,f->bw.crc8)) {
+                if(technicallyflac_bitwriter_add(&f->bw,n * 8,val)) {
+                    f->fr_state.headerpos += n;
+                    if(f->fr_state.headerpos == f->fr_state.headerlen) {
                         f->fr_state.state = TECHNICALLYFLAC_FRAME_SUBFRAME;
                     }
                 }
                 break;
             }
             case TECHNICALLYFLAC_FRAME_SUBFRAME: {
-                if(technicallyflac_subframe(f,num_frames,frames) == 0) {
+                if(technicallyflac_subframe(f,num_frames,in) == 0) {
                     f->fr_state.state = TECHNICALLYFLAC_FRAME_ALIGN;
                 }
                 break;
@@ -954,6 +4160,7 @@ int technicallyflac_frame(technicallyflac *f, uint8_t *output, uint32_t *bytes,
             }
             case TECHNICALLYFLAC_FRAME_FOOTER: {
                 if(f->bw.bits == 0) {
+                    technicallyflac_bitwriter_crc(&f->bw,f->cpu);
                     technicallyflac_bitwriter_add(&f->bw,16,f->bw.crc16);
                     f->fr_state.state = TECHNICALLYFLAC_FRAME_END;
                 }
@@ -968,17 +4175,143 @@ int technicallyflac_frame(technicallyflac *f, uint8_t *output, uint32_t *bytes,
             }
         }
     }
+    if(r) {
+        technicallyflac_bitwriter_crc(&f->bw,f->cpu);
+    }
+
     assert(f->bw.pos > 0);
     *bytes = f->bw.pos;
+    f->fr_state.framesize += *bytes;
+    if(r == 0) {
+        technicallyflac_streaminfo_frame(f,num_frames,f->fr_state.framesize,in);
+    }
     return r;
 }
 
+int technicallyflac_frame(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, int32_t **frames) {
+    technicallyflac_input in;
+
+    in.planar = frames;
+    in.interleaved = NULL;
+
+    return technicallyflac_frame_input(f,output,bytes,num_frames,&in);
+}
+
+int technicallyflac_frame_interleaved(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, const void *samples, enum TECHNICALLYFLAC_FORMAT format) {
+    technicallyflac_input in;
+
+    technicallyflac_input_interleaved(f,&in,samples,format);
+
+    return technicallyflac_frame_input(f,output,bytes,num_frames,&in);
+}
+
+/* packs a chunk of a verbatim subframe with a constant width. Whatever
+ * doesn't start on a byte boundary or fill a group goes bit by bit */
+#define TECHNICALLYFLAC_PACK_CONST(type) \
+TECHNICALLYFLAC_INLINE void technicallyflac_pack_const_##type(technicallyflac *f, technicallyflac_fastwriter *fw, const type *src, uint32_t count, uint8_t width) { \
+    uint32_t i = 0; \
+    technicallyflac_fastwriter_flush(fw); \
+    if(fw->bits == 0) { \
+        if(width % 8 == 0 && sizeof(type) == sizeof(int32_t)) { \
+            technicallyflac_pack_be(f->cpu,&fw->buffer[fw->pos],(const int32_t *)src,count,width / 8); \
+            i = count; \
+        } else { \
+            i = technicallyflac_pack_groups_##type(&fw->buffer[fw->pos],&fw->buffer[fw->len],src,count,width); \
+        } \
+        fw->pos += i * width / 8; \
+        technicallyflac_fastwriter_crc(fw,f->cpu); \
+    } \
+    technicallyflac_pack_bits_const_##type(fw,&src[i],count - i,width); \
+}
+
+TECHNICALLYFLAC_PACK_CONST(int32_t)
+TECHNICALLYFLAC_PACK_CONST(int64_t)
+
+#undef TECHNICALLYFLAC_PACK_CONST
+
+/* technicallyflac_frame_fast for verbatim frames, where bitdepth and channels
+ * are constants (see TECHNICALLYFLAC_ENCODER). Anything else goes to
+ * technicallyflac_frame_input */
+TECHNICALLYFLAC_INLINE int technicallyflac_frame_const(technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, const technicallyflac_input *in, const uint8_t bitdepth, const uint8_t channels) {
+    technicallyflac_fastwriter fw;
+    technicallyflac_chunk c;
+    const int32_t *left;
+    const int32_t *right;
+    uint32_t start;
+    uint32_t count;
+    uint8_t i;
+
+    if(f->bitdepth != bitdepth || f->channels != channels) return -1;
+    if(technicallyflac_frame_check(f,num_frames) != 0) return -1;
+
+    if(output == NULL || bytes == NULL || f->fr_state.state != TECHNICALLYFLAC_FRAME_START ||
+       f->flags & ~(TECHNICALLYFLAC_FLAG_MD5 | TECHNICALLYFLAC_FLAG_VARIABLE) ||
+       *bytes < technicallyflac_frame_size_max(f,num_frames)) {
+        return technicallyflac_frame_input(f,output,bytes,num_frames,in);
+    }
+
+    technicallyflac_fastwriter_init(&fw,output,*bytes);
+    fw.pos = technicallyflac_frame_header(f,technicallyflac_frameindex_next(f,num_frames),num_frames,output);
+
+    for(i=0;i<(channels < 9 ? channels : 2);i++) {
+        technicallyflac_fastwriter_add(&fw,8,TECHNICALLYFLAC_TYPE_VERBATIM << 1);
+
+        for(start=0;start<num_frames;start+=count) {
+            count = num_frames - start;
+            if(count > TECHNICALLYFLAC_CHUNK) count = TECHNICALLYFLAC_CHUNK;
+
+            if(channels < 9 || (channels == 9 && i == 0) || (channels == 10 && i == 1)) {
+                left = technicallyflac_input_read(in,i,start,count,c.lbuf);
+                technicallyflac_pack_const_int32_t(f,&fw,left,count,bitdepth);
+                continue;
+            }
+
+            left = technicallyflac_input_read(in,0,start,count,c.lbuf);
+            right = technicallyflac_input_read(in,1,start,count,c.rbuf);
+            if(channels == 11 && i == 0) {
+                technicallyflac_stereo_mid(left,right,c.mbuf,count);
+                technicallyflac_pack_const_int32_t(f,&fw,c.mbuf,count,bitdepth);
+            } else {
+                technicallyflac_stereo_side(left,right,c.sbuf,count);
+                technicallyflac_pack_const_int64_t(f,&fw,c.sbuf,count,bitdepth + 1);
+            }
+        }
+    }
+
+    technicallyflac_fastwriter_align(&fw);
+    technicallyflac_fastwriter_flush(&fw);
+    technicallyflac_fastwriter_crc(&fw,f->cpu);
+    technicallyflac_fastwriter_add(&fw,16,fw.crc16);
+    technicallyflac_fastwriter_flush(&fw);
+
+    *bytes = fw.pos;
+    technicallyflac_streaminfo_frame(f,num_frames,*bytes,in);
+    return 0;
+}
+
+void technicallyflac_streaminfo_track(technicallyflac *f, uint32_t num_frames, uint32_t frame_bytes, int32_t **frames) {
+    technicallyflac_input in;
+
+    in.planar = frames;
+    in.interleaved = NULL;
+
+    technicallyflac_streaminfo_frame(f,num_frames,frame_bytes,&in);
+}
+
+void technicallyflac_streaminfo_track_interleaved(technicallyflac *f, uint32_t num_frames, uint32_t frame_bytes, const void *samples, enum TECHNICALLYFLAC_FORMAT format) {
+    technicallyflac_input in;
+
+    technicallyflac_input_interleaved(f,&in,samples,format);
+
+    technicallyflac_streaminfo_frame(f,num_frames,frame_bytes,&in);
+}
+
 
 TF_PURE
-uint32_t technicallyflac_size_frame_index(uint32_t blocksize, uint8_t channels, uint8_t bitdepth, uint32_t frameindex) {
+uint32_t technicallyflac_size_frame_index(uint32_t blocksize, uint8_t channels, uint8_t bitdepth, uint64_t frameindex) {
     /* max size of a frame in bytes is:
      *   9 bytes of headers +
-     *   1-6 for max frame number +
+     *   1-7 for max frame/sample number +
      *   2 bytes of footer +
      *   (channels) bytes of subframe headers +
      *   (blocksize * bitdepth * channels) / bitdepth bytes for verbatim encoding
@@ -1015,18 +4348,35 @@ uint32_t technicallyflac_size_frame_index(uint32_t blocksize, uint8_t channels,
     else if(frameindex < ((uint32_t)1 << 26)) {
         total_bytes += 5;
     }
-    else {
+    else if(frameindex < ((uint32_t)1 << 31)) {
         total_bytes += 6;
     }
+    else {
+        total_bytes += 7;
+    }
     return total_bytes;
 }
 
+TF_PURE
+uint32_t technicallyflac_size_workspace(uint32_t blocksize) {
+    return sizeof(technicallyflac_fixed) + (blocksize * sizeof(int32_t));
+}
+
+TF_PURE
+uint32_t technicallyflac_size_remux_header(void) {
+    return TECHNICALLYFLAC_REMUX_HEADER_LEN;
+}
+
 TF_PURE
 uint32_t technicallyflac_size_frame(uint32_t blocksize, uint8_t channels, uint8_t bitdepth) {
-    return technicallyflac_size_frame_index(blocksize,channels,bitdepth,0x7FFFFFFF);
+    return technicallyflac_size_frame_index(blocksize,channels,bitdepth,0xFFFFFFFFF);
 }
 
 TF_PURE
+uint32_t technicallyflac_size_seektable(uint32_t num_points) {
+    return 4 + (18 * num_points);
+}
+
 uint32_t technicallyflac_size_metadata(uint32_t num_bytes) {
     return num_bytes + 4;
 }
@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2020 John Regan
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+A C++ wrapper for an encoder with a fixed bitdepth, channels and stereo
+mode, on top of technicallyflac.h (C++11). It's in namespace tf, the
+technicallyflac type already has the name.
+
+    tf::encoder<16, 2, tf::mid_side> e;
+    uint8_t buffer[decltype(e)::size_frame(4096)];
+
+    e.init(4096, 44100);
+    e.frame(buffer, &bufferlen, num_samples, samples);
+
+e.f is the technicallyflac object, for everything else (metadata, flags).
+frame() and frame_interleaved() call the encoders TECHNICALLYFLAC_ENCODER
+defines (see technicallyflac.h), which have to be declared with
+TECHNICALLYFLAC_CPP_ENCODER_DECL:
+
+    // in the C file with the implementation
+    #define TECHNICALLYFLAC_IMPLEMENTATION
+    #include "technicallyflac.h"
+    TECHNICALLYFLAC_ENCODER(16,11)
+
+    // wherever encoder<16, 2, tf::mid_side> is used
+    #include "technicallyflac.hpp"
+    TECHNICALLYFLAC_CPP_ENCODER_DECL(16,11)
+
+Without the declaration, or with it after the first encoder of that format,
+it doesn't compile. Note the channels given to the macros are
+technicallyflac_init's, where stereo modes are 9-11.
+*/
+
+#ifndef TECHNICALLYFLAC_HPP
+#define TECHNICALLYFLAC_HPP
+
+#ifndef TECHNICALLYFLAC_H
+#include "technicallyflac.h"
+#endif
+
+namespace tf {
+
+/* the stereo modes, as channels for technicallyflac_init */
+enum stereo_mode {
+    independent = 0,
+    left_side = 9,
+    right_side = 10,
+    mid_side = 11
+};
+
+namespace detail {
+
+/* the encoders for one format, TECHNICALLYFLAC_CPP_ENCODER_DECL specializes
+ * this for each one. Bits is never 0, it only makes the assert depend on them */
+template<unsigned Bits, unsigned Channels>
+struct frame {
+    static_assert(Bits == 0 && Channels == 0, "use TECHNICALLYFLAC_CPP_ENCODER_DECL(bitdepth, channels) before this encoder");
+};
+
+}
+
+template<unsigned Bits, unsigned Channels, unsigned Mode = independent>
+class encoder {
+    static_assert(Bits >= 4 && Bits <= 32, "bitdepth has to be 4-32");
+    static_assert(Channels >= 1 && Channels <= 8, "channels has to be 1-8");
+    static_assert(Mode == independent || (Mode >= left_side && Mode <= mid_side), "unknown stereo mode");
+    static_assert(Mode == independent || Channels == 2, "stereo modes need 2 channels");
+
+public:
+    /* channels as technicallyflac_init takes them */
+    static constexpr unsigned init_channels = Mode == independent ? Channels : Mode;
+
+    /* instantiates detail::frame along with the class, so a missing or late
+     * TECHNICALLYFLAC_CPP_ENCODER_DECL is caught at the first encoder<> and not
+     * wherever the compiler gets around to frame() */
+    static_assert(sizeof(detail::frame<Bits, init_channels>) > 0, "encoder not declared");
+
+    /* technicallyflac_size_frame, as a constant */
+    static constexpr uint32_t size_frame(uint32_t blocksize) {
+        return TECHNICALLYFLAC_SIZE_FRAME(blocksize,init_channels,Bits);
+    }
+
+    ::technicallyflac f;
+
+    /* technicallyflac_init, returns -1 on bad parameters */
+    int init(uint32_t blocksize, uint32_t samplerate) {
+        return technicallyflac_init(&f,blocksize,samplerate,init_channels,Bits);
+    }
+
+    /* technicallyflac_frame */
+    int frame(uint8_t *output, uint32_t *bytes, uint32_t num_frames, int32_t **frames) {
+        return detail::frame<Bits, init_channels>::call(&f,output,bytes,num_frames,frames);
+    }
+
+    /* technicallyflac_frame_interleaved */
+    int frame_interleaved(uint8_t *output, uint32_t *bytes, uint32_t num_frames, const void *samples, enum TECHNICALLYFLAC_FORMAT format) {
+        return detail::frame<Bits, init_channels>::call_interleaved(&f,output,bytes,num_frames,samples,format);
+    }
+};
+
+}
+
+#define TECHNICALLYFLAC_CPP_ENCODER_DECL(bitdepth, channels) \
+TECHNICALLYFLAC_ENCODER_DECL(bitdepth, channels); \
+namespace tf { namespace detail { \
+template<> \
+struct frame<bitdepth, channels> { \
+    static int call(::technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, int32_t **frames) { \
+        return technicallyflac_frame_##bitdepth##_##channels(f,output,bytes,num_frames,frames); \
+    } \
+    static int call_interleaved(::technicallyflac *f, uint8_t *output, uint32_t *bytes, uint32_t num_frames, const void *samples, enum TECHNICALLYFLAC_FORMAT format) { \
+        return technicallyflac_frame_interleaved_##bitdepth##_##channels(f,output,bytes,num_frames,samples,format); \
+    } \
+}; \
+} }
+
+#endif
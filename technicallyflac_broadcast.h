@@ -0,0 +1,253 @@
+/*
+Copyright (c) 2020 John Regan
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+Live streaming to many listeners, on top of technicallyflac.h.
+
+Every listener of a live stream gets the same frames, only starting at a
+different point. Each block is encoded once into a ring of finished
+frames, and each listener keeps its own place in the ring. A new
+listener gets the header (the streammarker and metadata blocks, built
+once up front) and then frames from the next one encoded. Frames carry
+their own sync code and number, so a decoder can start on any of them.
+
+The ring is your memory, sized with technicallyflac_broadcast_size. A
+listener that falls so far behind that its frame has been overwritten
+skips ahead to the oldest frame still kept, if it's between frames, or
+has to be dropped if it was part way through sending one.
+
+Nothing here sends data: technicallyflac_broadcast_data hands back the
+next bytes for a listener, as big a piece of the ring as it can, and
+technicallyflac_broadcast_sent says how much of it went out. See
+examples/example-broadcast.c for an HTTP server.
+
+This doesn't lock anything, call it all from one thread (or hold a lock).
+Like technicallyflac.h it doesn't use the C library or allocate memory.
+In one C file define TECHNICALLYFLAC_BROADCAST_IMPLEMENTATION before
+including it.
+*/
+
+#ifndef TECHNICALLYFLAC_BROADCAST_H
+#define TECHNICALLYFLAC_BROADCAST_H
+
+#ifndef TECHNICALLYFLAC_H
+#include "technicallyflac.h"
+#endif
+
+typedef struct technicallyflac_broadcast_s technicallyflac_broadcast;
+typedef struct technicallyflac_broadcast_slot_s technicallyflac_broadcast_slot;
+typedef struct technicallyflac_listener_s technicallyflac_listener;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* returns the bytes of ring needed to keep at least the last frames frames of f */
+uint32_t technicallyflac_broadcast_size(const technicallyflac *f, uint32_t frames);
+
+/* sets up a broadcast of f, which should already be set up and have written
+ * header (the streammarker and metadata blocks, header_len bytes). header
+ * isn't copied and has to stay around. ring is ring_len bytes, slots has an
+ * entry for each frame the ring can hold (see technicallyflac_broadcast_size).
+ * returns -1 if the ring can't hold a frame */
+int technicallyflac_broadcast_init(technicallyflac_broadcast *b, technicallyflac *f, const uint8_t *header, uint32_t header_len, uint8_t *ring, uint32_t ring_len, technicallyflac_broadcast_slot *slots, uint32_t slots_len);
+
+/* encodes a frame into the ring for every listener, like technicallyflac_frame.
+ * The oldest frames are dropped to make room. returns -1 if technicallyflac_frame fails */
+int technicallyflac_broadcast_frame(technicallyflac_broadcast *b, uint32_t num_frames, int32_t **frames);
+
+/* same as technicallyflac_broadcast_frame, with interleaved samples */
+int technicallyflac_broadcast_frame_interleaved(technicallyflac_broadcast *b, uint32_t num_frames, const void *samples, enum TECHNICALLYFLAC_FORMAT format);
+
+/* adds a listener. It gets the header and then frames starting from the next
+ * one encoded, or up to backlog frames already in the ring (so playback can
+ * start straight away) */
+void technicallyflac_broadcast_join(technicallyflac_broadcast *b, technicallyflac_listener *l, uint32_t backlog);
+
+/* points *data at the next *len bytes to send to l, which can cover more than
+ * one frame. returns 0 if there's something to send, 1 if l has everything
+ * encoded so far, or -1 if part of a frame l was sending has been overwritten
+ * (the listener has to be dropped) */
+int technicallyflac_broadcast_data(technicallyflac_broadcast *b, technicallyflac_listener *l, const uint8_t **data, uint32_t *len);
+
+/* marks len bytes from technicallyflac_broadcast_data as sent to l */
+void technicallyflac_broadcast_sent(technicallyflac_broadcast *b, technicallyflac_listener *l, uint32_t len);
+
+/* where a frame is in the ring */
+struct technicallyflac_broadcast_slot_s {
+    uint64_t start; /* counting every byte the ring has been through, see technicallyflac_broadcast_s.end */
+    uint32_t pos;   /* offset into the ring */
+    uint32_t len;
+};
+
+struct technicallyflac_broadcast_s {
+    technicallyflac *f;
+    const uint8_t *header;
+    uint32_t header_len;
+    uint8_t *ring;
+    uint32_t ring_len;
+    technicallyflac_broadcast_slot *slots;
+    uint32_t slots_len;
+    uint32_t frame_max;  /* bytes set aside for each frame */
+    uint64_t oldest;     /* first frame still in the ring */
+    uint64_t next;       /* frames encoded so far */
+    uint64_t end;        /* where the next frame goes, including the ring's wrap-arounds */
+};
+
+struct technicallyflac_listener_s {
+    uint64_t frame;  /* frame being sent */
+    uint32_t pos;    /* bytes of it (or of the header) sent */
+    uint8_t header;  /* still sending the header */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#ifdef TECHNICALLYFLAC_BROADCAST_IMPLEMENTATION
+
+static technicallyflac_broadcast_slot *technicallyflac_broadcast_slot_get(technicallyflac_broadcast *b, uint64_t frame) {
+    return &b->slots[frame % b->slots_len];
+}
+
+/* finds room for the next frame and drops the frames it'll overwrite,
+ * returns where it goes in the ring */
+static uint32_t technicallyflac_broadcast_reserve(technicallyflac_broadcast *b) {
+    uint32_t pos = (uint32_t)(b->end % b->ring_len);
+
+    /* frames never wrap around, skip the end of the ring */
+    if(b->ring_len - pos < b->frame_max) {
+        b->end += b->ring_len - pos;
+        pos = 0;
+    }
+
+    /* a byte is overwritten once the ring comes back round to it */
+    while(b->oldest < b->next &&
+      (b->next - b->oldest == b->slots_len ||
+       technicallyflac_broadcast_slot_get(b,b->oldest)->start + b->ring_len < b->end + b->frame_max)) {
+        b->oldest++;
+    }
+    return pos;
+}
+
+static void technicallyflac_broadcast_add(technicallyflac_broadcast *b, uint32_t pos, uint32_t len) {
+    technicallyflac_broadcast_slot *s = technicallyflac_broadcast_slot_get(b,b->next);
+
+    s->start = b->end;
+    s->pos = pos;
+    s->len = len;
+    b->end += len;
+    b->next++;
+}
+
+uint32_t technicallyflac_broadcast_size(const technicallyflac *f, uint32_t frames) {
+    /* plus one more, that much can be skipped at the end of the ring */
+    return (frames + 1) * technicallyflac_size_frame(f->blocksize,f->channels,f->bitdepth);
+}
+
+int technicallyflac_broadcast_init(technicallyflac_broadcast *b, technicallyflac *f, const uint8_t *header, uint32_t header_len, uint8_t *ring, uint32_t ring_len, technicallyflac_broadcast_slot *slots, uint32_t slots_len) {
+    b->f = f;
+    b->header = header;
+    b->header_len = header_len;
+    b->ring = ring;
+    b->ring_len = ring_len;
+    b->slots = slots;
+    b->slots_len = slots_len;
+    b->frame_max = technicallyflac_size_frame(f->blocksize,f->channels,f->bitdepth);
+    b->oldest = 0;
+    b->next = 0;
+    b->end = 0;
+
+    if(ring_len < b->frame_max || slots_len == 0) return -1;
+    return 0;
+}
+
+int technicallyflac_broadcast_frame(technicallyflac_broadcast *b, uint32_t num_frames, int32_t **frames) {
+    uint32_t pos = technicallyflac_broadcast_reserve(b);
+    uint32_t len = b->frame_max;
+
+    /* there's room for the whole frame, so it's written in one go */
+    if(technicallyflac_frame(b->f,&b->ring[pos],&len,num_frames,frames) != 0) return -1;
+    technicallyflac_broadcast_add(b,pos,len);
+    return 0;
+}
+
+int technicallyflac_broadcast_frame_interleaved(technicallyflac_broadcast *b, uint32_t num_frames, const void *samples, enum TECHNICALLYFLAC_FORMAT format) {
+    uint32_t pos = technicallyflac_broadcast_reserve(b);
+    uint32_t len = b->frame_max;
+
+    if(technicallyflac_frame_interleaved(b->f,&b->ring[pos],&len,num_frames,samples,format) != 0) return -1;
+    technicallyflac_broadcast_add(b,pos,len);
+    return 0;
+}
+
+void technicallyflac_broadcast_join(technicallyflac_broadcast *b, technicallyflac_listener *l, uint32_t backlog) {
+    l->frame = b->next - b->oldest < backlog ? b->oldest : b->next - backlog;
+    l->pos = 0;
+    l->header = 1;
+}
+
+int technicallyflac_broadcast_data(technicallyflac_broadcast *b, technicallyflac_listener *l, const uint8_t **data, uint32_t *len) {
+    technicallyflac_broadcast_slot *s;
+    technicallyflac_broadcast_slot *n;
+    uint64_t frame;
+
+    if(l->header) {
+        if(l->pos < b->header_len) {
+            *data = &b->header[l->pos];
+            *len = b->header_len - l->pos;
+            return 0;
+        }
+        l->header = 0;
+        l->pos = 0;
+    }
+
+    if(l->frame < b->oldest) {
+        if(l->pos != 0) return -1;
+        l->frame = b->oldest;
+    }
+    if(l->frame == b->next) return 1;
+
+    s = technicallyflac_broadcast_slot_get(b,l->frame);
+    *data = &b->ring[s->pos + l->pos];
+    *len = s->len - l->pos;
+
+    /* and the frames straight after it in the ring */
+    for(frame=l->frame+1;frame<b->next;frame++) {
+        n = technicallyflac_broadcast_slot_get(b,frame);
+        if(n->pos != s->pos + s->len) break;
+        *len += n->len;
+        s = n;
+    }
+    return 0;
+}
+
+void technicallyflac_broadcast_sent(technicallyflac_broadcast *b, technicallyflac_listener *l, uint32_t len) {
+    technicallyflac_broadcast_slot *s;
+
+    l->pos += len;
+    if(l->header) return;
+
+    while(l->frame < b->next) {
+        s = technicallyflac_broadcast_slot_get(b,l->frame);
+        if(l->pos < s->len) break;
+        l->pos -= s->len;
+        l->frame++;
+    }
+}
+
+#endif
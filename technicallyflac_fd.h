@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2020 John Regan
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+Metadata blocks from file descriptors, on top of technicallyflac.h.
+
+Cover art and cue sheets usually already live in a file. These write a
+metadata block straight from a file descriptor without loading it:
+
+  * technicallyflac_fd_read is a technicallyflac_read_func for
+    technicallyflac_metadata_read, for when the block goes into your own
+    buffers (eg. to be put in Ogg pages)
+  * technicallyflac_fd_metadata writes a whole block to another file
+    descriptor, on Linux the kernel copies it (copy_file_range if
+    _GNU_SOURCE is defined, otherwise sendfile)
+  * technicallyflac_fd_copy copies part of a file, for blocks made of
+    more than one piece (a PICTURE's fields, then the image file)
+
+Unlike technicallyflac.h this uses POSIX I/O, so it's kept in its own file.
+In one C file define TECHNICALLYFLAC_FD_IMPLEMENTATION before including it.
+*/
+
+#ifndef TECHNICALLYFLAC_FD_H
+#define TECHNICALLYFLAC_FD_H
+
+#ifndef TECHNICALLYFLAC_H
+#include "technicallyflac.h"
+#endif
+
+#include <sys/types.h>
+
+typedef struct technicallyflac_fd_source_s technicallyflac_fd_source;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* where technicallyflac_fd_read reads from, offset moves along as it reads */
+struct technicallyflac_fd_source_s {
+    int fd;
+    off_t offset;
+};
+
+/* a technicallyflac_read_func, userdata is a technicallyflac_fd_source.
+ * returns 0 on an error or at the end of the file */
+uint32_t technicallyflac_fd_read(uint8_t *buffer, uint32_t len, void *userdata);
+
+/* copies len bytes at offset in in_fd to the current position of out_fd.
+ * returns -1 on an error (with errno set) or if in_fd is too short */
+int technicallyflac_fd_copy(int out_fd, int in_fd, off_t offset, uint32_t len);
+
+/* writes a metadata block to out_fd, the block is block_length bytes at offset
+ * in in_fd. returns -1 on an error (with errno set) or if in_fd is too short */
+int technicallyflac_fd_metadata(technicallyflac *f, int out_fd, uint8_t last_flag, uint8_t block_type, int in_fd, off_t offset, uint32_t block_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#ifdef TECHNICALLYFLAC_FD_IMPLEMENTATION
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/* size of the bounce buffer when the kernel can't copy for us */
+#define TECHNICALLYFLAC_FD_BUFFER 16384
+
+static int technicallyflac_fd_write(int fd, const uint8_t *buffer, uint32_t len) {
+    ssize_t r;
+
+    while(len) {
+        r = write(fd,buffer,len);
+        if(r < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        buffer += r;
+        len -= (uint32_t)r;
+    }
+    return 0;
+}
+
+uint32_t technicallyflac_fd_read(uint8_t *buffer, uint32_t len, void *userdata) {
+    technicallyflac_fd_source *src = (technicallyflac_fd_source *)userdata;
+    ssize_t r;
+
+    do {
+        r = pread(src->fd,buffer,len,src->offset);
+    } while(r < 0 && errno == EINTR);
+
+    if(r <= 0) return 0;
+    src->offset += r;
+    return (uint32_t)r;
+}
+
+#ifdef __linux__
+/* lets the kernel do the copy, returns the bytes that are left, or -1
+ * on an error other than the kernel not supporting it for these files */
+static int64_t technicallyflac_fd_copy_kernel(int out_fd, int in_fd, off_t *offset, uint32_t len) {
+    ssize_t r;
+
+    while(len) {
+#ifdef _GNU_SOURCE
+        r = copy_file_range(in_fd,offset,out_fd,NULL,len,0);
+        if(r < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF)) {
+            r = sendfile(out_fd,in_fd,offset,len);
+        }
+#else
+        r = sendfile(out_fd,in_fd,offset,len);
+#endif
+        if(r < 0) {
+            if(errno == EINTR) continue;
+            if(errno == EINVAL || errno == ENOSYS) break;
+            return -1;
+        }
+        if(r == 0) {
+            /* in_fd ended early */
+            errno = EIO;
+            return -1;
+        }
+        len -= (uint32_t)r;
+    }
+    return len;
+}
+#endif
+
+int technicallyflac_fd_copy(int out_fd, int in_fd, off_t offset, uint32_t len) {
+    uint8_t buffer[TECHNICALLYFLAC_FD_BUFFER];
+    technicallyflac_fd_source src;
+    uint32_t n;
+
+#ifdef __linux__
+    int64_t left = technicallyflac_fd_copy_kernel(out_fd,in_fd,&offset,len);
+    if(left < 0) return -1;
+    len = (uint32_t)left;
+#endif
+
+    src.fd = in_fd;
+    src.offset = offset;
+
+    while(len) {
+        n = technicallyflac_fd_read(buffer,len < sizeof(buffer) ? len : sizeof(buffer),&src);
+        if(n == 0) {
+            errno = EIO;
+            return -1;
+        }
+        if(technicallyflac_fd_write(out_fd,buffer,n) != 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+int technicallyflac_fd_metadata(technicallyflac *f, int out_fd, uint8_t last_flag, uint8_t block_type, int in_fd, off_t offset, uint32_t block_length) {
+    uint8_t header[4];
+    uint32_t len = sizeof(header);
+
+    if(technicallyflac_metadata_header(f,header,&len,last_flag,block_type,block_length) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if(technicallyflac_fd_write(out_fd,header,len) != 0) return -1;
+    return technicallyflac_fd_copy(out_fd,in_fd,offset,block_length);
+}
+
+#undef TECHNICALLYFLAC_FD_BUFFER
+
+#endif
@@ -0,0 +1,269 @@
+/*
+Copyright (c) 2020 John Regan
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+Writing frames straight into a memory-mapped file, on top of technicallyflac.h.
+
+When the number of samples is known up front, so is the size of every
+uncompressed frame and where it goes (see technicallyflac_frame_offset).
+technicallyflac_mmap_init sizes the output file, maps it and writes the
+streammarker and metadata. After that frame N can be encoded in place at
+any time, from any thread, in any order: every frame has its own range of
+the file and nothing else is shared. technicallyflac_mmap_finish fills in
+STREAMINFO and the SEEKTABLE and unmaps the file.
+
+Frame sizes are only known without the flags that compress frames
+(TECHNICALLYFLAC_FLAG_FIXED, CONSTANT and WASTED), and the MD5 needs the
+audio in order, so those flags can't be used. STREAMINFO's MD5 is left
+as zeroes, which means it wasn't computed.
+
+Unlike technicallyflac.h this uses POSIX I/O and mmap, so it's kept in its
+own file. In one C file define TECHNICALLYFLAC_MMAP_IMPLEMENTATION before
+including it.
+*/
+
+#ifndef TECHNICALLYFLAC_MMAP_H
+#define TECHNICALLYFLAC_MMAP_H
+
+#ifndef TECHNICALLYFLAC_H
+#include "technicallyflac.h"
+#endif
+
+typedef struct technicallyflac_mmap_s technicallyflac_mmap;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* sets the file open for reading and writing at fd to the size of a stream of
+ * total_samples samples (per channel) from f, maps it and writes the streammarker,
+ * STREAMINFO, a SEEKTABLE if f has seek points (see technicallyflac_set_seektable)
+ * and metadata, metadata_len bytes of any other blocks (written with
+ * technicallyflac_metadata, the last one with last_flag set). f should be set up
+ * and not have written any frames. returns -1 on an error (with errno set) or
+ * if f has flags this can't be used with */
+int technicallyflac_mmap_init(technicallyflac_mmap *m, technicallyflac *f, int fd, uint64_t total_samples, const uint8_t *metadata, uint32_t metadata_len);
+
+/* returns the number of frames in the stream, frames are numbered from 0 */
+uint64_t technicallyflac_mmap_frames(const technicallyflac_mmap *m);
+
+/* encodes frame n in place, like technicallyflac_frame. frames points at the
+ * frame's samples, the blocksize of them or what's left for the last frame.
+ * Can be called from any thread, as long as two threads don't write the same
+ * frame. returns -1 if n is past the end or technicallyflac_frame fails */
+int technicallyflac_mmap_frame(technicallyflac_mmap *m, uint64_t n, int32_t **frames);
+
+/* same as technicallyflac_mmap_frame, with interleaved samples */
+int technicallyflac_mmap_frame_interleaved(technicallyflac_mmap *m, uint64_t n, const void *samples, enum TECHNICALLYFLAC_FORMAT format);
+
+/* once every frame is written, adds them to the STREAMINFO totals of f,
+ * writes STREAMINFO and the SEEKTABLE over the first ones and unmaps the
+ * file (fd stays open). returns -1 on an error (with errno set) */
+int technicallyflac_mmap_finish(technicallyflac_mmap *m);
+
+struct technicallyflac_mmap_s {
+    technicallyflac *f;
+    uint8_t *map;
+    size_t len;
+    uint64_t total_samples;
+    uint64_t frames;
+    uint32_t header_len;     /* streammarker and metadata, the first frame starts here */
+    uint32_t seektable_pos;  /* where the SEEKTABLE block is, 0 if there isn't one */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#ifdef TECHNICALLYFLAC_MMAP_IMPLEMENTATION
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#define TECHNICALLYFLAC_MMAP_UNSUPPORTED (TECHNICALLYFLAC_FLAG_FIXED | TECHNICALLYFLAC_FLAG_CONSTANT | TECHNICALLYFLAC_FLAG_WASTED | TECHNICALLYFLAC_FLAG_MD5)
+
+/* the number of samples in frame n */
+static uint32_t technicallyflac_mmap_samples(const technicallyflac_mmap *m, uint64_t n) {
+    uint64_t start = n * m->f->blocksize;
+
+    if(m->total_samples - start < m->f->blocksize) {
+        return (uint32_t)(m->total_samples - start);
+    }
+    return m->f->blocksize;
+}
+
+/* a copy of f set up to write frame n, frames only depend on each other
+ * through their number */
+static void technicallyflac_mmap_encoder(const technicallyflac_mmap *m, uint64_t n, technicallyflac *e) {
+    *e = *m->f;
+    e->seekpoints_len = 0;
+    e->frameindex = (uint32_t)(n % 0x80000000);
+    e->sampleindex = (n * e->blocksize) & 0xFFFFFFFFF;
+}
+
+/* points output at frame n and sets *bytes to its size */
+static uint8_t *technicallyflac_mmap_output(const technicallyflac_mmap *m, uint64_t n, uint32_t *bytes) {
+    uint64_t pos = technicallyflac_frame_offset(m->f,n);
+
+    if(n + 1 < m->frames) {
+        *bytes = (uint32_t)(technicallyflac_frame_offset(m->f,n + 1) - pos);
+    } else {
+        *bytes = (uint32_t)(technicallyflac_stream_size(m->f,m->total_samples) - pos);
+    }
+    return &m->map[m->header_len + pos];
+}
+
+/* checks a frame came out the size it was given */
+static int technicallyflac_mmap_check(int r, uint32_t bytes, uint32_t expected) {
+    if(r != 0 || bytes != expected) return -1;
+    return 0;
+}
+
+int technicallyflac_mmap_init(technicallyflac_mmap *m, technicallyflac *f, int fd, uint64_t total_samples, const uint8_t *metadata, uint32_t metadata_len) {
+    uint64_t size;
+    uint32_t pos;
+    uint32_t len;
+    void *map;
+
+    if(f->flags & TECHNICALLYFLAC_MMAP_UNSUPPORTED || f->fr_state.state != TECHNICALLYFLAC_FRAME_START ||
+       total_samples == 0 || total_samples > 0xFFFFFFFFF) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    m->f = f;
+    m->total_samples = total_samples;
+    m->frames = (total_samples + f->blocksize - 1) / f->blocksize;
+    m->header_len = technicallyflac_size_streammarker() + technicallyflac_size_streaminfo() + metadata_len;
+    m->seektable_pos = 0;
+    if(f->seekpoints_len) {
+        m->seektable_pos = technicallyflac_size_streammarker() + technicallyflac_size_streaminfo();
+        m->header_len += technicallyflac_size_seektable(f->seekpoints_len);
+    }
+
+    size = m->header_len + technicallyflac_stream_size(f,total_samples);
+    if(size != (uint64_t)(size_t)size || size != (uint64_t)(off_t)size) {
+        errno = EFBIG;
+        return -1;
+    }
+    m->len = (size_t)size;
+
+    if(ftruncate(fd,(off_t)size) != 0) return -1;
+#if defined(__linux__) && defined(_GNU_SOURCE)
+    /* set the blocks aside now, so a full disk shows up here and not as
+     * SIGBUS on a write to the map. Filesystems without it just get the
+     * size from ftruncate */
+    if(fallocate(fd,0,0,(off_t)size) != 0 && errno != EOPNOTSUPP && errno != ENOSYS) return -1;
+#endif
+
+    map = mmap(NULL,m->len,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    if(map == MAP_FAILED) return -1;
+    m->map = (uint8_t *)map;
+
+    /* the buffers are big enough, each is written in one go */
+    pos = 0;
+    len = technicallyflac_size_streammarker();
+    technicallyflac_streammarker(f,&m->map[pos],&len);
+    pos += len;
+
+    len = technicallyflac_size_streaminfo();
+    technicallyflac_streaminfo(f,&m->map[pos],&len,m->seektable_pos == 0 && metadata_len == 0);
+    pos += len;
+
+    if(m->seektable_pos) {
+        len = technicallyflac_size_seektable(f->seekpoints_len);
+        technicallyflac_seektable(f,&m->map[pos],&len,metadata_len == 0);
+        pos += len;
+    }
+
+    if(metadata_len) memcpy(&m->map[pos],metadata,metadata_len);
+    return 0;
+}
+
+uint64_t technicallyflac_mmap_frames(const technicallyflac_mmap *m) {
+    return m->frames;
+}
+
+int technicallyflac_mmap_frame(technicallyflac_mmap *m, uint64_t n, int32_t **frames) {
+    technicallyflac e;
+    uint8_t *output;
+    uint32_t expected;
+    uint32_t bytes;
+    int r;
+
+    if(n >= m->frames) return -1;
+
+    technicallyflac_mmap_encoder(m,n,&e);
+    output = technicallyflac_mmap_output(m,n,&expected);
+    bytes = expected;
+    r = technicallyflac_frame(&e,output,&bytes,technicallyflac_mmap_samples(m,n),frames);
+    return technicallyflac_mmap_check(r,bytes,expected);
+}
+
+int technicallyflac_mmap_frame_interleaved(technicallyflac_mmap *m, uint64_t n, const void *samples, enum TECHNICALLYFLAC_FORMAT format) {
+    technicallyflac e;
+    uint8_t *output;
+    uint32_t expected;
+    uint32_t bytes;
+    int r;
+
+    if(n >= m->frames) return -1;
+
+    technicallyflac_mmap_encoder(m,n,&e);
+    output = technicallyflac_mmap_output(m,n,&expected);
+    bytes = expected;
+    r = technicallyflac_frame_interleaved(&e,output,&bytes,technicallyflac_mmap_samples(m,n),samples,format);
+    return technicallyflac_mmap_check(r,bytes,expected);
+}
+
+int technicallyflac_mmap_finish(technicallyflac_mmap *m) {
+    technicallyflac *f = m->f;
+    uint32_t bytes;
+    uint32_t len;
+    uint64_t n;
+    int r = 0;
+
+    /* without the MD5 the totals and seek points only need the sizes */
+    for(n=0;n<m->frames;n++) {
+        technicallyflac_mmap_output(m,n,&bytes);
+        technicallyflac_streaminfo_track(f,technicallyflac_mmap_samples(m,n),bytes,NULL);
+    }
+    f->frameindex = (uint32_t)(m->frames % 0x80000000);
+    f->sampleindex = m->total_samples & 0xFFFFFFFFF;
+
+    len = technicallyflac_size_streaminfo() - 4;
+    technicallyflac_streaminfo_finalize(f,&m->map[8],&len);
+
+    if(m->seektable_pos) {
+        /* the last-block flag is already in the first one */
+        len = technicallyflac_size_seektable(f->seekpoints_len);
+        technicallyflac_seektable(f,&m->map[m->seektable_pos],&len,m->map[m->seektable_pos] >> 7);
+    }
+
+    if(msync(m->map,m->len,MS_SYNC) != 0) r = -1;
+    if(munmap(m->map,m->len) != 0) r = -1;
+    m->map = NULL;
+    return r;
+}
+
+#undef TECHNICALLYFLAC_MMAP_UNSUPPORTED
+
+#endif
@@ -0,0 +1,396 @@
+/*
+Copyright (c) 2020 John Regan
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+Multi-threaded batch encoding on top of technicallyflac.h.
+
+Frames only depend on each other through the frame number, so a batch of
+blocks can be handed out to a pool of threads, each with its own copy of
+the encoder and its frame number worked out ahead of time. The frames come
+back in order.
+
+Unlike technicallyflac.h this uses pthreads and the C library (malloc,
+memmove), so it's kept in its own file. In one C file define
+TECHNICALLYFLAC_MT_IMPLEMENTATION before including it.
+*/
+
+#ifndef TECHNICALLYFLAC_MT_H
+#define TECHNICALLYFLAC_MT_H
+
+#ifndef TECHNICALLYFLAC_H
+#include "technicallyflac.h"
+#endif
+
+#include <pthread.h>
+
+typedef struct technicallyflac_mt_s technicallyflac_mt;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* returns the number of bytes needed for the output buffer to encode
+ * num_samples samples (per channel) in one batch */
+size_t technicallyflac_mt_size(const technicallyflac *f, size_t num_samples);
+
+/* starts a pool of threads encoding with the settings of f, which should
+ * already be set up (technicallyflac_init, technicallyflac_set_flags).
+ * Each thread gets its own workspace. returns -1 on failure */
+int technicallyflac_mt_init(technicallyflac_mt *mt, technicallyflac *f, unsigned int threads);
+
+/* encodes num_samples samples (per channel) as consecutive frames, like calling
+ * technicallyflac_frame once per block. Only the last frame of a stream
+ * should be shorter than the blocksize. output should be at least
+ * technicallyflac_mt_size bytes, *bytes is set to the number of bytes written.
+ * If lengths is not NULL it gets the size of each frame. The frames are added
+ * to the STREAMINFO totals of f, see technicallyflac_streaminfo_finalize.
+ * Must be called between frames, returns -1 if f is in the middle of one.
+ * With TECHNICALLYFLAC_FLAG_VERIFY also returns -1 if any frame failed to
+ * verify, the batch is still written out */
+int technicallyflac_mt_frames(technicallyflac_mt *mt, uint8_t *output, size_t *bytes, size_t num_samples, int32_t **frames, uint32_t *lengths);
+
+/* same as technicallyflac_mt_frames but reads interleaved PCM, see technicallyflac_frame_interleaved */
+int technicallyflac_mt_frames_interleaved(technicallyflac_mt *mt, uint8_t *output, size_t *bytes, size_t num_samples, const void *samples, enum TECHNICALLYFLAC_FORMAT format, uint32_t *lengths);
+
+/* stops the threads and frees everything allocated by technicallyflac_mt_init */
+void technicallyflac_mt_free(technicallyflac_mt *mt);
+
+struct technicallyflac_mt_s {
+    technicallyflac *f;
+
+    unsigned int threads;   /* threads running */
+    pthread_t *workers;
+    void **workspaces;      /* one per thread */
+    unsigned int workspaces_len;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start; /* a batch is ready or it's time to quit */
+    pthread_cond_t done;  /* a frame is finished */
+    int quit;
+
+    /* the current batch */
+    technicallyflac encoder;  /* f as it was when the batch started */
+    uint8_t *output;
+    uint32_t slot;            /* bytes set aside for each frame */
+    size_t num_samples;
+    int32_t **planar;
+    const uint8_t *interleaved;
+    enum TECHNICALLYFLAC_FORMAT format;
+    uint32_t stride;          /* bytes per interleaved frame */
+    uint32_t blocks;
+    uint32_t next;            /* next block to hand out */
+    uint32_t *lengths;        /* 0 until a block's frame is done */
+    uint32_t lengths_len;
+    int failed;               /* a frame in the batch returned an error */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#ifdef TECHNICALLYFLAC_MT_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+struct technicallyflac_mt_worker_s {
+    technicallyflac_mt *mt;
+    unsigned int id;
+};
+
+static uint32_t technicallyflac_mt_blocks(const technicallyflac *f, size_t num_samples) {
+    return (uint32_t)((num_samples + f->blocksize - 1) / f->blocksize);
+}
+
+static uint32_t technicallyflac_mt_samplesize(enum TECHNICALLYFLAC_FORMAT format) {
+    switch(format) {
+        case TECHNICALLYFLAC_FORMAT_S16LE: /* fall-through */
+        case TECHNICALLYFLAC_FORMAT_S16BE: return 2;
+        case TECHNICALLYFLAC_FORMAT_S24LE: /* fall-through */
+        case TECHNICALLYFLAC_FORMAT_S24BE: return 3;
+        default: break;
+    }
+    return 4;
+}
+
+/* encodes one block of the current batch into its slot, returns what technicallyflac_frame did */
+static int technicallyflac_mt_encode(technicallyflac_mt *mt, unsigned int id, uint32_t block, uint32_t *len) {
+    technicallyflac e = mt->encoder;
+    int32_t *planar[8];
+    size_t start = (size_t)block * e.blocksize;
+    uint32_t num_frames = e.blocksize;
+    uint8_t *output = &mt->output[(size_t)block * mt->slot];
+    uint8_t i;
+
+    if(mt->num_samples - start < num_frames) {
+        num_frames = (uint32_t)(mt->num_samples - start);
+    }
+
+    /* the MD5 and seek points have to see the blocks in order, technicallyflac_mt_run adds them */
+    e.flags &= ~(uint32_t)TECHNICALLYFLAC_FLAG_MD5;
+    e.seekpoints_len = 0;
+    e.workspace = mt->workspaces[id];
+    e.frameindex = (uint32_t)((e.frameindex + (uint64_t)block) % 0x80000000);
+    e.sampleindex = (e.sampleindex + start) & 0xFFFFFFFFF;
+
+    if(mt->planar != NULL) {
+        for(i=0;i<e.fr_state.subframe.channels;i++) {
+            planar[i] = &mt->planar[i][start];
+        }
+        return technicallyflac_frame(&e,output,len,num_frames,planar);
+    }
+    return technicallyflac_frame_interleaved(&e,output,len,num_frames,&mt->interleaved[start * mt->stride],mt->format);
+}
+
+static void *technicallyflac_mt_worker(void *arg) {
+    struct technicallyflac_mt_worker_s *w = (struct technicallyflac_mt_worker_s *)arg;
+    technicallyflac_mt *mt = w->mt;
+    unsigned int id = w->id;
+    uint32_t block;
+    uint32_t len;
+    int r;
+
+    free(w);
+
+    pthread_mutex_lock(&mt->lock);
+    while(!mt->quit) {
+        if(mt->next == mt->blocks) {
+            pthread_cond_wait(&mt->start,&mt->lock);
+            continue;
+        }
+        block = mt->next++;
+        pthread_mutex_unlock(&mt->lock);
+
+        len = mt->slot;
+        r = technicallyflac_mt_encode(mt,id,block,&len);
+
+        pthread_mutex_lock(&mt->lock);
+        if(r != 0) mt->failed = 1;
+        mt->lengths[block] = len;
+        pthread_cond_signal(&mt->done);
+    }
+    pthread_mutex_unlock(&mt->lock);
+    return NULL;
+}
+
+/* adds a finished block to the STREAMINFO totals of f */
+static void technicallyflac_mt_track(technicallyflac_mt *mt, uint32_t block, uint32_t len) {
+    int32_t *planar[8];
+    size_t start = (size_t)block * mt->f->blocksize;
+    uint32_t num_frames = mt->f->blocksize;
+    uint8_t i;
+
+    if(mt->num_samples - start < num_frames) {
+        num_frames = (uint32_t)(mt->num_samples - start);
+    }
+
+    if(mt->planar != NULL) {
+        for(i=0;i<mt->f->fr_state.subframe.channels;i++) {
+            planar[i] = &mt->planar[i][start];
+        }
+        technicallyflac_streaminfo_track(mt->f,num_frames,len,planar);
+    } else {
+        technicallyflac_streaminfo_track_interleaved(mt->f,num_frames,len,&mt->interleaved[start * mt->stride],mt->format);
+    }
+}
+
+/* hands the batch to the workers, then moves each frame down next to the
+ * previous one and adds it to the STREAMINFO totals as soon as it's done.
+ * A frame only ever moves into its own slot or earlier ones, so this can't
+ * clobber a frame still being written */
+static int technicallyflac_mt_run(technicallyflac_mt *mt, uint8_t *output, size_t *bytes, uint32_t *lengths) {
+    size_t pos = 0;
+    uint32_t block;
+    uint32_t len;
+    int failed;
+
+    pthread_mutex_lock(&mt->lock);
+    pthread_cond_broadcast(&mt->start);
+
+    for(block=0;block<mt->blocks;block++) {
+        while(mt->lengths[block] == 0) {
+            pthread_cond_wait(&mt->done,&mt->lock);
+        }
+        len = mt->lengths[block];
+        pthread_mutex_unlock(&mt->lock);
+
+        memmove(&output[pos],&output[(size_t)block * mt->slot],len);
+        pos += len;
+        if(lengths != NULL) lengths[block] = len;
+        technicallyflac_mt_track(mt,block,len);
+
+        pthread_mutex_lock(&mt->lock);
+    }
+    mt->blocks = 0;
+    mt->next = 0;
+    failed = mt->failed;
+    mt->failed = 0;
+    pthread_mutex_unlock(&mt->lock);
+
+    mt->f->frameindex = (uint32_t)((mt->f->frameindex + (uint64_t)block) % 0x80000000);
+    mt->f->sampleindex = (mt->f->sampleindex + mt->num_samples) & 0xFFFFFFFFF;
+    *bytes = pos;
+    return failed ? -1 : 0;
+}
+
+static int technicallyflac_mt_setup(technicallyflac_mt *mt, uint8_t *output, size_t num_samples) {
+    uint32_t blocks;
+    uint32_t *l;
+
+    if(mt->f->fr_state.state != TECHNICALLYFLAC_FRAME_START) {
+        return -1;
+    }
+
+    blocks = technicallyflac_mt_blocks(mt->f,num_samples);
+    if(blocks > mt->lengths_len) {
+        l = (uint32_t *)realloc(mt->lengths,sizeof(uint32_t) * blocks);
+        if(l == NULL) return -1;
+        mt->lengths = l;
+        mt->lengths_len = blocks;
+    }
+
+    for(l=mt->lengths;l<&mt->lengths[blocks];l++) {
+        *l = 0;
+    }
+
+    /* called with the lock held, workers pick the batch up as soon as it's released */
+    mt->encoder = *mt->f;
+    mt->output = output;
+    mt->slot = technicallyflac_size_frame(mt->f->blocksize,mt->f->channels,mt->f->bitdepth);
+    mt->num_samples = num_samples;
+    mt->next = 0;
+    mt->blocks = blocks;
+    return 0;
+}
+
+size_t technicallyflac_mt_size(const technicallyflac *f, size_t num_samples) {
+    return (size_t)technicallyflac_mt_blocks(f,num_samples) * technicallyflac_size_frame(f->blocksize,f->channels,f->bitdepth);
+}
+
+int technicallyflac_mt_init(technicallyflac_mt *mt, technicallyflac *f, unsigned int threads) {
+    struct technicallyflac_mt_worker_s *w;
+    unsigned int i;
+
+    if(threads == 0) threads = 1;
+
+    mt->f = f;
+    mt->threads = 0;
+    mt->quit = 0;
+    mt->blocks = 0;
+    mt->next = 0;
+    mt->failed = 0;
+    mt->lengths = NULL;
+    mt->lengths_len = 0;
+    mt->workspaces_len = threads;
+
+    pthread_mutex_init(&mt->lock,NULL);
+    pthread_cond_init(&mt->start,NULL);
+    pthread_cond_init(&mt->done,NULL);
+
+    mt->workers = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+    mt->workspaces = (void **)calloc(threads,sizeof(void *));
+    if(mt->workers == NULL || mt->workspaces == NULL) {
+        technicallyflac_mt_free(mt);
+        return -1;
+    }
+
+    for(i=0;i<threads;i++) {
+        /* malloc'd memory is aligned for a uint64_t, as technicallyflac_set_workspace wants */
+        mt->workspaces[i] = malloc(technicallyflac_size_workspace(f->blocksize));
+        if(mt->workspaces[i] == NULL) {
+            technicallyflac_mt_free(mt);
+            return -1;
+        }
+    }
+
+    for(i=0;i<threads;i++) {
+        w = (struct technicallyflac_mt_worker_s *)malloc(sizeof(struct technicallyflac_mt_worker_s));
+        if(w == NULL) {
+            technicallyflac_mt_free(mt);
+            return -1;
+        }
+        w->mt = mt;
+        w->id = i;
+        if(pthread_create(&mt->workers[i],NULL,technicallyflac_mt_worker,w) != 0) {
+            free(w);
+            technicallyflac_mt_free(mt);
+            return -1;
+        }
+        mt->threads++;
+    }
+
+    return 0;
+}
+
+int technicallyflac_mt_frames(technicallyflac_mt *mt, uint8_t *output, size_t *bytes, size_t num_samples, int32_t **frames, uint32_t *lengths) {
+    int r;
+
+    pthread_mutex_lock(&mt->lock);
+    r = technicallyflac_mt_setup(mt,output,num_samples);
+    mt->planar = frames;
+    mt->interleaved = NULL;
+    pthread_mutex_unlock(&mt->lock);
+
+    if(r != 0) return r;
+    return technicallyflac_mt_run(mt,output,bytes,lengths);
+}
+
+int technicallyflac_mt_frames_interleaved(technicallyflac_mt *mt, uint8_t *output, size_t *bytes, size_t num_samples, const void *samples, enum TECHNICALLYFLAC_FORMAT format, uint32_t *lengths) {
+    int r;
+
+    pthread_mutex_lock(&mt->lock);
+    r = technicallyflac_mt_setup(mt,output,num_samples);
+    mt->planar = NULL;
+    mt->interleaved = (const uint8_t *)samples;
+    mt->format = format;
+    mt->stride = technicallyflac_mt_samplesize(format) * mt->f->fr_state.subframe.channels;
+    pthread_mutex_unlock(&mt->lock);
+
+    if(r != 0) return r;
+    return technicallyflac_mt_run(mt,output,bytes,lengths);
+}
+
+void technicallyflac_mt_free(technicallyflac_mt *mt) {
+    unsigned int i;
+
+    pthread_mutex_lock(&mt->lock);
+    mt->quit = 1;
+    pthread_cond_broadcast(&mt->start);
+    pthread_mutex_unlock(&mt->lock);
+
+    for(i=0;i<mt->threads;i++) {
+        pthread_join(mt->workers[i],NULL);
+    }
+
+    for(i=0;mt->workspaces != NULL && i<mt->workspaces_len;i++) {
+        free(mt->workspaces[i]);
+    }
+
+    pthread_cond_destroy(&mt->done);
+    pthread_cond_destroy(&mt->start);
+    pthread_mutex_destroy(&mt->lock);
+
+    free(mt->lengths);
+    free(mt->workspaces);
+    free(mt->workers);
+    mt->lengths = NULL;
+    mt->workspaces = NULL;
+    mt->workers = NULL;
+    mt->threads = 0;
+}
+
+#endif
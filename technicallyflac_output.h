@@ -0,0 +1,601 @@
+/*
+Copyright (c) 2020 John Regan
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+Asynchronous output for many streams at once, to go with technicallyflac.h.
+
+Writing every frame with its own blocking write costs a system call per
+frame per stream, and the encoder waits on each one. This keeps a pool of
+buffers instead: frames from any number of technicallyflac objects are
+written into buffers, each buffer is queued with the file descriptor and
+offset it goes to, and technicallyflac_output_submit starts every queued
+write at once. A buffer comes back to the pool when its write is done.
+
+On Linux the writes go through io_uring, with the buffers registered with
+the kernel so they aren't mapped for every write: a whole batch is one
+system call. Where io_uring isn't there (an older kernel, or it's turned
+off) a pool of threads does the writes, waiting with poll on
+non-blocking file descriptors. Define TECHNICALLYFLAC_OUTPUT_NO_URING to
+always use the threads.
+
+Writes with an offset can finish in any order. Writes to the current
+position of a file, a pipe or a socket (offset -1) can too, so only have
+one of those in flight per file descriptor at a time.
+
+Call everything from one thread (or hold a lock). Unlike technicallyflac.h
+this uses pthreads and the C library, so it's kept in its own file. In one
+C file define TECHNICALLYFLAC_OUTPUT_IMPLEMENTATION before including it
+(with _GNU_SOURCE defined on Linux, for syscall).
+*/
+
+#ifndef TECHNICALLYFLAC_OUTPUT_H
+#define TECHNICALLYFLAC_OUTPUT_H
+
+#ifndef TECHNICALLYFLAC_H
+#include "technicallyflac.h"
+#endif
+
+#include <pthread.h>
+
+typedef struct technicallyflac_output_s technicallyflac_output;
+typedef struct technicallyflac_output_slot_s technicallyflac_output_slot;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* sets up buffers buffers of buffer_len bytes each, eg. technicallyflac_size_frame
+ * bytes to write one frame per buffer. threads is the number of threads doing
+ * the writes if io_uring can't be used. returns -1 on failure */
+int technicallyflac_output_init(technicallyflac_output *o, uint32_t buffers, uint32_t buffer_len, unsigned int threads);
+
+/* returns a buffer of buffer_len bytes to write frames into. If they're all in
+ * use it submits anything queued and waits for a write to finish. returns
+ * NULL if io_uring stops working */
+uint8_t *technicallyflac_output_buffer(technicallyflac_output *o);
+
+/* queues the first len bytes of buffer (from technicallyflac_output_buffer)
+ * to be written to fd at offset, or at the current position with an offset
+ * of -1. Nothing is written until technicallyflac_output_submit, after that
+ * the buffer belongs to the output until the write is done */
+void technicallyflac_output_queue(technicallyflac_output *o, uint8_t *buffer, uint32_t len, int fd, int64_t offset);
+
+/* starts every queued write and takes back the buffers of the ones that are
+ * done, without waiting. returns -1 if a write has failed (see o->error) */
+int technicallyflac_output_submit(technicallyflac_output *o);
+
+/* submits and waits for every write to finish. returns -1 if a write has
+ * failed (see o->error) */
+int technicallyflac_output_flush(technicallyflac_output *o);
+
+/* waits for the writes and frees everything allocated by technicallyflac_output_init */
+void technicallyflac_output_free(technicallyflac_output *o);
+
+struct technicallyflac_output_slot_s {
+    int fd;
+    int64_t offset;  /* where the rest of it goes, -1 for the current position */
+    uint32_t pos;    /* bytes written so far */
+    uint32_t len;
+    uint32_t next;   /* the next buffer in the same list */
+};
+
+struct technicallyflac_output_s {
+    uint8_t *memory;          /* every buffer, one after another */
+    uint32_t buffer_len;
+    technicallyflac_output_slot *buffers;
+    uint32_t buffers_len;
+    uint32_t free;            /* buffers ready to use */
+    uint32_t queued;          /* queued and not submitted yet, first and last */
+    uint32_t queued_last;
+    uint32_t busy;            /* buffers queued or being written */
+    int error;                /* errno of the first write that failed, 0 if none */
+    int error_fd;             /* and the file descriptor it was writing to */
+
+    pthread_mutex_t lock;
+    pthread_cond_t done;      /* a write has finished */
+
+    int uring;                /* writes go through io_uring, otherwise the threads */
+
+    /* io_uring */
+    int ring_fd;
+    int registered;           /* the buffers are registered, writes use IORING_OP_WRITE_FIXED */
+    void *sq_ring;
+    size_t sq_ring_len;
+    void *cq_ring;
+    size_t cq_ring_len;
+    void *sqes;
+    size_t sqes_len;
+    void *cqes;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    uint32_t sq_pending;      /* entries added since the last io_uring_enter */
+
+    /* threads */
+    pthread_t *workers;
+    unsigned int threads;     /* threads running */
+    pthread_cond_t work;      /* there's something to write or it's time to quit */
+    uint32_t work_first;      /* submitted, waiting for a thread */
+    uint32_t work_last;
+    int quit;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#ifdef TECHNICALLYFLAC_OUTPUT_IMPLEMENTATION
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && !defined(TECHNICALLYFLAC_OUTPUT_NO_URING)
+#define TECHNICALLYFLAC_OUTPUT_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#define TECHNICALLYFLAC_OUTPUT_NONE 0xFFFFFFFF
+
+/* adds buffer b to the end of a list */
+static void technicallyflac_output_append(technicallyflac_output *o, uint32_t *first, uint32_t *last, uint32_t b) {
+    o->buffers[b].next = TECHNICALLYFLAC_OUTPUT_NONE;
+    if(*first == TECHNICALLYFLAC_OUTPUT_NONE) {
+        *first = b;
+    } else {
+        o->buffers[*last].next = b;
+    }
+    *last = b;
+}
+
+/* a write is finished, called with the lock held */
+static void technicallyflac_output_done(technicallyflac_output *o, uint32_t b, int error) {
+    if(error && o->error == 0) {
+        o->error = error;
+        o->error_fd = o->buffers[b].fd;
+    }
+    o->buffers[b].next = o->free;
+    o->free = b;
+    o->busy--;
+    pthread_cond_signal(&o->done);
+}
+
+/* some of the buffer went out, returns 1 if there's more to write */
+static int technicallyflac_output_wrote(technicallyflac_output *o, uint32_t b, size_t len) {
+    technicallyflac_output_slot *buf = &o->buffers[b];
+
+    buf->pos += (uint32_t)len;
+    if(buf->offset != -1) buf->offset += len;
+    return buf->pos < buf->len;
+}
+
+#ifdef TECHNICALLYFLAC_OUTPUT_URING
+
+static int technicallyflac_output_uring_enter(technicallyflac_output *o, uint32_t submit, uint32_t wait) {
+    return (int)syscall(__NR_io_uring_enter,o->ring_fd,submit,wait,wait ? IORING_ENTER_GETEVENTS : 0,NULL,0);
+}
+
+/* submits the entries added so far, waiting for wait writes to finish.
+ * returns -1 if the ring can't be used */
+static int technicallyflac_output_uring_submit(technicallyflac_output *o, uint32_t wait) {
+    int r;
+
+    for(;;) {
+        r = technicallyflac_output_uring_enter(o,o->sq_pending,wait);
+        if(r >= 0) {
+            o->sq_pending -= (uint32_t)r;
+            return 0;
+        }
+        /* out of room for completions, they get picked up before the next try */
+        if(errno == EBUSY || errno == EAGAIN) return 0;
+        if(errno != EINTR) return -1;
+    }
+}
+
+/* puts the rest of buffer b in the submission queue. The ring has an entry
+ * for every buffer, and a buffer is only ever in it once, so there's always room */
+static void technicallyflac_output_uring_add(technicallyflac_output *o, uint32_t b) {
+    technicallyflac_output_slot *buf = &o->buffers[b];
+    struct io_uring_sqe *sqe;
+    uint32_t tail = *o->sq_tail;
+    uint32_t index;
+
+    index = tail & *o->sq_mask;
+    sqe = &((struct io_uring_sqe *)o->sqes)[index];
+    memset(sqe,0,sizeof(*sqe));
+    sqe->opcode = o->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = buf->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&o->memory[(size_t)b * o->buffer_len + buf->pos];
+    sqe->len = buf->len - buf->pos;
+    sqe->off = (uint64_t)buf->offset;
+    sqe->buf_index = 0;
+    sqe->user_data = b;
+
+    o->sq_array[index] = index;
+    __atomic_store_n(o->sq_tail,tail + 1,__ATOMIC_RELEASE);
+    o->sq_pending++;
+}
+
+/* handles every completion that's come in, called with the lock held */
+static void technicallyflac_output_uring_reap(technicallyflac_output *o) {
+    struct io_uring_cqe *cqe;
+    uint32_t head = *o->cq_head;
+    uint32_t b;
+
+    while(head != __atomic_load_n(o->cq_tail,__ATOMIC_ACQUIRE)) {
+        cqe = &((struct io_uring_cqe *)o->cqes)[head & *o->cq_mask];
+        b = (uint32_t)cqe->user_data;
+        head++;
+
+        if(cqe->res == -EAGAIN || cqe->res == -EINTR) {
+            technicallyflac_output_uring_add(o,b);
+        } else if(cqe->res < 0) {
+            technicallyflac_output_done(o,b,-cqe->res);
+        } else if(cqe->res == 0) {
+            /* nothing written and no error, the file can't take any more */
+            technicallyflac_output_done(o,b,ENOSPC);
+        } else if(technicallyflac_output_wrote(o,b,(size_t)cqe->res)) {
+            technicallyflac_output_uring_add(o,b);
+        } else {
+            technicallyflac_output_done(o,b,0);
+        }
+    }
+    __atomic_store_n(o->cq_head,head,__ATOMIC_RELEASE);
+}
+
+/* sets up the ring, returns -1 if io_uring isn't available */
+static int technicallyflac_output_uring_init(technicallyflac_output *o) {
+    struct io_uring_params p;
+    struct iovec iov;
+    uint8_t *sq;
+    uint8_t *cq;
+
+    /* an entry per buffer, the threads are used for more than the kernel allows (32768) */
+    memset(&p,0,sizeof(p));
+    o->ring_fd = (int)syscall(__NR_io_uring_setup,o->buffers_len,&p);
+    if(o->ring_fd < 0) return -1;
+
+    /* plain writes with an offset of -1 need 5.6, which also added this */
+    if(!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(o->ring_fd);
+        return -1;
+    }
+
+    o->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    o->cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(o->cq_ring_len > o->sq_ring_len) o->sq_ring_len = o->cq_ring_len;
+        o->cq_ring_len = 0;
+    }
+    o->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    o->sq_ring = mmap(NULL,o->sq_ring_len,PROT_READ | PROT_WRITE,MAP_SHARED,o->ring_fd,IORING_OFF_SQ_RING);
+    o->cq_ring = o->sq_ring;
+    if(o->sq_ring != MAP_FAILED && o->cq_ring_len) {
+        o->cq_ring = mmap(NULL,o->cq_ring_len,PROT_READ | PROT_WRITE,MAP_SHARED,o->ring_fd,IORING_OFF_CQ_RING);
+    }
+    o->sqes = mmap(NULL,o->sqes_len,PROT_READ | PROT_WRITE,MAP_SHARED,o->ring_fd,IORING_OFF_SQES);
+    if(o->sq_ring == MAP_FAILED || o->cq_ring == MAP_FAILED || o->sqes == MAP_FAILED) {
+        if(o->sqes != MAP_FAILED) munmap(o->sqes,o->sqes_len);
+        if(o->cq_ring != MAP_FAILED && o->cq_ring_len) munmap(o->cq_ring,o->cq_ring_len);
+        if(o->sq_ring != MAP_FAILED) munmap(o->sq_ring,o->sq_ring_len);
+        close(o->ring_fd);
+        return -1;
+    }
+
+    o->sq_pending = 0;
+    sq = (uint8_t *)o->sq_ring;
+    cq = (uint8_t *)o->cq_ring;
+    o->sq_head = (uint32_t *)(sq + p.sq_off.head);
+    o->sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+    o->sq_mask = (uint32_t *)(sq + p.sq_off.ring_mask);
+    o->sq_array = (uint32_t *)(sq + p.sq_off.array);
+    o->cq_head = (uint32_t *)(cq + p.cq_off.head);
+    o->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+    o->cq_mask = (uint32_t *)(cq + p.cq_off.ring_mask);
+    o->cqes = cq + p.cq_off.cqes;
+
+    /* the whole pool as one registered buffer, so the kernel doesn't pin
+     * and map each buffer on every write. It's fine without (eg. over
+     * RLIMIT_MEMLOCK), just slower */
+    iov.iov_base = o->memory;
+    iov.iov_len = (size_t)o->buffers_len * o->buffer_len;
+    o->registered = syscall(__NR_io_uring_register,o->ring_fd,IORING_REGISTER_BUFFERS,&iov,1) == 0;
+
+    o->uring = 1;
+    return 0;
+}
+
+static void technicallyflac_output_uring_free(technicallyflac_output *o) {
+    munmap(o->sqes,o->sqes_len);
+    if(o->cq_ring_len) munmap(o->cq_ring,o->cq_ring_len);
+    munmap(o->sq_ring,o->sq_ring_len);
+    close(o->ring_fd);
+}
+
+#endif
+
+/* writes buffer b out, waiting for room on non-blocking file descriptors.
+ * returns 0 or an errno */
+static int technicallyflac_output_write(technicallyflac_output *o, uint32_t b) {
+    technicallyflac_output_slot *buf = &o->buffers[b];
+    const uint8_t *data = &o->memory[(size_t)b * o->buffer_len];
+    struct pollfd pfd;
+    ssize_t r;
+
+    while(buf->pos < buf->len) {
+        if(buf->offset == -1) {
+            r = write(buf->fd,&data[buf->pos],buf->len - buf->pos);
+        } else {
+            r = pwrite(buf->fd,&data[buf->pos],buf->len - buf->pos,(off_t)buf->offset);
+        }
+        if(r < 0) {
+            if(errno == EINTR) continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK) return errno;
+            pfd.fd = buf->fd;
+            pfd.events = POLLOUT;
+            if(poll(&pfd,1,-1) < 0 && errno != EINTR) return errno;
+            continue;
+        }
+        if(r == 0) return ENOSPC;
+        technicallyflac_output_wrote(o,b,(size_t)r);
+    }
+    return 0;
+}
+
+static void *technicallyflac_output_worker(void *arg) {
+    technicallyflac_output *o = (technicallyflac_output *)arg;
+    uint32_t b;
+    int error;
+
+    pthread_mutex_lock(&o->lock);
+    while(!o->quit) {
+        if(o->work_first == TECHNICALLYFLAC_OUTPUT_NONE) {
+            pthread_cond_wait(&o->work,&o->lock);
+            continue;
+        }
+        b = o->work_first;
+        o->work_first = o->buffers[b].next;
+        pthread_mutex_unlock(&o->lock);
+
+        error = technicallyflac_output_write(o,b);
+
+        pthread_mutex_lock(&o->lock);
+        technicallyflac_output_done(o,b,error);
+    }
+    pthread_mutex_unlock(&o->lock);
+    return NULL;
+}
+
+/* starts the queued writes, called with the lock held */
+static void technicallyflac_output_start(technicallyflac_output *o) {
+    uint32_t b;
+    uint32_t next;
+
+    for(b=o->queued;b!=TECHNICALLYFLAC_OUTPUT_NONE;b=next) {
+        next = o->buffers[b].next;
+#ifdef TECHNICALLYFLAC_OUTPUT_URING
+        if(o->uring) {
+            technicallyflac_output_uring_add(o,b);
+            continue;
+        }
+#endif
+        technicallyflac_output_append(o,&o->work_first,&o->work_last,b);
+    }
+    o->queued = TECHNICALLYFLAC_OUTPUT_NONE;
+
+#ifdef TECHNICALLYFLAC_OUTPUT_URING
+    if(o->uring) {
+        if(o->sq_pending && technicallyflac_output_uring_submit(o,0) != 0 && o->error == 0) {
+            o->error = errno;
+            o->error_fd = o->ring_fd;
+        }
+        technicallyflac_output_uring_reap(o);
+        return;
+    }
+#endif
+    pthread_cond_broadcast(&o->work);
+}
+
+/* waits for a write to finish, called with the lock held. returns -1 if
+ * the ring has stopped working and nothing will */
+static int technicallyflac_output_wait(technicallyflac_output *o) {
+#ifdef TECHNICALLYFLAC_OUTPUT_URING
+    if(o->uring) {
+        if(technicallyflac_output_uring_submit(o,1) != 0) {
+            if(o->error == 0) {
+                o->error = errno;
+                o->error_fd = o->ring_fd;
+            }
+            return -1;
+        }
+        technicallyflac_output_uring_reap(o);
+        return 0;
+    }
+#endif
+    pthread_cond_wait(&o->done,&o->lock);
+    return 0;
+}
+
+int technicallyflac_output_init(technicallyflac_output *o, uint32_t buffers, uint32_t buffer_len, unsigned int threads) {
+    uint32_t i;
+
+    if(buffers == 0 || buffer_len == 0) return -1;
+    if(threads == 0) threads = 1;
+
+    o->buffer_len = buffer_len;
+    o->buffers_len = buffers;
+    o->free = TECHNICALLYFLAC_OUTPUT_NONE;
+    o->queued = TECHNICALLYFLAC_OUTPUT_NONE;
+    o->queued_last = TECHNICALLYFLAC_OUTPUT_NONE;
+    o->work_first = TECHNICALLYFLAC_OUTPUT_NONE;
+    o->work_last = TECHNICALLYFLAC_OUTPUT_NONE;
+    o->busy = 0;
+    o->error = 0;
+    o->error_fd = -1;
+    o->uring = 0;
+    o->registered = 0;
+    o->workers = NULL;
+    o->threads = 0;
+    o->quit = 0;
+
+    o->memory = (uint8_t *)malloc((size_t)buffers * buffer_len);
+    o->buffers = (technicallyflac_output_slot *)malloc(sizeof(technicallyflac_output_slot) * buffers);
+    if(o->memory == NULL || o->buffers == NULL) {
+        free(o->memory);
+        free(o->buffers);
+        return -1;
+    }
+    for(i=buffers;i>0;i--) {
+        o->buffers[i-1].next = o->free;
+        o->free = i-1;
+    }
+
+    pthread_mutex_init(&o->lock,NULL);
+    pthread_cond_init(&o->done,NULL);
+    pthread_cond_init(&o->work,NULL);
+
+#ifdef TECHNICALLYFLAC_OUTPUT_URING
+    if(technicallyflac_output_uring_init(o) == 0) return 0;
+#endif
+
+    o->workers = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+    if(o->workers == NULL) {
+        technicallyflac_output_free(o);
+        return -1;
+    }
+    for(i=0;i<threads;i++) {
+        if(pthread_create(&o->workers[i],NULL,technicallyflac_output_worker,o) != 0) {
+            technicallyflac_output_free(o);
+            return -1;
+        }
+        o->threads++;
+    }
+    return 0;
+}
+
+uint8_t *technicallyflac_output_buffer(technicallyflac_output *o) {
+    uint32_t b;
+
+    pthread_mutex_lock(&o->lock);
+    while(o->free == TECHNICALLYFLAC_OUTPUT_NONE) {
+        /* whatever is only queued can't come back until it's written */
+        if(o->queued != TECHNICALLYFLAC_OUTPUT_NONE) {
+            technicallyflac_output_start(o);
+            continue;
+        }
+        if(technicallyflac_output_wait(o) != 0) {
+            pthread_mutex_unlock(&o->lock);
+            return NULL;
+        }
+    }
+    b = o->free;
+    o->free = o->buffers[b].next;
+    pthread_mutex_unlock(&o->lock);
+
+    return &o->memory[(size_t)b * o->buffer_len];
+}
+
+void technicallyflac_output_queue(technicallyflac_output *o, uint8_t *buffer, uint32_t len, int fd, int64_t offset) {
+    uint32_t b = (uint32_t)((size_t)(buffer - o->memory) / o->buffer_len);
+    technicallyflac_output_slot *buf = &o->buffers[b];
+
+    buf->fd = fd;
+    buf->offset = offset;
+    buf->pos = 0;
+    buf->len = len;
+
+    pthread_mutex_lock(&o->lock);
+    o->busy++;
+    if(len == 0) {
+        technicallyflac_output_done(o,b,0);
+    } else {
+        technicallyflac_output_append(o,&o->queued,&o->queued_last,b);
+    }
+    pthread_mutex_unlock(&o->lock);
+}
+
+int technicallyflac_output_submit(technicallyflac_output *o) {
+    int r;
+
+    pthread_mutex_lock(&o->lock);
+    technicallyflac_output_start(o);
+    r = o->error ? -1 : 0;
+    pthread_mutex_unlock(&o->lock);
+    return r;
+}
+
+int technicallyflac_output_flush(technicallyflac_output *o) {
+    int r;
+
+    pthread_mutex_lock(&o->lock);
+    technicallyflac_output_start(o);
+    while(o->busy && technicallyflac_output_wait(o) == 0);
+    r = o->error ? -1 : 0;
+    pthread_mutex_unlock(&o->lock);
+    return r;
+}
+
+void technicallyflac_output_free(technicallyflac_output *o) {
+    unsigned int i;
+    uint32_t b;
+
+    /* writes that were only queued are dropped, the rest are waited for */
+    pthread_mutex_lock(&o->lock);
+    for(b=o->queued;b!=TECHNICALLYFLAC_OUTPUT_NONE;b=o->buffers[b].next) {
+        o->busy--;
+    }
+    o->queued = TECHNICALLYFLAC_OUTPUT_NONE;
+    while(o->busy && (o->uring || o->threads) && technicallyflac_output_wait(o) == 0);
+    o->quit = 1;
+    pthread_cond_broadcast(&o->work);
+    pthread_mutex_unlock(&o->lock);
+
+    for(i=0;i<o->threads;i++) {
+        pthread_join(o->workers[i],NULL);
+    }
+
+#ifdef TECHNICALLYFLAC_OUTPUT_URING
+    if(o->uring) technicallyflac_output_uring_free(o);
+#endif
+
+    pthread_cond_destroy(&o->work);
+    pthread_cond_destroy(&o->done);
+    pthread_mutex_destroy(&o->lock);
+
+    free(o->workers);
+    free(o->buffers);
+    free(o->memory);
+    o->workers = NULL;
+    o->buffers = NULL;
+    o->memory = NULL;
+    o->threads = 0;
+}
+
+#undef TECHNICALLYFLAC_OUTPUT_NONE
+
+#endif